@@ -0,0 +1,550 @@
+// breachcheck.c
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+#include <errno.h>
+#include <time.h>
+#include <unistd.h>
+#include <netdb.h>
+#include <sys/epoll.h>
+#include <sys/socket.h>
+#include <sys/un.h>
+#include <netinet/in.h>
+#include <netinet/tcp.h>
+#include "sha256_lib.h"
+#include "protocol.h"
+#include "breachcheck.h"
+
+#define DEFAULT_CONNECTIONS 4 // Pool size when none is given
+#define DEFAULT_TIMEOUT_MS 1000 // Request timeout when none is given
+#define DEFAULT_RECONNECT_MS 100 // Reconnect delay when none is given
+#define DEFAULT_MAX_PENDING 65536 // Outstanding request limit when none is given
+#define READ_CHUNK 16384 // Bytes read per recv call
+#define MAX_EVENTS 64 // Events handled per epoll_wait call
+
+// One check from bc_check to its callback
+typedef struct {
+    uint64_t handle; // 0 once cancelled or timed out; the slot stays until its reply arrives
+    uint32_t id; // request_id on the wire
+    uint8_t field; // BIN_FIELD_USERNAME, BIN_FIELD_PASSWORD or BIN_FIELD_BOTH
+    uint8_t digests[2][SHA256_DIGEST_SIZE]; // Payload, kept for resending after a reconnect
+    uint64_t deadline; // Monotonic nanoseconds
+    bc_callback callback;
+    void *arg;
+} bc_request;
+
+// Growable FIFO of requests
+typedef struct {
+    bc_request *items;
+    size_t head, count, cap;
+} bc_queue;
+
+// One pooled connection
+typedef struct {
+    int fd; // Socket, -1 while down
+    int connecting; // Non-blocking connect in progress
+    int broken; // A send failed outside bc_process; closed by the next bc_process
+    int want_write; // EPOLLOUT registered because the socket was full
+    uint64_t retry_at; // When to reconnect while down
+    bc_queue inflight; // Requests written to `out` or sent, in order; replies come back in this order
+    char *out; // Encoded frames not yet accepted by the socket
+    size_t out_off, out_len, out_cap;
+    char *in; // Received reply bytes not yet parsed
+    size_t in_len, in_cap;
+} bc_conn;
+
+struct bc_client {
+    bc_options options; // With defaults filled in
+    struct sockaddr_storage addr; // Resolved server address
+    socklen_t addr_len;
+    int epoll_fd; // Every pooled socket
+    bc_conn *conns;
+    bc_queue waiting; // Requests not yet assigned to a connection
+    uint64_t next_handle; // Last handle issued
+    size_t pending; // Requests whose callback has not run
+    int next_conn; // Round-robin position
+    int completed; // Callbacks run by the current bc_process
+};
+
+static uint64_t now_ns(void) {
+    struct timespec ts;
+    clock_gettime(CLOCK_MONOTONIC, &ts);
+    return (uint64_t)ts.tv_sec * 1000000000 + ts.tv_nsec;
+}
+
+static int queue_push(bc_queue *q, const bc_request *req) {
+    if (q->count == q->cap) {
+        size_t cap = q->cap ? q->cap * 2 : 64;
+        bc_request *items = malloc(cap * sizeof(*items));
+        if (!items) {
+            return -1;
+        }
+        for (size_t i = 0; i < q->count; i++) { // Unwrap into the new array
+            items[i] = q->items[(q->head + i) % q->cap];
+        }
+        free(q->items);
+        q->items = items;
+        q->head = 0;
+        q->cap = cap;
+    }
+    q->items[(q->head + q->count++) % q->cap] = *req;
+    return 0;
+}
+
+static bc_request *queue_at(const bc_queue *q, size_t i) {
+    return &q->items[(q->head + i) % q->cap];
+}
+
+static bc_request queue_pop(bc_queue *q) {
+    bc_request req = q->items[q->head];
+    q->head = (q->head + 1) % q->cap;
+    q->count--;
+    return req;
+}
+
+// Run a request's callback and retire it
+static void complete(bc_client *client, bc_request req, int status, int found) {
+    client->pending--;
+    client->completed++;
+    if (req.callback) {
+        req.callback(req.arg, req.handle, status, found);
+    }
+}
+
+static int buf_reserve(char **data, size_t *cap, size_t need) {
+    if (need <= *cap) {
+        return 0;
+    }
+    size_t grown = *cap ? *cap : 1024;
+    while (grown < need) {
+        grown *= 2;
+    }
+    char *p = realloc(*data, grown);
+    if (!p) {
+        return -1;
+    }
+    *data = p;
+    *cap = grown;
+    return 0;
+}
+
+// Encode one CHECK_BATCH frame for `req` and remember it as in flight on `conn`
+static int conn_queue(bc_conn *conn, const bc_request *req) {
+    size_t payload = req->field == BIN_FIELD_BOTH ? 2 * SHA256_DIGEST_SIZE : SHA256_DIGEST_SIZE;
+    if (conn->out_off == conn->out_len) {
+        conn->out_off = conn->out_len = 0;
+    }
+    if (buf_reserve(&conn->out, &conn->out_cap, conn->out_len + BIN_HEADER_SIZE + payload) != 0 ||
+        queue_push(&conn->inflight, req) != 0) {
+        return -1;
+    }
+    bin_header hdr = {BIN_VERSION, BIN_OP_CHECK_BATCH, req->field, req->id, 1, (uint32_t)payload};
+    bin_header_encode(&hdr, (uint8_t *)conn->out + conn->out_len);
+    const uint8_t *digest = req->field == BIN_FIELD_PASSWORD ? req->digests[1] : req->digests[0];
+    memcpy(conn->out + conn->out_len + BIN_HEADER_SIZE, digest, payload);
+    conn->out_len += BIN_HEADER_SIZE + payload;
+    return 0;
+}
+
+// Send queued frames until the socket is full, -1 on a fatal error
+static int conn_flush(bc_client *client, bc_conn *conn) {
+    if (conn->fd < 0 || conn->connecting) {
+        return 0;
+    }
+    while (conn->out_off < conn->out_len) {
+        ssize_t sent = send(conn->fd, conn->out + conn->out_off, conn->out_len - conn->out_off, MSG_NOSIGNAL);
+        if (sent > 0) {
+            conn->out_off += sent;
+        } else if (sent < 0 && errno == EINTR) {
+            continue;
+        } else if (sent < 0 && (errno == EAGAIN || errno == EWOULDBLOCK)) {
+            break;
+        } else {
+            return -1;
+        }
+    }
+    int want_write = conn->out_off < conn->out_len;
+    if (want_write != conn->want_write) { // Ask for EPOLLOUT only while the socket is full
+        struct epoll_event ev = {.events = EPOLLIN | (want_write ? EPOLLOUT : 0), .data.u32 = conn - client->conns};
+        epoll_ctl(client->epoll_fd, EPOLL_CTL_MOD, conn->fd, &ev);
+        conn->want_write = want_write;
+    }
+    return 0;
+}
+
+// Close a failed connection and put its unanswered requests back in line
+static void conn_down(bc_client *client, bc_conn *conn) {
+    if (conn->fd >= 0) {
+        close(conn->fd); // Also leaves the epoll set
+        conn->fd = -1;
+    }
+    while (conn->inflight.count > 0) {
+        bc_request req = queue_pop(&conn->inflight);
+        if (req.handle != 0 && queue_push(&client->waiting, &req) != 0) {
+            complete(client, req, BC_ERROR, 0); // Out of memory
+        }
+    }
+    conn->connecting = conn->broken = conn->want_write = 0;
+    conn->out_off = conn->out_len = conn->in_len = 0;
+    conn->retry_at = now_ns() + (uint64_t)client->options.reconnect_ms * 1000000;
+}
+
+// Start a non-blocking connect
+static void conn_open(bc_client *client, bc_conn *conn) {
+    conn->fd = socket(client->addr.ss_family, SOCK_STREAM | SOCK_NONBLOCK | SOCK_CLOEXEC, 0);
+    if (conn->fd < 0) {
+        conn_down(client, conn);
+        return;
+    }
+    if (client->addr.ss_family != AF_UNIX) {
+        int opt = 1; // Requests are tiny, do not hold them back for coalescing
+        setsockopt(conn->fd, IPPROTO_TCP, TCP_NODELAY, &opt, sizeof(opt));
+    }
+    int status = connect(conn->fd, (struct sockaddr *)&client->addr, client->addr_len);
+    if (status < 0 && errno != EINPROGRESS) {
+        conn_down(client, conn);
+        return;
+    }
+    conn->connecting = status < 0;
+    struct epoll_event ev = {.events = EPOLLIN | (conn->connecting ? EPOLLOUT : 0), .data.u32 = conn - client->conns};
+    conn->want_write = conn->connecting;
+    if (epoll_ctl(client->epoll_fd, EPOLL_CTL_ADD, conn->fd, &ev) != 0) {
+        conn_down(client, conn);
+    }
+}
+
+// Assign waiting requests to connected sockets, round robin
+static void dispatch(bc_client *client) {
+    int conns = client->options.connections;
+    while (client->waiting.count > 0) {
+        bc_conn *conn = NULL;
+        for (int i = 0; i < conns && !conn; i++) {
+            bc_conn *c = &client->conns[(client->next_conn + i) % conns];
+            if (c->fd >= 0 && !c->connecting && !c->broken) {
+                conn = c;
+                client->next_conn = (client->next_conn + i + 1) % conns;
+            }
+        }
+        if (!conn) {
+            return; // Nothing connected, wait for a reconnect
+        }
+        bc_request req = queue_pop(&client->waiting);
+        if (req.handle != 0 && conn_queue(conn, &req) != 0) {
+            complete(client, req, BC_ERROR, 0); // Out of memory
+        }
+    }
+}
+
+// Read and answer every complete reply, -1 if the connection failed
+static int conn_read(bc_client *client, bc_conn *conn) {
+    while (1) {
+        if (buf_reserve(&conn->in, &conn->in_cap, conn->in_len + READ_CHUNK) != 0) {
+            return -1;
+        }
+        ssize_t got = recv(conn->fd, conn->in + conn->in_len, READ_CHUNK, 0);
+        if (got == 0) {
+            return -1; // Server closed the connection
+        } else if (got < 0) {
+            if (errno == EINTR) {
+                continue;
+            }
+            return errno == EAGAIN || errno == EWOULDBLOCK ? 0 : -1;
+        }
+        conn->in_len += got;
+
+        size_t off = 0;
+        while (conn->in_len - off >= BIN_HEADER_SIZE) {
+            bin_header hdr;
+            if (bin_header_decode((const uint8_t *)conn->in + off, &hdr) != 0 || hdr.length > BIN_MAX_PAYLOAD) {
+                return -1; // Not a reply to our frames
+            }
+            if (conn->in_len - off < BIN_HEADER_SIZE + hdr.length) {
+                break; // Rest of the frame not here yet
+            }
+            if (conn->inflight.count == 0 || queue_at(&conn->inflight, 0)->id != hdr.request_id) {
+                return -1; // Replies come back in request order
+            }
+            bc_request req = queue_pop(&conn->inflight);
+            const uint8_t *bitmap = (const uint8_t *)conn->in + off + BIN_HEADER_SIZE;
+            off += BIN_HEADER_SIZE + hdr.length;
+            if (req.handle == 0) {
+                continue; // Cancelled or already timed out
+            }
+            if (hdr.field != BIN_STATUS_OK || hdr.length < 1) {
+                complete(client, req, BC_ERROR, 0);
+                continue;
+            }
+            int found = 0;
+            if (req.field == BIN_FIELD_BOTH) {
+                found = (bitmap[0] & 1 ? BC_FOUND_USERNAME : 0) | (bitmap[0] & 2 ? BC_FOUND_PASSWORD : 0);
+            } else if (bitmap[0] & 1) {
+                found = req.field == BIN_FIELD_USERNAME ? BC_FOUND_USERNAME : BC_FOUND_PASSWORD;
+            }
+            complete(client, req, BC_OK, found);
+        }
+        memmove(conn->in, conn->in + off, conn->in_len - off);
+        conn->in_len -= off;
+    }
+}
+
+// Time out expired requests; in-flight ones keep their slot until their reply arrives
+static void expire(bc_client *client, uint64_t now) {
+    bc_queue *waiting = &client->waiting;
+    size_t kept = 0; // Drop dead entries first so the queue stays bounded while the server is down
+    for (size_t i = 0; i < waiting->count; i++) {
+        bc_request *req = queue_at(waiting, i);
+        if (req->handle != 0) {
+            *queue_at(waiting, kept++) = *req;
+        }
+    }
+    waiting->count = kept;
+    for (size_t i = 0; i < waiting->count; i++) {
+        bc_request *req = queue_at(waiting, i);
+        if (req->handle != 0 && req->deadline <= now) {
+            bc_request expired = *req;
+            req->handle = 0;
+            complete(client, expired, BC_TIMEOUT, 0);
+        }
+    }
+    for (int c = 0; c < client->options.connections; c++) {
+        bc_queue *q = &client->conns[c].inflight;
+        for (size_t i = 0; i < q->count; i++) { // Oldest first, so stop at the first live request not due
+            bc_request *req = queue_at(q, i);
+            if (req->handle == 0) {
+                continue;
+            }
+            if (req->deadline > now) {
+                break;
+            }
+            bc_request expired = *req;
+            req->handle = 0;
+            complete(client, expired, BC_TIMEOUT, 0);
+        }
+    }
+}
+
+bc_client *bc_create(const bc_options *options) {
+    bc_client *client = calloc(1, sizeof(*client));
+    if (!client) {
+        return NULL;
+    }
+    client->options = *options;
+    bc_options *o = &client->options;
+    o->connections = o->connections > 0 ? o->connections : DEFAULT_CONNECTIONS;
+    o->timeout_ms = o->timeout_ms > 0 ? o->timeout_ms : DEFAULT_TIMEOUT_MS;
+    o->reconnect_ms = o->reconnect_ms > 0 ? o->reconnect_ms : DEFAULT_RECONNECT_MS;
+    o->max_pending = o->max_pending > 0 ? o->max_pending : DEFAULT_MAX_PENDING;
+
+    if (o->host && strchr(o->host, '/')) { // Unix domain socket of a server on this host
+        struct sockaddr_un *address = (struct sockaddr_un *)&client->addr;
+        if (strlen(o->host) >= sizeof(address->sun_path)) {
+            free(client);
+            errno = ENAMETOOLONG;
+            return NULL;
+        }
+        address->sun_family = AF_UNIX;
+        strcpy(address->sun_path, o->host);
+        client->addr_len = sizeof(*address);
+    }
+
+    struct addrinfo hints, *addrs;
+    memset(&hints, 0, sizeof(hints));
+    hints.ai_family = AF_UNSPEC;
+    hints.ai_socktype = SOCK_STREAM;
+    char service[16];
+    snprintf(service, sizeof(service), "%d", o->port);
+    if (client->addr_len == 0) {
+        if (!o->host || getaddrinfo(o->host, service, &hints, &addrs) != 0) { // Resolved once, reconnects reuse it
+            free(client);
+            errno = EINVAL;
+            return NULL;
+        }
+        memcpy(&client->addr, addrs->ai_addr, addrs->ai_addrlen);
+        client->addr_len = addrs->ai_addrlen;
+        freeaddrinfo(addrs);
+    }
+    o->host = NULL; // The caller's string need not outlive bc_create
+
+    client->epoll_fd = epoll_create1(EPOLL_CLOEXEC);
+    client->conns = calloc(o->connections, sizeof(*client->conns));
+    if (client->epoll_fd < 0 || !client->conns) {
+        int saved = errno;
+        bc_destroy(client);
+        errno = saved;
+        return NULL;
+    }
+    for (int i = 0; i < o->connections; i++) {
+        client->conns[i].fd = -1;
+        conn_open(client, &client->conns[i]);
+    }
+    return client;
+}
+
+void bc_destroy(bc_client *client) {
+    if (!client) {
+        return;
+    }
+    for (int i = 0; client->conns && i < client->options.connections; i++) {
+        bc_conn *conn = &client->conns[i];
+        if (conn->fd >= 0) {
+            close(conn->fd);
+        }
+        free(conn->inflight.items);
+        free(conn->out);
+        free(conn->in);
+    }
+    if (client->epoll_fd >= 0) {
+        close(client->epoll_fd);
+    }
+    free(client->waiting.items);
+    free(client->conns);
+    free(client);
+}
+
+uint64_t bc_check(bc_client *client, const char *username, size_t username_len, const char *password,
+                  size_t password_len, bc_callback callback, void *arg) {
+    if (!username && !password) {
+        errno = EINVAL;
+        return 0;
+    }
+    if (client->pending >= client->options.max_pending) {
+        errno = EAGAIN;
+        return 0;
+    }
+    bc_request req;
+    memset(&req, 0, sizeof(req));
+    req.field = username && password ? BIN_FIELD_BOTH : username ? BIN_FIELD_USERNAME : BIN_FIELD_PASSWORD;
+    SHA256_CTX ctx;
+    if (username) {
+        sha256_init(&ctx);
+        sha256_update(&ctx, (const uint8_t *)username, username_len);
+        sha256_final(&ctx, req.digests[0]);
+    }
+    if (password) {
+        sha256_init(&ctx);
+        sha256_update(&ctx, (const uint8_t *)password, password_len);
+        sha256_final(&ctx, req.digests[1]);
+    }
+    req.handle = ++client->next_handle;
+    req.id = (uint32_t)req.handle;
+    req.deadline = now_ns() + (uint64_t)client->options.timeout_ms * 1000000;
+    req.callback = callback;
+    req.arg = arg;
+    if (queue_push(&client->waiting, &req) != 0) {
+        return 0;
+    }
+    client->pending++;
+
+    dispatch(client);
+    for (int i = 0; i < client->options.connections; i++) { // Send now rather than on the next bc_process
+        bc_conn *conn = &client->conns[i];
+        if (conn->out_off < conn->out_len && conn_flush(client, conn) != 0) {
+            conn->broken = 1; // Closed by bc_process, which may be the caller of this callback
+        }
+    }
+    return req.handle;
+}
+
+int bc_cancel(bc_client *client, uint64_t handle) {
+    bc_queue *queues[1 + client->options.connections];
+    queues[0] = &client->waiting;
+    for (int i = 0; i < client->options.connections; i++) {
+        queues[i + 1] = &client->conns[i].inflight;
+    }
+    for (int q = 0; q <= client->options.connections; q++) {
+        for (size_t i = 0; handle != 0 && i < queues[q]->count; i++) {
+            bc_request *req = queue_at(queues[q], i);
+            if (req->handle == handle) {
+                req->handle = 0; // Its reply, if any, is skipped
+                client->pending--;
+                return 0;
+            }
+        }
+    }
+    return -1;
+}
+
+int bc_fd(const bc_client *client) {
+    return client->epoll_fd;
+}
+
+int bc_timeout(const bc_client *client) {
+    uint64_t now = now_ns(), due = UINT64_MAX;
+    for (size_t i = 0; i < client->waiting.count; i++) {
+        const bc_request *req = queue_at(&client->waiting, i);
+        if (req->handle != 0 && req->deadline < due) {
+            due = req->deadline;
+        }
+    }
+    for (int c = 0; c < client->options.connections; c++) {
+        const bc_conn *conn = &client->conns[c];
+        if (conn->fd < 0 && conn->retry_at < due) {
+            due = conn->retry_at;
+        }
+        for (size_t i = 0; i < conn->inflight.count; i++) {
+            const bc_request *req = queue_at(&conn->inflight, i);
+            if (req->handle != 0) {
+                due = req->deadline < due ? req->deadline : due; // The oldest live one is due first
+                break;
+            }
+        }
+    }
+    if (due == UINT64_MAX) {
+        return -1;
+    }
+    return due <= now ? 0 : (int)((due - now + 999999) / 1000000);
+}
+
+int bc_process(bc_client *client, int timeout_ms) {
+    client->completed = 0;
+    int due = bc_timeout(client);
+    if (due >= 0 && (timeout_ms < 0 || due < timeout_ms)) {
+        timeout_ms = due;
+    }
+    struct epoll_event events[MAX_EVENTS];
+    int n = epoll_wait(client->epoll_fd, events, MAX_EVENTS, timeout_ms);
+    if (n < 0 && errno != EINTR) {
+        return -1;
+    }
+    for (int i = 0; i < n; i++) {
+        bc_conn *conn = &client->conns[events[i].data.u32];
+        if (conn->fd < 0) {
+            continue; // Closed earlier in this batch
+        }
+        if (conn->connecting) {
+            int error = 0;
+            socklen_t len = sizeof(error);
+            if (getsockopt(conn->fd, SOL_SOCKET, SO_ERROR, &error, &len) != 0 || error != 0) {
+                conn_down(client, conn);
+                continue;
+            }
+            conn->connecting = 0; // Connected; conn_flush drops EPOLLOUT once nothing is queued
+        }
+        if ((events[i].events & (EPOLLIN | EPOLLERR | EPOLLHUP)) && conn_read(client, conn) != 0) {
+            conn_down(client, conn);
+        }
+    }
+
+    uint64_t now = now_ns();
+    for (int c = 0; c < client->options.connections; c++) {
+        bc_conn *conn = &client->conns[c];
+        if (conn->broken) {
+            conn_down(client, conn);
+        }
+        if (conn->fd < 0 && now >= conn->retry_at) {
+            conn_open(client, conn);
+        }
+    }
+    dispatch(client);
+    for (int c = 0; c < client->options.connections; c++) {
+        if (conn_flush(client, &client->conns[c]) != 0) {
+            conn_down(client, &client->conns[c]);
+        }
+    }
+    expire(client, now);
+    return client->completed;
+}
+
+size_t bc_pending(const bc_client *client) {
+    return client->pending;
+}
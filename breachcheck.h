@@ -0,0 +1,53 @@
+// breachcheck.h
+// libbreachcheck: non-blocking client library for applications that check credentials
+// inline, e.g. on every sign-in. A client keeps a pool of persistent connections to
+// one server and speaks the binary protocol (protocol.h), so many checks can be in
+// flight on each connection. bc_check hashes the credentials, queues the request and
+// returns a handle at once; the answer arrives through a callback run from
+// bc_process. Applications with an event loop watch bc_fd and call bc_process when it
+// is readable or when bc_timeout expires; others call bc_process with a timeout.
+// Connections that fail are reopened after a delay, and their unanswered requests are
+// resent on another connection until the request's own timeout expires.
+//
+// A client is not thread-safe: use it from one thread at a time, or one per thread.
+
+#ifndef _BREACHCHECK_H_
+#define _BREACHCHECK_H_
+
+#include <stddef.h>
+#include <stdint.h>
+
+#define BC_FOUND_USERNAME 0x01 // `found` bit: the username/email is in a breach
+#define BC_FOUND_PASSWORD 0x02 // `found` bit: the password is in a breach
+
+// Request outcome passed to the callback
+#define BC_OK 0 // Answered, see `found`
+#define BC_TIMEOUT 1 // No answer within the timeout
+#define BC_ERROR 2 // The server rejected the request
+
+typedef struct bc_client bc_client;
+
+// Called once per request from bc_process, unless the request was cancelled
+typedef void (*bc_callback)(void *arg, uint64_t handle, int status, int found);
+
+// Client settings; zero fields take the defaults
+typedef struct {
+    const char *host; // Server name or address, or a Unix domain socket path (contains '/')
+    int port; // Server port, unused with a path
+    int connections; // Pool size (default 4)
+    int timeout_ms; // Per-request timeout (default 1000)
+    int reconnect_ms; // Delay before reopening a failed connection (default 100)
+    size_t max_pending; // Requests outstanding before bc_check fails with EAGAIN (default 65536)
+} bc_options;
+
+bc_client *bc_create(const bc_options *options); // Resolve the server and start connecting, NULL on error
+void bc_destroy(bc_client *client); // Close every connection; outstanding requests get no callback
+uint64_t bc_check(bc_client *client, const char *username, size_t username_len, const char *password,
+                  size_t password_len, bc_callback callback, void *arg); // Queue a check, 0 on error
+int bc_cancel(bc_client *client, uint64_t handle); // Drop a request without a callback, -1 if it is not pending
+int bc_fd(const bc_client *client); // Readable when bc_process has I/O to do
+int bc_timeout(const bc_client *client); // Milliseconds until bc_process is due anyway, -1 for never
+int bc_process(bc_client *client, int timeout_ms); // Do pending I/O and run callbacks, returns how many ran
+size_t bc_pending(const bc_client *client); // Requests not yet completed
+
+#endif
@@ -0,0 +1,120 @@
+// build_index.c
+// Offline compiler from credentials*-sha256.txt files, or plain "user:password" dumps
+// with -p, to the binary index file the server maps at startup (layout in cred_index.h).
+// Inputs are parsed on -j threads and sorted within -M MB of memory, spilling sorted
+// runs to -T when they do not fit (see ingest.h). With -s and -n it writes only the
+// digests one shard owns, so each server of a sharded deployment maps a file of its
+// own size. An existing index file given as the only input is re-sharded directly.
+#include <stdio.h> // Standard I/O library
+#include <stdlib.h> // Standard library for memory allocation, process control, etc.
+#include <string.h> // String handling functions
+#include <unistd.h> // getopt
+#include <time.h> // Throughput timing
+#include "cred_index.h" // Sorted binary digest sets and index files
+#include "ingest.h" // Parallel parse and external sort of large inputs
+
+int main(int argc, char *argv[]) {
+    cred_index index;
+
+    if (argc == 3 && strcmp(argv[1], "-v") == 0) { // Check an existing index file
+        if (cred_index_map(&index, argv[2]) != 0 || cred_index_verify(&index) != 0) {
+            perror("Index file is not valid"); // Print error if the file is damaged
+            exit(EXIT_FAILURE);
+        }
+        printf("%s: %zu username and %zu password hashes, ", argv[2], index.usernames.count, index.passwords.count);
+        if (index.pairs.indexed) {
+            printf("%zu pairs, ", index.pairs.count);
+        } else {
+            printf("no pairs, ");
+        }
+        printf("%s, checksum OK\n", index.usernames.refs ? "line counts" : "no line counts");
+        cred_index_free(&index);
+        return 0;
+    }
+
+    const char *shard_map_file = NULL; // Write one shard of this map
+    const char *shard_name = NULL; // Name of the shard to write
+    ingest_options options = {
+        .threads = (int)sysconf(_SC_NPROCESSORS_ONLN),
+        .memory = INGEST_DEFAULT_MEMORY,
+        .tmpdir = getenv("TMPDIR") ? getenv("TMPDIR") : "/tmp",
+    };
+    int opt;
+    while ((opt = getopt(argc, argv, "s:n:pj:M:T:")) != -1) {
+        if (opt == 's') {
+            shard_map_file = optarg;
+        } else if (opt == 'n') {
+            shard_name = optarg;
+        } else if (opt == 'p') {
+            options.plain = 1;
+        } else if (opt == 'j') {
+            options.threads = atoi(optarg);
+        } else if (opt == 'M') {
+            options.memory = (size_t)atol(optarg) << 20;
+        } else if (opt == 'T') {
+            options.tmpdir = optarg;
+        } else {
+            argc = 0; // Force the usage message
+            break;
+        }
+    }
+
+    if (argc - optind < 2 || !shard_map_file != !shard_name || options.threads < 1 || options.memory == 0) {
+        fprintf(stderr, "Usage: %s [-p] [-j jobs] [-M megabytes] [-T tmpdir] [-s shard_map -n shard] "
+                        "<credentials_file>... <index_file>\n"
+                        "       %s -v <index_file>\n", argv[0], argv[0]);
+        exit(EXIT_FAILURE); // Exit if arguments are incorrect
+    }
+
+    shard_map shards = {0};
+    int shard = 0;
+    if (shard_map_file) {
+        if (shard_map_load(&shards, shard_map_file) != 0) {
+            perror("Failed to load shard map");
+            exit(EXIT_FAILURE);
+        }
+        if ((shard = shard_map_find(&shards, shard_name)) < 0) {
+            fprintf(stderr, "Shard %s is not in %s\n", shard_name, shard_map_file);
+            exit(EXIT_FAILURE);
+        }
+    }
+
+    int inputs = argc - optind - 1;
+    const char *output = argv[argc - 1];
+    if (inputs == 1 && !options.plain && cred_index_is_file(argv[optind])) { // Re-shard an existing index
+        if (cred_index_open_shard(&index, argv[optind], shard_map_file ? &shards : NULL, shard) != 0) {
+            perror("Failed to load index file");
+            exit(EXIT_FAILURE);
+        }
+        if (cred_index_save(&index, output) != 0) {
+            perror("Failed to write index file"); // Print error if writing fails
+            exit(EXIT_FAILURE);
+        }
+        printf("Wrote %zu username and %zu password hashes and %zu pairs to %s\n",
+               index.usernames.count, index.passwords.count, index.pairs.count, output);
+        cred_index_free(&index);
+        shard_map_free(&shards);
+        return 0;
+    }
+
+    options.map = shard_map_file ? &shards : NULL;
+    options.shard = shard;
+    ingest_totals totals;
+    struct timespec start, end;
+    clock_gettime(CLOCK_MONOTONIC, &start);
+    if (ingest_files((const char *const *)argv + optind, inputs, output, &options, &totals) != 0) { // Parse, sort and de-duplicate both fields
+        perror("Failed to build index file"); // Print error if loading or writing fails
+        exit(EXIT_FAILURE);
+    }
+    clock_gettime(CLOCK_MONOTONIC, &end);
+    double seconds = (end.tv_sec - start.tv_sec) + (end.tv_nsec - start.tv_nsec) / 1e9;
+    if (totals.skipped) {
+        fprintf(stderr, "Skipped %llu malformed lines\n", totals.skipped);
+    }
+    printf("Read %llu lines (%.1f MB) in %.2f s, %.1f MB/s, %llu sorted runs spilled\n", totals.lines,
+           totals.bytes / 1e6, seconds, seconds > 0 ? totals.bytes / 1e6 / seconds : 0.0, totals.runs);
+    printf("Wrote %llu username and %llu password hashes and %llu pairs to %s\n", totals.unique[0], totals.unique[1],
+           totals.unique[2], output);
+    shard_map_free(&shards);
+    return 0;
+}
@@ -0,0 +1,452 @@
+// bulk.c
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+#include <errno.h>
+#include <time.h>
+#include <unistd.h>
+#include <fcntl.h>
+#include <pthread.h>
+#include <sys/mman.h>
+#include <sys/socket.h>
+#include <sys/uio.h>
+#include <sys/stat.h>
+#include "sha256_lib.h"
+#include "protocol.h"
+#include "shard.h"
+#include "bulk.h"
+
+#define SLICE_SIZE (1 << 20) // Input bytes handed to a worker at a time
+#define REPORT_INTERVAL 1.0 // Seconds between progress lines
+#define POLL_INTERVAL_US 50000 // How often the main thread checks for completion
+
+// One line of input waiting for its answer
+typedef struct {
+    const char *user; // Username/email, not NUL-terminated
+    size_t user_len;
+    const char *password; // Password, not NUL-terminated
+    size_t password_len;
+} bulk_entry;
+
+// Lines whose digests have been sent to their shards and not yet answered. Digests
+// are grouped by (shard, field) so each group goes out as one CHECK_BATCH frame.
+typedef struct {
+    bulk_entry entries[BIN_MAX_BATCH]; // Lines in this batch
+    uint32_t count; // Number of lines
+    uint8_t found[BIN_MAX_BATCH]; // Bit 0 username, bit 1 password of each line
+    uint8_t payload[BIN_MAX_BATCH * 2][SHA256_DIGEST_SIZE]; // Digests in group order
+    uint16_t item[BIN_MAX_BATCH * 2]; // Line * 2 + field of each payload digest
+    uint32_t *groups; // Start of each group in `payload`, shard * 2 + field, plus the end
+} bulk_batch;
+
+// State shared by every worker
+typedef struct {
+    const shard_map *map; // Shards and their replicas
+    const char *data; // Mapped input file
+    size_t size; // Input size in bytes
+    size_t next; // Offset of the first line not yet handed out
+    pthread_mutex_t lock; // Protects `next` and `out`
+    FILE *out; // Matches file
+    uint64_t lookups; // Lines checked, updated atomically
+    uint64_t matches; // Lines with any hit, updated atomically
+    uint64_t skipped; // Lines without a ':' separator, updated atomically
+    int failed; // A worker lost every replica of a shard, accessed atomically
+} bulk_job;
+
+// One worker's connections and batches in flight
+typedef struct {
+    bulk_job *job;
+    int *socks; // Connection to each shard, -1 until first needed
+    int *replicas; // Replica each connection goes to
+    bulk_batch *ring; // Batches in flight, batch n at ring[n % BULK_PIPELINE_DEPTH]
+    uint32_t sent, done; // Batches issued and answered
+    uint8_t (*digests)[SHA256_DIGEST_SIZE]; // Scratch for hashing a batch in line order
+} bulk_worker_state;
+
+static double monotonic_seconds(void) {
+    struct timespec ts;
+    clock_gettime(CLOCK_MONOTONIC, &ts);
+    return ts.tv_sec + ts.tv_nsec / 1e9;
+}
+
+// Hand out the next slice of whole lines, 0 when the input is exhausted
+static int take_slice(bulk_job *job, const char **start, const char **end) {
+    pthread_mutex_lock(&job->lock);
+    size_t from = job->next;
+    size_t to = from + SLICE_SIZE < job->size ? from + SLICE_SIZE : job->size;
+    if (to < job->size) { // Extend to the end of the line
+        const char *nl = memchr(job->data + to, '\n', job->size - to);
+        to = nl ? (size_t)(nl - job->data) + 1 : job->size;
+    }
+    job->next = to;
+    pthread_mutex_unlock(&job->lock);
+
+    *start = job->data + from;
+    *end = job->data + to;
+    return from < to;
+}
+
+// Fill a batch from the worker's current slice, taking new slices as needed
+static void fill_batch(bulk_job *job, bulk_batch *batch, const char **pos, const char **end) {
+    batch->count = 0;
+    while (batch->count < BIN_MAX_BATCH) {
+        if (*pos == *end && !take_slice(job, pos, end)) {
+            return; // Input exhausted
+        }
+        const char *line = *pos;
+        const char *nl = memchr(line, '\n', *end - line);
+        size_t len = nl ? (size_t)(nl - line) : (size_t)(*end - line);
+        *pos = nl ? nl + 1 : *end;
+        if (len > 0 && line[len - 1] == '\r') {
+            len--;
+        }
+        if (len == 0) {
+            continue; // Blank line
+        }
+
+        const char *colon = memchr(line, ':', len); // Passwords may contain ':', usernames may not
+        if (!colon) {
+            __atomic_fetch_add(&job->skipped, 1, __ATOMIC_RELAXED);
+            continue;
+        }
+        bulk_entry *e = &batch->entries[batch->count++];
+        e->user = line;
+        e->user_len = colon - line;
+        e->password = colon + 1;
+        e->password_len = len - e->user_len - 1;
+    }
+}
+
+// Hash a filled batch and group its digests by owning shard and field
+static void route_batch(bulk_worker_state *w, bulk_batch *batch) {
+    static __thread const uint8_t *msgs[BIN_MAX_BATCH * 2];
+    static __thread size_t lens[BIN_MAX_BATCH * 2];
+    for (uint32_t i = 0; i < batch->count; i++) { // Username then password of each line
+        msgs[2 * i] = (const uint8_t *)batch->entries[i].user;
+        lens[2 * i] = batch->entries[i].user_len;
+        msgs[2 * i + 1] = (const uint8_t *)batch->entries[i].password;
+        lens[2 * i + 1] = batch->entries[i].password_len;
+    }
+    sha256_batch(msgs, lens, batch->count * 2, w->digests);
+    memset(batch->found, 0, batch->count);
+
+    static __thread uint32_t group_of[BIN_MAX_BATCH * 2];
+    int groups = w->job->map->count * 2;
+    memset(batch->groups, 0, sizeof(*batch->groups) * (groups + 1));
+    for (uint32_t d = 0; d < batch->count * 2; d++) { // Counting sort by group
+        group_of[d] = shard_owner(w->job->map, w->digests[d]) * 2 + d % 2;
+        batch->groups[group_of[d] + 1]++;
+    }
+    for (int g = 0; g < groups; g++) {
+        batch->groups[g + 1] += batch->groups[g];
+    }
+    static __thread uint32_t fill[BIN_MAX_BATCH * 2];
+    memcpy(fill, batch->groups, sizeof(*fill) * groups);
+    for (uint32_t d = 0; d < batch->count * 2; d++) {
+        uint32_t at = fill[group_of[d]]++;
+        memcpy(batch->payload[at], w->digests[d], SHA256_DIGEST_SIZE);
+        batch->item[at] = (uint16_t)d;
+    }
+}
+
+// Send one shard's frames of batch `id`, -1 on a connection error
+static int send_shard(bulk_worker_state *w, int shard, uint32_t id) {
+    const bulk_batch *batch = &w->ring[id % BULK_PIPELINE_DEPTH];
+    for (int field = 0; field < 2; field++) {
+        uint32_t first = batch->groups[shard * 2 + field], count = batch->groups[shard * 2 + field + 1] - first;
+        if (count == 0) {
+            continue; // Nothing for this shard
+        }
+        uint8_t raw[BIN_HEADER_SIZE];
+        bin_header hdr = {BIN_VERSION, BIN_OP_CHECK_BATCH, field ? BIN_FIELD_PASSWORD : BIN_FIELD_USERNAME,
+                          id * 2 + field, count, count * SHA256_DIGEST_SIZE};
+        bin_header_encode(&hdr, raw);
+        struct iovec iov[2] = {{raw, sizeof(raw)}, {(void *)batch->payload[first], hdr.length}};
+        struct msghdr msg = {.msg_iov = iov, .msg_iovlen = 2};
+        size_t left = sizeof(raw) + hdr.length;
+        while (left > 0) {
+            ssize_t n = sendmsg(w->socks[shard], &msg, MSG_NOSIGNAL);
+            if (n < 0 && errno == EINTR) {
+                continue;
+            }
+            if (n <= 0) {
+                return -1;
+            }
+            left -= n;
+            while (msg.msg_iovlen > 0 && (size_t)n >= msg.msg_iov->iov_len) { // Skip what was sent
+                n -= msg.msg_iov->iov_len;
+                msg.msg_iov++;
+                msg.msg_iovlen--;
+            }
+            if (msg.msg_iovlen > 0) {
+                msg.msg_iov->iov_base = (char *)msg.msg_iov->iov_base + n;
+                msg.msg_iov->iov_len -= n;
+            }
+        }
+    }
+    return 0;
+}
+
+static int recv_full(int sock, void *buf, size_t len) {
+    size_t got = 0;
+    while (got < len) {
+        ssize_t n = recv(sock, (char *)buf + got, len - got, 0);
+        if (n < 0 && errno == EINTR) {
+            continue;
+        }
+        if (n <= 0) {
+            return -1;
+        }
+        got += n;
+    }
+    return 0;
+}
+
+// Read one shard's replies to batch `id` into its found bits, -1 on error
+static int recv_shard(bulk_worker_state *w, int shard, uint32_t id) {
+    bulk_batch *batch = &w->ring[id % BULK_PIPELINE_DEPTH];
+    for (int field = 0; field < 2; field++) {
+        uint32_t first = batch->groups[shard * 2 + field], count = batch->groups[shard * 2 + field + 1] - first;
+        if (count == 0) {
+            continue;
+        }
+        uint8_t raw[BIN_HEADER_SIZE];
+        uint8_t bitmap[(BIN_MAX_BATCH * 2 + 7) / 8];
+        bin_header hdr;
+        if (recv_full(w->socks[shard], raw, sizeof(raw)) != 0 || bin_header_decode(raw, &hdr) != 0 ||
+            hdr.length > sizeof(bitmap) || recv_full(w->socks[shard], bitmap, hdr.length) != 0) {
+            return -1;
+        }
+        if (hdr.request_id != id * 2 + field || hdr.field != BIN_STATUS_OK ||
+            hdr.length != bin_bitmap_size(BIN_FIELD_USERNAME, count)) {
+            fprintf(stderr, "Unexpected reply to batch %u from shard %s (status %u)\n", id,
+                    w->job->map->shards[shard].name, hdr.field);
+            return -1;
+        }
+        for (uint32_t k = 0; k < count; k++) {
+            if (bitmap[k / 8] & (1 << (k % 8))) {
+                uint16_t item = batch->item[first + k];
+                batch->found[item / 2] |= 1 << (item % 2); // Idempotent, so a resent frame is harmless
+            }
+        }
+    }
+    return 0;
+}
+
+// Connect to the next replica of a shard and resend its frames still in flight.
+// -1 once every replica has been tried without success.
+static int fail_over(bulk_worker_state *w, int shard, int *attempts) {
+    const shard_entry *s = &w->job->map->shards[shard];
+    while ((*attempts)++ < s->replica_count) {
+        if (w->socks[shard] >= 0) {
+            close(w->socks[shard]);
+            w->replicas[shard] = (w->replicas[shard] + 1) % s->replica_count; // Try the next one first
+        }
+        w->socks[shard] = shard_connect(w->job->map, shard, &w->replicas[shard]);
+        if (w->socks[shard] < 0) {
+            return -1; // shard_connect already tried every replica
+        }
+        uint32_t id = w->done;
+        while (id != w->sent && send_shard(w, shard, id) == 0) {
+            id++;
+        }
+        if (id == w->sent) {
+            return 0;
+        }
+    }
+    return -1;
+}
+
+// Write the matches of the oldest batch
+static void finish_batch(bulk_job *job, const bulk_batch *batch) {
+    static const char *results[] = {NULL, "FoundUsernameOnly", "FoundPasswordOnly", "FoundBoth"};
+    uint64_t matches = 0;
+    pthread_mutex_lock(&job->lock);
+    for (uint32_t i = 0; i < batch->count; i++) {
+        if (batch->found[i]) {
+            const bulk_entry *e = &batch->entries[i];
+            fprintf(job->out, "%.*s\t%s\n", (int)e->user_len, e->user, results[batch->found[i]]); // Never the password
+            matches++;
+        }
+    }
+    pthread_mutex_unlock(&job->lock);
+    __atomic_fetch_add(&job->matches, matches, __ATOMIC_RELAXED);
+    __atomic_fetch_add(&job->lookups, batch->count, __ATOMIC_RELAXED);
+}
+
+// Send batch `w->sent` to every shard it has digests for, 0 on success
+static int issue_batch(bulk_worker_state *w) {
+    const bulk_batch *batch = &w->ring[w->sent % BULK_PIPELINE_DEPTH];
+    for (int s = 0; s < w->job->map->count; s++) {
+        if (batch->groups[s * 2] == batch->groups[s * 2 + 2]) {
+            continue;
+        }
+        int attempts = 0;
+        while (w->socks[s] < 0 || send_shard(w, s, w->sent) != 0) {
+            if (fail_over(w, s, &attempts) != 0) {
+                return -1;
+            }
+        }
+    }
+    w->sent++;
+    return 0;
+}
+
+// Collect every shard's replies to batch `w->done`, 0 on success
+static int collect_batch(bulk_worker_state *w) {
+    for (int s = 0; s < w->job->map->count; s++) {
+        int attempts = 0;
+        while (recv_shard(w, s, w->done) != 0) {
+            if (fail_over(w, s, &attempts) != 0) {
+                return -1;
+            }
+        }
+    }
+    finish_batch(w->job, &w->ring[w->done % BULK_PIPELINE_DEPTH]);
+    w->done++;
+    return 0;
+}
+
+static void *bulk_worker(void *arg) {
+    bulk_job *job = arg;
+    int shards = job->map->count;
+    bulk_worker_state w = {job, NULL, NULL, NULL, 0, 0, NULL};
+    w.socks = malloc(sizeof(*w.socks) * shards);
+    w.replicas = calloc(shards, sizeof(*w.replicas));
+    w.ring = calloc(BULK_PIPELINE_DEPTH, sizeof(*w.ring));
+    w.digests = malloc(sizeof(*w.digests) * BIN_MAX_BATCH * 2);
+    int ok = w.socks && w.replicas && w.ring && w.digests;
+    for (int i = 0; ok && i < BULK_PIPELINE_DEPTH; i++) {
+        ok = (w.ring[i].groups = malloc(sizeof(*w.ring[i].groups) * (shards * 2 + 1))) != NULL;
+    }
+    for (int s = 0; w.socks && s < shards; s++) {
+        w.socks[s] = -1; // Connected on first use
+    }
+    if (!ok) {
+        __atomic_store_n(&job->failed, 1, __ATOMIC_RELAXED);
+    }
+
+    const char *pos = NULL, *end = NULL; // Current slice
+    int input_left = 1;
+    while (ok && !__atomic_load_n(&job->failed, __ATOMIC_RELAXED)) {
+        while (input_left && w.sent - w.done < BULK_PIPELINE_DEPTH) { // Keep the pipeline full
+            bulk_batch *batch = &w.ring[w.sent % BULK_PIPELINE_DEPTH];
+            fill_batch(job, batch, &pos, &end);
+            if (batch->count == 0) {
+                input_left = 0;
+                break;
+            }
+            route_batch(&w, batch);
+            if (issue_batch(&w) != 0) {
+                __atomic_store_n(&job->failed, 1, __ATOMIC_RELAXED);
+                break;
+            }
+        }
+        if (__atomic_load_n(&job->failed, __ATOMIC_RELAXED) || w.sent == w.done) {
+            break; // Error, or everything answered
+        }
+        if (collect_batch(&w) != 0) {
+            __atomic_store_n(&job->failed, 1, __ATOMIC_RELAXED);
+            break;
+        }
+    }
+
+    for (int s = 0; w.socks && s < shards; s++) {
+        if (w.socks[s] < 0) {
+            continue;
+        }
+        bin_header hdr = {BIN_VERSION, BIN_OP_EXIT, 0, w.sent * 2, 0, 0}; // Close cleanly
+        uint8_t raw[BIN_HEADER_SIZE];
+        bin_header_encode(&hdr, raw);
+        send(w.socks[s], raw, sizeof(raw), MSG_NOSIGNAL);
+        close(w.socks[s]);
+    }
+    for (int i = 0; w.ring && i < BULK_PIPELINE_DEPTH; i++) {
+        free(w.ring[i].groups);
+    }
+    free(w.socks);
+    free(w.replicas);
+    free(w.ring);
+    free(w.digests);
+    return NULL;
+}
+
+int bulk_audit(const shard_map *map, const char *input, const char *output, int workers) {
+    bulk_job job;
+    memset(&job, 0, sizeof(job));
+    job.map = map;
+
+    int fd = open(input, O_RDONLY | O_CLOEXEC);
+    struct stat st;
+    if (fd < 0 || fstat(fd, &st) != 0) {
+        perror("Failed to open input file");
+        return -1;
+    }
+    job.size = st.st_size;
+    if (job.size > 0) {
+        job.data = mmap(NULL, job.size, PROT_READ, MAP_PRIVATE, fd, 0);
+        if (job.data == MAP_FAILED) {
+            perror("Failed to map input file");
+            close(fd);
+            return -1;
+        }
+        madvise((void *)job.data, job.size, MADV_SEQUENTIAL); // Read once, front to back
+    }
+    close(fd);
+
+    job.out = fopen(output, "w");
+    if (!job.out) {
+        perror("Failed to open output file");
+        return -1;
+    }
+    pthread_mutex_init(&job.lock, NULL);
+
+    pthread_t *threads = calloc(workers, sizeof(*threads));
+    double start = monotonic_seconds();
+    int started = 0;
+    for (; threads && started < workers; started++) {
+        if (pthread_create(&threads[started], NULL, bulk_worker, &job) != 0) {
+            break;
+        }
+    }
+    if (started < workers) { // Stop the workers that did start, or the loop below would wait forever
+        fprintf(stderr, "Failed to start worker threads\n");
+        __atomic_store_n(&job.failed, 1, __ATOMIC_RELAXED);
+    }
+
+    // Report progress until every slice has been handed out
+    uint64_t last = 0;
+    double last_time = start;
+    int finished = 0;
+    while (!finished && !__atomic_load_n(&job.failed, __ATOMIC_RELAXED)) {
+        usleep(POLL_INTERVAL_US);
+        pthread_mutex_lock(&job.lock);
+        finished = job.next == job.size;
+        pthread_mutex_unlock(&job.lock);
+
+        double now = monotonic_seconds();
+        if (now - last_time >= REPORT_INTERVAL) {
+            uint64_t lookups = __atomic_load_n(&job.lookups, __ATOMIC_RELAXED);
+            fprintf(stderr, "%llu lookups, %.0f lookups/sec\n", (unsigned long long)lookups,
+                    (lookups - last) / (now - last_time));
+            last = lookups;
+            last_time = now;
+        }
+    }
+    for (int i = 0; i < started; i++) {
+        pthread_join(threads[i], NULL);
+    }
+    double elapsed = monotonic_seconds() - start;
+
+    fclose(job.out);
+    if (job.size > 0) {
+        munmap((void *)job.data, job.size);
+    }
+    free(threads);
+    pthread_mutex_destroy(&job.lock);
+
+    fprintf(stderr, "Checked %llu lines (%llu skipped) in %.2f seconds: %.0f lookups/sec, %llu matches written to %s\n",
+            (unsigned long long)job.lookups, (unsigned long long)job.skipped, elapsed,
+            elapsed > 0 ? job.lookups / elapsed : 0.0, (unsigned long long)job.matches, output);
+    return job.failed ? -1 : 0;
+}
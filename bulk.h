@@ -0,0 +1,21 @@
+// bulk.h
+// Non-interactive audit of a whole "user:password" file against the server, or every
+// shard of a sharded deployment. Worker threads each own one connection per shard:
+// they take slices of the memory-mapped input, hash usernames and passwords with
+// sha256_batch, send each shard one CHECK_BATCH frame per field with the digests it
+// owns, and keep several batches in flight before reading the replies. If a shard's
+// connection fails, the worker moves to its next replica and resends what is still
+// unanswered. Memory use is bounded by the number of workers and batches in flight,
+// not by the input size.
+
+#ifndef _BULK_H_
+#define _BULK_H_
+
+#include "shard.h"
+
+#define BULK_PIPELINE_DEPTH 4 // Batches in flight per worker
+
+int bulk_audit(const shard_map *map, const char *input, const char *output,
+               int workers); // Audit every line of `input`, writing matches to `output`; 0 on success
+
+#endif
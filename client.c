@@ -2,69 +2,173 @@
 #include <stdlib.h> // Standard library for memory allocation, process control, etc.
 #include <string.h> // String handling functions
 #include <unistd.h> // POSIX API for Unix-like systems
-#include <arpa/inet.h> // Definitions for internet operations
+#include <getopt.h> // Long options
+#include <poll.h> // UDP reply timeouts
+#include <errno.h> // Refused datagrams
+#include <sys/socket.h> // Socket API
 #include <time.h> // Time-related functions
 #include "sha256_lib.h" // Custom SHA-256 library
+#include "protocol.h" // Binary frame headers
+#include "filter.h" // Server pre-filters for local negatives
+#include "range.h" // k-anonymity range replies
+#include "bulk.h" // Non-interactive file audit
+#include "shard.h" // Routing to the shard that holds a digest
+#include "pair.h" // Fingerprints routing a username/password pair
+#include "net.h" // UDP sockets
 
 #define BUFFER_SIZE 1024 // Buffer size for reading data
+#define UDP_TIMEOUT_MS 50 // First wait for a UDP reply, doubled on every retry
+#define UDP_ATTEMPTS 4 // Times a UDP request is sent before the shard counts as unavailable
 
-void handle_connection(int sock); // Function to handle connection with the server
+// Connection to one shard, opened on first use
+typedef struct {
+    int sock; // Connected socket, -1 if not connected
+    int replica; // Replica the socket goes to
+    int udp_sock; // Connected UDP socket with -U, -1 if not open
+    digest_filter username_filter; // Usernames the shard might hold, empty unless -f
+    digest_filter password_filter; // Passwords the shard might hold, empty unless -f
+} shard_conn;
+
+shard_map shards; // <hostname> <port> as a single shard, or the shard map given with -s
+shard_conn *conns; // One per shard
+int use_filters = 0; // Download each shard's pre-filters and answer definite misses locally
+int use_udp = 0; // Send lookups as single datagrams instead of over a connection
+uint32_t next_request_id; // Request ID of the last UDP query
+
+// One CHECK_BATCH frame of a single item sent over UDP
+typedef struct {
+    uint8_t field; // BIN_FIELD_* of the item
+    const uint8_t *item; // Digest, or username digest then password digest
+    uint32_t request_id; // Kept across retries, so a late reply to an earlier send still counts
+    int status; // BIN_STATUS_* of the reply, -1 until it arrives
+    uint8_t bits; // First byte of the reply bitmap
+} udp_query;
+
+// Range replies already downloaded, so repeated prefixes need no round trip
+typedef struct {
+    char prefix[RANGE_PREFIX_HEX + 1]; // Hex prefix of the bucket
+    char *suffixes; // Suffix lines, RANGE_SUFFIX_HEX + 1 bytes each
+    size_t count; // Number of suffixes
+} range_bucket;
+
+range_bucket *range_cache; // Downloaded buckets
+size_t range_cache_count; // Number of downloaded buckets
+
+void handle_connection(void); // Function to handle the connections with the servers
+int shard_sock(int shard); // Connected socket of a shard, connecting and downloading filters if needed
+void shard_failed(int shard); // Drop a broken connection so the next use tries another replica
+int exchange(int shard, const char *request, char *reply, size_t size); // Send a text request and read the reply, with failover
+int filters_ready(int shard); // 1 if the shard's pre-filters can rule digests out
+int shard_udp_sock(int shard); // Connected UDP socket of a shard, opened if needed
+void udp_failed(int shard); // Give up on a silent replica so the next send tries another
+int udp_ask(int shard, udp_query *queries, int count); // Send the queries and wait for every reply, with retries and failover
+int udp_exchange(int shard, const char *request, char *reply, size_t size); // Answer a text request with UDP queries
+int read_full(int sock, void *buf, size_t len); // Read exactly len bytes, 0 on success
+int fetch_filter(int sock, uint8_t field, digest_filter *filter); // Download one pre-filter, 0 on success
+const range_bucket *fetch_range(const char *hash_str); // Cached or downloaded bucket of a hash, NULL on error
+int read_range(int sock, const char *hash_str, range_bucket *bucket); // Append one server's part of a bucket: 0, 1 if it has no ranges, -1 on error
 void sha256(const char *input, size_t len, unsigned char output[SHA256_DIGEST_SIZE]); // Function to compute SHA-256 hash
 
 int main(int argc, char *argv[]) {
-    if (argc != 3) { // Check if the correct number of arguments is provided
-        fprintf(stderr, "Usage: %s <hostname> <port>\n", argv[0]);
-        exit(EXIT_FAILURE); // Exit if arguments are incorrect
+    const char *shard_map_file = NULL; // Route each digest to its shard instead of one server
+    const char *bulk_input = NULL; // Audit this "user:password" file instead of prompting
+    const char *bulk_output = "bulk-matches.txt"; // Where bulk mode writes matches
+    long workers = sysconf(_SC_NPROCESSORS_ONLN); // Bulk mode threads, one connection each
+    static const struct option long_options[] = {
+        {"bulk", required_argument, NULL, 'b'},
+        {"output", required_argument, NULL, 'o'},
+        {"jobs", required_argument, NULL, 'j'},
+        {"shards", required_argument, NULL, 's'},
+        {"udp", no_argument, NULL, 'U'},
+        {NULL, 0, NULL, 0},
+    };
+    int opt;
+    while ((opt = getopt_long(argc, argv, "fb:o:j:s:U", long_options, NULL)) != -1) { // Parse optional flags
+        if (opt == 'f') {
+            use_filters = 1;
+        } else if (opt == 'b') {
+            bulk_input = optarg;
+        } else if (opt == 'o') {
+            bulk_output = optarg;
+        } else if (opt == 'j' && atoi(optarg) > 0) {
+            workers = atoi(optarg);
+        } else if (opt == 's') {
+            shard_map_file = optarg;
+        } else if (opt == 'U') {
+            use_udp = 1;
+        } else {
+            argc = 0; // Force the usage message
+            break;
+        }
     }
 
-    char *hostname = argv[1]; // Get the hostname from arguments
-    int port = atoi(argv[2]); // Convert port argument to integer
-
-    int sock; // Socket descriptor
-    struct sockaddr_in server_addr; // Structure to hold server address
-
-    // Create socket
-    if ((sock = socket(AF_INET, SOCK_STREAM, 0)) < 0) {
-        perror("Socket creation error"); // Print error if socket creation fails
-        exit(EXIT_FAILURE); // Exit if socket creation fails
+    if (argc - optind != (shard_map_file ? 0 : 2)) { // Check if the correct number of arguments is provided
+        fprintf(stderr, "Usage: %s [-f] [--udp] <hostname> <port>\n"
+                        "       %s [-f] [--udp] --shards <shard_map>\n"
+                        "       %s --bulk <file> [--output <file>] [--jobs <n>] {<hostname> <port> | --shards <shard_map>}\n",
+                argv[0], argv[0], argv[0]);
+        exit(EXIT_FAILURE); // Exit if arguments are incorrect
     }
 
-    server_addr.sin_family = AF_INET; // Set address family to Internet
-    server_addr.sin_port = htons(port); // Set port number
+    if (shard_map_file ? shard_map_load(&shards, shard_map_file) != 0
+                       : shard_map_single(&shards, argv[optind], atoi(argv[optind + 1])) != 0) { // Servers to query
+        perror("Failed to load shard map");
+        exit(EXIT_FAILURE);
+    }
 
-    // Convert hostname to IP address
-    if (inet_pton(AF_INET, hostname, &server_addr.sin_addr) <= 0) {
-        perror("Invalid address/ Address not supported"); // Print error if address conversion fails
-        exit(EXIT_FAILURE); // Exit if address conversion fails
+    if (bulk_input) { // Audit a whole file without prompting
+        if (workers < 1) {
+            workers = 1;
+        }
+        return bulk_audit(&shards, bulk_input, bulk_output, (int)workers) == 0 ? 0 : EXIT_FAILURE;
     }
 
-    // Connect to server
-    if (connect(sock, (struct sockaddr *)&server_addr, sizeof(server_addr)) < 0) {
-        perror("Connection failed"); // Print error if connection fails
-        exit(EXIT_FAILURE); // Exit if connection fails
+    conns = calloc(shards.count, sizeof(*conns));
+    if (!conns) {
+        exit(EXIT_FAILURE);
+    }
+    for (int i = 0; i < shards.count; i++) {
+        conns[i].sock = conns[i].udp_sock = -1; // Connected on first use
+    }
+    for (int i = 0; i < shards.count; i++) {
+        if (use_udp && shard_udp_sock(i) < 0) { // Nothing answers until the first lookup, but names resolve now
+            exit(EXIT_FAILURE);
+        }
+        if ((!use_udp || use_filters) && shard_sock(i) < 0) { // Connect up front, so a bad address is reported before prompting
+            exit(EXIT_FAILURE); // Exit if no replica of the shard answered
+        }
     }
 
-    handle_connection(sock); // Handle the connection with the server
-    close(sock); // Close the socket
+    handle_connection(); // Handle the connections with the servers
+    for (int i = 0; i < shards.count; i++) {
+        if (conns[i].sock >= 0) {
+            send(conns[i].sock, TEXT_EXIT, strlen(TEXT_EXIT), MSG_NOSIGNAL); // Send exit command to server
+            close(conns[i].sock); // Close the socket
+        }
+        if (conns[i].udp_sock >= 0) {
+            close(conns[i].udp_sock);
+        }
+    }
     return 0; // Return 0 to indicate successful execution
 }
 
-void handle_connection(int sock) {
-    char buffer[BUFFER_SIZE]; // Buffer to hold data from the server
+void handle_connection(void) {
+    char buffer[BUFFER_SIZE]; // Buffer to hold the request
+    char reply[BUFFER_SIZE]; // Buffer to hold data from the server
+    int valread = -1; // Length of the reply, -1 if no replica answered
     int option; // Variable to store user option
     char input[BUFFER_SIZE]; // Buffer to hold user input
     unsigned char hash[SHA256_DIGEST_SIZE]; // Buffer to hold SHA-256 hash
     char hash_str[SHA256_DIGEST_SIZE * 2 + 1]; // Buffer to hold hash as a string
-    clock_t start, end; // Variables to measure time
-    double cpu_time_used; // Variable to store CPU time used
+    struct timespec start, end; // Wall-clock send and reply times
+    double response_time; // Seconds from sending the request to receiving the reply
 
     while (1) {
-        printf("Enter option (1: check username/email, 2: check password, 3: check both, 4: exit): ");
+        printf("Enter option (1: check username/email, 2: check password, 3: check both, 4: exit, 5: check password privately): ");
         scanf("%d", &option); // Get user option
         getchar(); // Consume newline
 
         if (option == 4) { // If user wants to exit
-            send(sock, "exit", strlen("exit"), 0); // Send exit command to server
             break; // Exit the loop
         }
 
@@ -77,8 +181,14 @@ void handle_connection(int sock) {
                 sprintf(hash_str + (i * 2), "%02x", hash[i]); // Convert hash to string
             }
             printf("Username/email hash: %s\n", hash_str); // Debug print
+            int shard = shard_owner(&shards, hash); // Only this shard can hold it
+            if (filters_ready(shard) && !digest_filter_may_contain(&conns[shard].username_filter, hash)) {
+                printf("Server response: Not Found (ruled out by local filter)\n");
+                continue; // No round trip needed
+            }
             sprintf(buffer, "check_username:%s", hash_str); // Prepare buffer to send to server
-            send(sock, buffer, strlen(buffer), 0); // Send buffer to server
+            clock_gettime(CLOCK_MONOTONIC, &start); // Start time measurement
+            valread = exchange(shard, buffer, reply, sizeof(reply)); // Send buffer to server and read response
         }
 
         if (option == 2) { // If user wants to check password
@@ -90,8 +200,37 @@ void handle_connection(int sock) {
                 sprintf(hash_str + (i * 2), "%02x", hash[i]); // Convert hash to string
             }
             printf("Password hash: %s\n", hash_str); // Debug print
+            int shard = shard_owner(&shards, hash); // Only this shard can hold it
+            if (filters_ready(shard) && !digest_filter_may_contain(&conns[shard].password_filter, hash)) {
+                printf("Server response: Not Found (ruled out by local filter)\n");
+                continue; // No round trip needed
+            }
             sprintf(buffer, "check_password:%s", hash_str); // Prepare buffer to send to server
-            send(sock, buffer, strlen(buffer), 0); // Send buffer to server
+            clock_gettime(CLOCK_MONOTONIC, &start); // Start time measurement
+            valread = exchange(shard, buffer, reply, sizeof(reply)); // Send buffer to server and read response
+        }
+
+        if (option == 5) { // Check a password without sending its full hash
+            printf("Enter password: ");
+            fgets(input, BUFFER_SIZE, stdin); // Get password from user
+            input[strcspn(input, "\n")] = 0; // Remove newline
+            sha256(input, strlen(input), hash); // Compute SHA-256 hash
+            for (int i = 0; i < SHA256_DIGEST_SIZE; i++) {
+                sprintf(hash_str + (i * 2), "%02x", hash[i]); // Convert hash to string
+            }
+            printf("Password hash: %s (sending only %.*s)\n", hash_str, RANGE_PREFIX_HEX, hash_str);
+            const range_bucket *bucket = fetch_range(hash_str); // Every suffix under the prefix
+            if (!bucket) {
+                printf("Server response: range queries not available\n");
+                continue;
+            }
+            int found = 0; // Match the suffix locally
+            for (size_t i = 0; i < bucket->count && !found; i++) {
+                found = strncmp(bucket->suffixes + i * (RANGE_SUFFIX_HEX + 1), hash_str + RANGE_PREFIX_HEX,
+                                RANGE_SUFFIX_HEX) == 0;
+            }
+            printf("Server response: %s (%zu hashes share the prefix)\n", found ? "Found" : "Not Found", bucket->count);
+            continue; // Reply already consumed
         }
 
         if (option == 3) { // If user wants to check both username/email and password
@@ -106,6 +245,11 @@ void handle_connection(int sock) {
                 sprintf(username_hash + (i * 2), "%02x", hash[i]); // Convert hash to string
             }
             printf("Username/email hash: %s\n", username_hash); // Debug print
+            int username_shard = shard_owner(&shards, hash); // Before hash is reused
+            unsigned char username_digest[SHA256_DIGEST_SIZE];
+            memcpy(username_digest, hash, SHA256_DIGEST_SIZE);
+            int username_possible = !filters_ready(username_shard) ||
+                                    digest_filter_may_contain(&conns[username_shard].username_filter, hash);
 
             printf("Enter password: ");
             fgets(input, BUFFER_SIZE, stdin); // Get password from user
@@ -115,19 +259,357 @@ void handle_connection(int sock) {
                 sprintf(password_hash + (i * 2), "%02x", hash[i]); // Convert hash to string
             }
             printf("Password hash: %s\n", password_hash); // Debug print
+            int password_shard = shard_owner(&shards, hash);
+            int pair_shard = shard_owner_key(&shards, pair_fingerprint(username_digest, hash));
+            int password_possible = !filters_ready(password_shard) ||
+                                    digest_filter_may_contain(&conns[password_shard].password_filter, hash);
+            if (!username_possible && !password_possible) {
+                printf("Server response: NotFound (ruled out by local filter)\n");
+                continue; // No round trip needed
+            }
 
+            clock_gettime(CLOCK_MONOTONIC, &start); // Start time measurement
             sprintf(buffer, "check_both:%s:%s", username_hash, password_hash); // Prepare buffer to send to server
-            send(sock, buffer, strlen(buffer), 0); // Send buffer to server
+            valread = exchange(pair_shard, buffer, reply, sizeof(reply)); // Send buffer to server and read response
+            if (valread > 0 && strcmp(reply, "FoundPair") != 0 &&
+                (username_shard != pair_shard || password_shard != pair_shard)) {
+                // Not a breached pair, and the pair's shard does not hold both halves: ask each
+                // owner for its half and combine the answers like check_both does
+                int found_username = 0, found_password = 0;
+                sprintf(buffer, "check_username:%s", username_hash);
+                valread = exchange(username_shard, buffer, reply, sizeof(reply));
+                found_username = valread > 0 && strcmp(reply, "Found") == 0;
+                if (valread >= 0) {
+                    sprintf(buffer, "check_password:%s", password_hash);
+                    valread = exchange(password_shard, buffer, reply, sizeof(reply));
+                    found_password = valread > 0 && strcmp(reply, "Found") == 0;
+                }
+                if (valread >= 0) {
+                    strcpy(reply, found_username && found_password ? "FoundBoth"
+                                  : found_username                 ? "FoundUsernameOnly"
+                                  : found_password                 ? "FoundPasswordOnly"
+                                                                   : "NotFound");
+                }
+            }
+        }
+
+        if (option < 1 || option > 3) {
+            continue; // Unknown option
+        }
+        clock_gettime(CLOCK_MONOTONIC, &end); // End time measurement
+        response_time = (end.tv_sec - start.tv_sec) + (end.tv_nsec - start.tv_nsec) / 1e9; // Elapsed wall time
+        if (valread < 0) {
+            printf("Server response: unavailable (no replica of the shard answered)\n");
+            continue;
+        }
+        printf("Server response: %s\n", reply); // Print server response
+        printf("Response time: %f seconds\n", response_time); // Print response time
+    }
+}
+
+int shard_sock(int shard) {
+    shard_conn *conn = &conns[shard];
+    if (conn->sock >= 0) {
+        return conn->sock;
+    }
+    if ((conn->sock = shard_connect(&shards, shard, &conn->replica)) < 0) {
+        return -1;
+    }
+    if (use_filters) { // Each replica serves its own copy of the shard's filters
+        digest_filter_free(&conn->username_filter);
+        digest_filter_free(&conn->password_filter);
+        if (fetch_filter(conn->sock, BIN_FIELD_USERNAME, &conn->username_filter) != 0 ||
+            fetch_filter(conn->sock, BIN_FIELD_PASSWORD, &conn->password_filter) != 0) {
+            fprintf(stderr, "Could not download filters\n"); // Server without binary protocol support
+            exit(EXIT_FAILURE);
+        }
+        printf("Downloaded filters%s%s: %zu username and %zu password blocks\n",
+               shards.count > 1 ? " of shard " : "", shards.count > 1 ? shards.shards[shard].name : "",
+               conn->username_filter.block_count, conn->password_filter.block_count);
+    }
+    return conn->sock;
+}
+
+void shard_failed(int shard) {
+    shard_conn *conn = &conns[shard];
+    if (conn->sock >= 0) {
+        close(conn->sock);
+        conn->sock = -1;
+    }
+    conn->replica = (conn->replica + 1) % shards.shards[shard].replica_count; // Start with the next replica
+}
+
+int exchange(int shard, const char *request, char *reply, size_t size) {
+    if (use_udp) {
+        return udp_exchange(shard, request, reply, size);
+    }
+    for (int attempt = 0; attempt < shards.shards[shard].replica_count; attempt++) {
+        int sock = shard_sock(shard);
+        if (sock < 0) {
+            return -1; // No replica accepts connections
+        }
+        ssize_t len = (ssize_t)strlen(request);
+        int valread;
+        if (send(sock, request, len, MSG_NOSIGNAL) == len && (valread = read(sock, reply, size - 1)) > 0) {
+            reply[valread] = '\0'; // Null-terminate the buffer
+            return valread;
+        }
+        shard_failed(shard); // Connection broke, retry on another replica
+    }
+    return -1;
+}
+
+int filters_ready(int shard) {
+    return use_filters && shard_sock(shard) >= 0; // Without -f the filters are empty and rule nothing out
+}
+
+int shard_udp_sock(int shard) {
+    shard_conn *conn = &conns[shard];
+    if (conn->udp_sock < 0) {
+        const shard_replica *r = &shards.shards[shard].replicas[conn->replica];
+        conn->udp_sock = udp_connect(r->host, r->port);
+    }
+    return conn->udp_sock;
+}
+
+void udp_failed(int shard) {
+    shard_conn *conn = &conns[shard];
+    if (conn->udp_sock >= 0) {
+        close(conn->udp_sock);
+        conn->udp_sock = -1;
+    }
+    conn->replica = (conn->replica + 1) % shards.shards[shard].replica_count; // Start with the next replica
+}
+
+int udp_ask(int shard, udp_query *queries, int count) {
+    for (int i = 0; i < count; i++) {
+        queries[i].request_id = ++next_request_id; // Replies to earlier lookups are told apart by ID
+        queries[i].status = -1;
+    }
+    int timeout_ms = UDP_TIMEOUT_MS;
+    for (int attempt = 0; attempt < UDP_ATTEMPTS; attempt++, timeout_ms *= 2) {
+        int sock = shard_udp_sock(shard);
+        if (sock < 0) {
+            return -1;
+        }
+        int waiting = 0; // Queries sent in this attempt and not answered yet
+        for (int i = 0; i < count; i++) {
+            if (queries[i].status >= 0) {
+                continue; // Answered by an earlier attempt
+            }
+            size_t item_size = bin_item_size(queries[i].field);
+            bin_header hdr = {BIN_VERSION, BIN_OP_CHECK_BATCH, queries[i].field, queries[i].request_id, 1, item_size};
+            uint8_t frame[BIN_HEADER_SIZE + SHA256_DIGEST_SIZE * 2];
+            bin_header_encode(&hdr, frame);
+            memcpy(frame + BIN_HEADER_SIZE, queries[i].item, item_size);
+            if (send(sock, frame, BIN_HEADER_SIZE + item_size, 0) < 0) {
+                break; // Refused: an earlier datagram found no server listening
+            }
+            waiting++;
+        }
+
+        struct timespec now, deadline;
+        clock_gettime(CLOCK_MONOTONIC, &deadline);
+        deadline.tv_nsec += timeout_ms * 1000000L;
+        deadline.tv_sec += deadline.tv_nsec / 1000000000L;
+        deadline.tv_nsec %= 1000000000L;
+        while (waiting > 0) {
+            clock_gettime(CLOCK_MONOTONIC, &now);
+            long left_ms = (deadline.tv_sec - now.tv_sec) * 1000 + (deadline.tv_nsec - now.tv_nsec) / 1000000;
+            struct pollfd pfd = {sock, POLLIN, 0};
+            if (left_ms <= 0 || poll(&pfd, 1, (int)left_ms) == 0) {
+                break; // Lost on the way there or back
+            }
+            uint8_t raw[BIN_HEADER_SIZE + 1]; // Header and the one byte of bitmap a single item needs
+            ssize_t n = recv(sock, raw, sizeof(raw), MSG_DONTWAIT);
+            if (n < 0 && (errno == EINTR || errno == EAGAIN)) {
+                continue;
+            }
+            bin_header hdr;
+            if (n < 0) {
+                break; // ECONNREFUSED: the replica is down, no point waiting for it
+            }
+            if (n < BIN_HEADER_SIZE || bin_header_decode(raw, &hdr) != 0 || hdr.length != (size_t)n - BIN_HEADER_SIZE) {
+                continue; // Not a reply to a single-item query
+            }
+            for (int i = 0; i < count; i++) {
+                if (queries[i].status < 0 && queries[i].request_id == hdr.request_id) {
+                    queries[i].status = hdr.field;
+                    queries[i].bits = hdr.length ? raw[BIN_HEADER_SIZE] : 0;
+                    waiting--;
+                }
+            }
+        }
+        int answered = 1;
+        for (int i = 0; i < count; i++) {
+            answered &= queries[i].status >= 0;
+        }
+        if (answered) {
+            return 0;
+        }
+        udp_failed(shard); // Retry, on the next replica if the shard has one
+    }
+    return -1;
+}
+
+int udp_exchange(int shard, const char *request, char *reply, size_t size) {
+    uint8_t digests[SHA256_DIGEST_SIZE * 2]; // Hashes in the request, username first
+    const char *hex = strchr(request, ':') + 1;
+    for (int i = 0; i < SHA256_DIGEST_SIZE * 2 && *hex; i++, hex += 2) {
+        if (*hex == ':') {
+            hex++; // Between the username and password hashes
         }
+        sscanf(hex, "%2hhx", &digests[i]);
+    }
+
+    udp_query queries[2] = {{0}};
+    int count = 1;
+    if (strncmp(request, TEXT_CHECK_BOTH, strlen(TEXT_CHECK_BOTH)) == 0) {
+        queries[0].field = BIN_FIELD_PAIR; // Sent together, so a miss costs no extra round trip
+        queries[1].field = BIN_FIELD_BOTH;
+        queries[0].item = queries[1].item = digests;
+        count = 2;
+    } else {
+        queries[0].field = strncmp(request, TEXT_CHECK_USERNAME, strlen(TEXT_CHECK_USERNAME)) == 0 ? BIN_FIELD_USERNAME
+                                                                                                  : BIN_FIELD_PASSWORD;
+        queries[0].item = digests;
+    }
+    if (udp_ask(shard, queries, count) != 0) {
+        return -1;
+    }
+
+    const udp_query *last = &queries[count - 1];
+    if (last->status != BIN_STATUS_OK) {
+        return -1; // Refused by the server
+    }
+    if (count == 1) {
+        snprintf(reply, size, "%s", last->bits & 1 ? "Found" : "Not Found");
+    } else if (queries[0].status == BIN_STATUS_OK && (queries[0].bits & 1)) {
+        snprintf(reply, size, "FoundPair"); // UNSUPPORTED without a pair index: fall back on the fields
+    } else {
+        int found_username = last->bits & 1, found_password = (last->bits >> 1) & 1;
+        snprintf(reply, size, "%s", found_username && found_password ? "FoundBoth"
+                                    : found_username                 ? "FoundUsernameOnly"
+                                    : found_password                 ? "FoundPasswordOnly"
+                                                                     : "NotFound");
+    }
+    return (int)strlen(reply);
+}
 
-        start = clock(); // Start time measurement
-        int valread = read(sock, buffer, BUFFER_SIZE); // Read response from server
-        end = clock(); // End time measurement
-        buffer[valread] = '\0'; // Null-terminate the buffer
-        cpu_time_used = ((double) (end - start)) / CLOCKS_PER_SEC; // Calculate CPU time used
-        printf("Server response: %s\n", buffer); // Print server response
-        printf("Response time: %f seconds\n", cpu_time_used); // Print response time
+int read_full(int sock, void *buf, size_t len) {
+    size_t got = 0; // Bytes read so far
+    while (got < len) {
+        ssize_t n = read(sock, (char *)buf + got, len - got);
+        if (n <= 0) {
+            return -1; // Server closed the connection or failed
+        }
+        got += n;
+    }
+    return 0;
+}
+
+int fetch_filter(int sock, uint8_t field, digest_filter *filter) {
+    bin_header hdr = {BIN_VERSION, BIN_OP_GET_FILTER, field, field, 0, 0}; // Request ID is the field
+    uint8_t raw[BIN_HEADER_SIZE]; // Encoded header
+    bin_header_encode(&hdr, raw);
+    if (send(sock, raw, sizeof(raw), 0) != sizeof(raw) || read_full(sock, raw, sizeof(raw)) != 0 ||
+        bin_header_decode(raw, &hdr) != 0) {
+        return -1;
+    }
+
+    void *data = malloc(hdr.length ? hdr.length : 1); // Filter bits
+    if (!data || read_full(sock, data, hdr.length) != 0) {
+        free(data);
+        return -1;
+    }
+    int status = 0;
+    if (hdr.field == BIN_STATUS_OK) {
+        status = digest_filter_load(filter, data, hdr.length);
+    } else {
+        memset(filter, 0, sizeof(*filter)); // Server has no filter, every lookup goes to it
+    }
+    free(data);
+    return status;
+}
+
+const range_bucket *fetch_range(const char *hash_str) {
+    for (size_t i = 0; i < range_cache_count; i++) { // Seen this prefix before?
+        if (strncmp(range_cache[i].prefix, hash_str, RANGE_PREFIX_HEX) == 0) {
+            return &range_cache[i];
+        }
+    }
+
+    range_bucket bucket = {{0}, NULL, 0}; // Suffixes from every shard owning part of the bucket
+    memcpy(bucket.prefix, hash_str, RANGE_PREFIX_HEX);
+    uint64_t first = strtoull(bucket.prefix, NULL, 16) << (64 - RANGE_PREFIX_HEX * 4); // Lowest digest key under the prefix
+    uint64_t last = first | (UINT64_MAX >> (RANGE_PREFIX_HEX * 4)); // Highest
+    int owners[shards.count];
+    int owner_count = shard_owners(&shards, first, last, owners);
+    for (int i = 0; i < owner_count; i++) {
+        int status = -1;
+        for (int attempt = 0; status != 0 && attempt < shards.shards[owners[i]].replica_count; attempt++) {
+            int sock = shard_sock(owners[i]);
+            if (sock < 0) {
+                break;
+            }
+            size_t had = bucket.count;
+            status = read_range(sock, hash_str, &bucket);
+            if (status != 0) {
+                bucket.count = had; // Drop a partial answer
+                if (status < 0) {
+                    shard_failed(owners[i]); // Retry on another replica
+                } else {
+                    break; // Server started without -r
+                }
+            }
+        }
+        if (status != 0) {
+            free(bucket.suffixes);
+            return NULL;
+        }
+    }
+
+    range_bucket *grown = realloc(range_cache, (range_cache_count + 1) * sizeof(*range_cache));
+    if (!grown) {
+        free(bucket.suffixes);
+        return NULL;
+    }
+    range_cache = grown;
+    range_cache[range_cache_count] = bucket;
+    return &range_cache[range_cache_count++];
+}
+
+int read_range(int sock, const char *hash_str, range_bucket *bucket) {
+    char request[sizeof(TEXT_RANGE) + RANGE_PREFIX_HEX]; // "range:" plus the prefix
+    int len = sprintf(request, "%s%.*s", TEXT_RANGE, RANGE_PREFIX_HEX, hash_str);
+    if (send(sock, request, len, MSG_NOSIGNAL) != len) {
+        return -1;
+    }
+
+    char header[64]; // "Range <count>" line
+    size_t used = 0;
+    while (used < sizeof(header) - 1 && read_full(sock, header + used, 1) == 0 && header[used] != '\n') {
+        used++;
+    }
+    if (used == 0 || header[used] != '\n') {
+        return -1; // Connection closed or a broken stream
+    }
+    header[used] = '\0';
+    size_t count;
+    if (sscanf(header, "Range %zu", &count) != 1) {
+        return 1; // "Range Unsupported"
+    }
+
+    char *grown = realloc(bucket->suffixes, (bucket->count + count) * (RANGE_SUFFIX_HEX + 1) + 1);
+    if (!grown) {
+        return -1;
+    }
+    bucket->suffixes = grown;
+    if (read_full(sock, bucket->suffixes + bucket->count * (RANGE_SUFFIX_HEX + 1), count * (RANGE_SUFFIX_HEX + 1)) != 0) {
+        return -1;
     }
+    bucket->count += count;
+    return 0;
 }
 
 void sha256(const char *input, size_t len, unsigned char output[SHA256_DIGEST_SIZE]) {
@@ -0,0 +1,144 @@
+// compact.c
+#include <stdlib.h>
+#include <string.h>
+#include "hugemem.h"
+#include "compact.h"
+
+#define SUFFIX_BITS 32 // Digest bits kept after the bucket bits
+
+// First 8 bytes of a digest as a big-endian integer
+static inline uint64_t leading_bits(const uint8_t *digest) {
+    uint64_t key = 0;
+    for (int i = 0; i < 8; i++) {
+        key = (key << 8) | digest[i];
+    }
+    return key;
+}
+
+static inline uint64_t bucket_of(const digest_compact *compact, uint64_t key) {
+    return key >> (64 - compact->bucket_bits);
+}
+
+static inline uint32_t suffix_of(const digest_compact *compact, uint64_t key) {
+    return (uint32_t)((key << compact->bucket_bits) >> (64 - SUFFIX_BITS));
+}
+
+int digest_compact_build(digest_compact *compact, const uint8_t (*digests)[SHA256_DIGEST_SIZE], size_t count) {
+    memset(compact, 0, sizeof(*compact));
+    int bucket_bits = 1; // About one digest per bucket keeps the unary code near 2 bits per digest
+    while (bucket_bits < 64 - SUFFIX_BITS && ((size_t)1 << bucket_bits) < count) {
+        bucket_bits++;
+    }
+    size_t buckets = (size_t)1 << bucket_bits;
+    size_t bits = count + buckets;
+    size_t words = bits / 64 + 1;
+    size_t samples = buckets / COMPACT_SAMPLE + 1;
+
+    compact->high = calloc(words, sizeof(uint64_t));
+    compact->low = malloc((count ? count : 1) * sizeof(uint32_t));
+    compact->samples = malloc(samples * sizeof(uint64_t));
+    if (!compact->high || !compact->low || !compact->samples) {
+        digest_compact_free(compact);
+        return -1;
+    }
+    compact->bits = bits;
+    compact->count = count;
+    compact->bucket_bits = bucket_bits;
+    compact->bytes = words * sizeof(uint64_t) + count * sizeof(uint32_t) + samples * sizeof(uint64_t);
+
+    size_t pos = 0; // Next bit of `high`
+    uint64_t bucket = 0; // Bucket being filled
+    compact->samples[0] = 0;
+    for (size_t i = 0; i <= count; i++) {
+        uint64_t target = buckets; // Past the last digest, close every remaining bucket
+        uint64_t key = 0;
+        if (i < count) {
+            key = leading_bits(digests[i]);
+            target = bucket_of(compact, key);
+        }
+        while (bucket < target) { // Close buckets up to this digest's with 0 bits
+            pos++;
+            if (++bucket % COMPACT_SAMPLE == 0 && bucket < buckets) {
+                compact->samples[bucket / COMPACT_SAMPLE] = pos;
+            }
+        }
+        if (i < count) {
+            compact->high[pos / 64] |= (uint64_t)1 << (pos % 64);
+            pos++;
+            compact->low[i] = suffix_of(compact, key);
+        }
+    }
+    return 0;
+}
+
+// Bit position in `high` where `bucket` starts: just after the 0 closing the bucket before
+static size_t bucket_start(const digest_compact *compact, uint64_t bucket) {
+    size_t pos = compact->samples[bucket / COMPACT_SAMPLE];
+    size_t skip = bucket % COMPACT_SAMPLE; // Bucket ends still to pass
+    if (skip == 0) {
+        return pos;
+    }
+    size_t w = pos / 64;
+    uint64_t zeros = ~compact->high[w] & (~(uint64_t)0 << (pos % 64));
+    while (1) {
+        size_t n = __builtin_popcountll(zeros);
+        if (n >= skip) {
+            break;
+        }
+        skip -= n;
+        zeros = ~compact->high[++w];
+    }
+    while (--skip > 0) {
+        zeros &= zeros - 1; // Drop the lowest 0 bit (set bit of the complement)
+    }
+    return w * 64 + __builtin_ctzll(zeros) + 1;
+}
+
+int digest_compact_contains(const digest_compact *compact, const uint8_t (*digests)[SHA256_DIGEST_SIZE],
+                            const uint8_t digest[SHA256_DIGEST_SIZE]) {
+    uint64_t key = leading_bits(digest);
+    uint64_t bucket = bucket_of(compact, key);
+    uint32_t suffix = suffix_of(compact, key);
+    size_t pos = bucket_start(compact, bucket);
+    size_t rank = pos - bucket; // 1 bits before `pos`: every 0 before it closed an earlier bucket
+    for (; pos < compact->bits && (compact->high[pos / 64] >> (pos % 64)) & 1; pos++, rank++) {
+        if (compact->low[rank] > suffix) {
+            return 0; // Suffixes ascend within a bucket
+        }
+        if (compact->low[rank] == suffix && memcmp(digests[rank], digest, SHA256_DIGEST_SIZE) == 0) {
+            return 1; // Confirmed against the full digest
+        }
+    }
+    return 0;
+}
+
+void digest_compact_prefetch(const digest_compact *compact, const uint8_t digest[SHA256_DIGEST_SIZE]) {
+    uint64_t bucket = bucket_of(compact, leading_bits(digest));
+    size_t buckets = (size_t)1 << compact->bucket_bits;
+    size_t rank = (size_t)((unsigned __int128)bucket * compact->count / buckets); // Expected digests before the bucket
+    __builtin_prefetch(&compact->samples[bucket / COMPACT_SAMPLE]);
+    __builtin_prefetch(&compact->high[(bucket + rank) / 64]); // One bit per bucket and per digest before it
+    if (rank < compact->count) {
+        __builtin_prefetch(&compact->low[rank]);
+    }
+}
+
+int digest_compact_place(digest_compact *compact, int numa_node) {
+    if (!compact->high) {
+        return 0;
+    }
+    size_t samples = ((size_t)1 << compact->bucket_bits) / COMPACT_SAMPLE + 1;
+    if (hugemem_move((void **)&compact->high, (compact->bits / 64 + 1) * sizeof(uint64_t), numa_node) != 0 ||
+        hugemem_move((void **)&compact->low, compact->count * sizeof(uint32_t), numa_node) != 0 ||
+        hugemem_move((void **)&compact->samples, samples * sizeof(uint64_t), numa_node) != 0) {
+        return -1;
+    }
+    return 0;
+}
+
+void digest_compact_free(digest_compact *compact) {
+    free(compact->high);
+    free(compact->low);
+    free(compact->samples);
+    memset(compact, 0, sizeof(*compact));
+}
@@ -0,0 +1,41 @@
+// compact.h
+// Compressed search directory over a sorted digest array, for sets of billions of
+// digests whose full 32-byte digests should stay on disk. The first `bucket_bits`
+// bits of a digest pick its bucket, with about one digest per bucket. Bucket sizes
+// are coded in unary, as in the high half of an Elias-Fano sequence: a bitvector with
+// one 1 per digest and a 0 closing each bucket, plus the start of every
+// COMPACT_SAMPLE-th bucket so a bucket is found by scanning a few words. The next 32
+// bits of each digest are kept as its truncated suffix. A lookup scans the suffixes
+// of one bucket and compares the full digest only when a suffix matches, so the
+// digest array (an index file mapping) is read once per hit and about once per four
+// billion misses, while roughly 4.5 bytes per digest stay resident.
+
+#ifndef _COMPACT_H_
+#define _COMPACT_H_
+
+#include <stddef.h>
+#include <stdint.h>
+#include "sha256_lib.h"
+
+#define COMPACT_SAMPLE 64 // Buckets between stored bucket starts
+
+typedef struct {
+    uint64_t *high; // Unary bucket sizes, NULL if no directory was built
+    uint32_t *low; // Truncated suffix of each digest, in digest order
+    uint64_t *samples; // Bit position in `high` where bucket k * COMPACT_SAMPLE starts
+    size_t bits; // Bits used in `high`
+    size_t count; // Digests covered
+    int bucket_bits; // Leading digest bits naming the bucket
+    size_t bytes; // Memory allocated for the directory
+} digest_compact;
+
+int digest_compact_build(digest_compact *compact, const uint8_t (*digests)[SHA256_DIGEST_SIZE],
+                         size_t count); // Build over sorted digests, 0 on success
+int digest_compact_contains(const digest_compact *compact, const uint8_t (*digests)[SHA256_DIGEST_SIZE],
+                            const uint8_t digest[SHA256_DIGEST_SIZE]); // 1 if present in `digests`
+void digest_compact_prefetch(const digest_compact *compact,
+                             const uint8_t digest[SHA256_DIGEST_SIZE]); // Start loading what a lookup reads first
+int digest_compact_place(digest_compact *compact, int numa_node); // Move to huge pages (hugemem.h), 0 on success
+void digest_compact_free(digest_compact *compact); // Release the directory
+
+#endif
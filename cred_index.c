@@ -0,0 +1,973 @@
+// cred_index.c
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+#include <errno.h>
+#include <fcntl.h>
+#include <unistd.h>
+#include <sys/mman.h>
+#include <sys/stat.h>
+#include "hugemem.h"
+#include "cred_index.h"
+#include "search.h"
+
+#define LINE_SIZE 1024 // Buffer size for one line of the credentials file
+#define INITIAL_CAPACITY 1024 // First allocation for a digest set
+#define WRITER_BUFFER_SIZE (1 << 20) // stdio buffer of an index file being written
+#define LOOKUP_GROUP 16 // Batched lookups whose memory accesses are overlapped
+
+// Value of each byte as a hex digit, -1 if it is not one
+static const signed char hex_values[256] = {
+    -1, -1, -1, -1, -1, -1, -1, -1, -1, -1, -1, -1, -1, -1, -1, -1,
+    -1, -1, -1, -1, -1, -1, -1, -1, -1, -1, -1, -1, -1, -1, -1, -1,
+    -1, -1, -1, -1, -1, -1, -1, -1, -1, -1, -1, -1, -1, -1, -1, -1,
+     0,  1,  2,  3,  4,  5,  6,  7,  8,  9, -1, -1, -1, -1, -1, -1,
+    -1, 10, 11, 12, 13, 14, 15, -1, -1, -1, -1, -1, -1, -1, -1, -1,
+    -1, -1, -1, -1, -1, -1, -1, -1, -1, -1, -1, -1, -1, -1, -1, -1,
+    -1, 10, 11, 12, 13, 14, 15, -1, -1, -1, -1, -1, -1, -1, -1, -1,
+    -1, -1, -1, -1, -1, -1, -1, -1, -1, -1, -1, -1, -1, -1, -1, -1,
+    -1, -1, -1, -1, -1, -1, -1, -1, -1, -1, -1, -1, -1, -1, -1, -1,
+    -1, -1, -1, -1, -1, -1, -1, -1, -1, -1, -1, -1, -1, -1, -1, -1,
+    -1, -1, -1, -1, -1, -1, -1, -1, -1, -1, -1, -1, -1, -1, -1, -1,
+    -1, -1, -1, -1, -1, -1, -1, -1, -1, -1, -1, -1, -1, -1, -1, -1,
+    -1, -1, -1, -1, -1, -1, -1, -1, -1, -1, -1, -1, -1, -1, -1, -1,
+    -1, -1, -1, -1, -1, -1, -1, -1, -1, -1, -1, -1, -1, -1, -1, -1,
+    -1, -1, -1, -1, -1, -1, -1, -1, -1, -1, -1, -1, -1, -1, -1, -1,
+    -1, -1, -1, -1, -1, -1, -1, -1, -1, -1, -1, -1, -1, -1, -1, -1,
+};
+
+int hex_value(char c) {
+    return hex_values[(unsigned char)c];
+}
+
+int hex_to_digest(const char *hex, uint8_t digest[SHA256_DIGEST_SIZE]) {
+    for (int i = 0; i < SHA256_DIGEST_SIZE; i++) {
+        int hi = hex_values[(unsigned char)hex[i * 2]]; // High nibble
+        int lo = hi < 0 ? -1 : hex_values[(unsigned char)hex[i * 2 + 1]]; // Low nibble (never read past a NUL)
+        if (lo < 0) {
+            return -1; // Not a well-formed digest
+        }
+        digest[i] = (uint8_t)((hi << 4) | lo);
+    }
+    return 0;
+}
+
+void digest_to_hex(const uint8_t digest[SHA256_DIGEST_SIZE], char hex[SHA256_HEX_SIZE + 1]) {
+    static const char digits[] = "0123456789abcdef";
+    for (int i = 0; i < SHA256_DIGEST_SIZE; i++) {
+        hex[i * 2] = digits[digest[i] >> 4];
+        hex[i * 2 + 1] = digits[digest[i] & 0x0f];
+    }
+    hex[SHA256_HEX_SIZE] = '\0';
+}
+
+static int digest_compare(const void *a, const void *b) {
+    return memcmp(a, b, SHA256_DIGEST_SIZE);
+}
+
+int digest_set_add(digest_set *set, const uint8_t digest[SHA256_DIGEST_SIZE]) {
+    if (set->count == set->capacity) { // Grow geometrically
+        size_t capacity = set->capacity ? set->capacity * 2 : INITIAL_CAPACITY;
+        void *grown = realloc(set->digests, capacity * SHA256_DIGEST_SIZE);
+        if (!grown) {
+            return -1; // Out of memory
+        }
+        set->digests = grown;
+        set->capacity = capacity;
+    }
+    memcpy(set->digests[set->count++], digest, SHA256_DIGEST_SIZE);
+    return 0;
+}
+
+size_t digest_sort_unique(uint8_t (*digests)[SHA256_DIGEST_SIZE], size_t count) {
+    if (count == 0) {
+        return 0;
+    }
+    qsort(digests, count, SHA256_DIGEST_SIZE, digest_compare); // Sort for searching
+
+    size_t unique = 1; // Drop repeated digests (e.g. a password shared by many users)
+    for (size_t i = 1; i < count; i++) {
+        if (memcmp(digests[i], digests[unique - 1], SHA256_DIGEST_SIZE) != 0) {
+            memcpy(digests[unique++], digests[i], SHA256_DIGEST_SIZE);
+        }
+    }
+    return unique;
+}
+
+// Line count stored big-endian at `ref`
+static uint32_t ref_value(const uint8_t *ref) {
+    return (uint32_t)ref[0] << 24 | (uint32_t)ref[1] << 16 | (uint32_t)ref[2] << 8 | ref[3];
+}
+
+static void store_ref(uint8_t *ref, uint64_t value) {
+    if (value > UINT32_MAX) {
+        value = UINT32_MAX; // Saturated: never counted down again
+    }
+    for (int i = 0; i < DIGEST_REF_SIZE; i++) {
+        ref[i] = (uint8_t)(value >> (24 - i * 8));
+    }
+}
+
+void digest_set_finalize(digest_set *set) {
+    if (set->count == 0) {
+        return;
+    }
+    set->count = digest_sort_unique(set->digests, set->count);
+
+    void *shrunk = realloc(set->digests, set->count * SHA256_DIGEST_SIZE); // Return the slack
+    if (shrunk) {
+        set->digests = shrunk;
+        set->capacity = set->count;
+    }
+}
+
+// Sort and de-duplicate after the last add, each digest having been added once per
+// distinct line holding it: the repeats become its line count
+static int digest_set_finalize_counted(digest_set *set) {
+    if (set->count == 0) {
+        return 0;
+    }
+    qsort(set->digests, set->count, SHA256_DIGEST_SIZE, digest_compare);
+    set->refs = malloc(set->count * DIGEST_REF_SIZE);
+    if (!set->refs) {
+        return -1;
+    }
+    size_t unique = 0;
+    for (size_t i = 0, run; i < set->count; i += run) {
+        for (run = 1; i + run < set->count && memcmp(set->digests[i + run], set->digests[i], SHA256_DIGEST_SIZE) == 0;
+             run++) {
+        }
+        memcpy(set->digests[unique], set->digests[i], SHA256_DIGEST_SIZE);
+        store_ref(set->refs[unique++], run);
+    }
+    set->count = unique;
+
+    void *shrunk = realloc(set->digests, unique * SHA256_DIGEST_SIZE); // Return the slack
+    if (shrunk) {
+        set->digests = shrunk;
+        set->capacity = unique;
+    }
+    return 0;
+}
+
+// Digests as the record array the search helpers walk
+static const uint8_t *set_records(const digest_set *set) {
+    return (const uint8_t *)set->digests;
+}
+
+// Search the compressed directory if there is one, else the digests themselves
+static int digest_set_find(const digest_set *set, const uint8_t digest[SHA256_DIGEST_SIZE]) {
+    if (set->compact.high) {
+        return digest_compact_contains(&set->compact, (const void *)set->digests, digest);
+    }
+    return search_find(set_records(set), SHA256_DIGEST_SIZE, set->count, digest);
+}
+
+int digest_set_contains(const digest_set *set, const uint8_t digest[SHA256_DIGEST_SIZE]) {
+    if (set->filter.block_count == 0) {
+        return digest_set_find(set, digest);
+    }
+    if (!digest_filter_may_contain(&set->filter, digest)) {
+        digest_filter_count(&set->filter, 0, 0);
+        return 0; // Definitely absent, no search needed
+    }
+    int found = digest_set_find(set, digest);
+    digest_filter_count(&set->filter, 1, found);
+    return found;
+}
+
+// Lookups are done in groups whose memory accesses are issued together, so their cache
+// and TLB misses overlap instead of following one another: first every filter block of
+// the group is prefetched, then the searches of the digests the filter passed advance
+// in turns, one probe each per round, prefetching their next probe before handing over.
+void digest_set_contains_batch(const digest_set *set, const uint8_t *digests, size_t stride, size_t count,
+                               uint8_t *found) {
+    int filtered = set->filter.block_count > 0;
+    for (size_t start = 0; start < count; start += LOOKUP_GROUP) {
+        size_t n = count - start < LOOKUP_GROUP ? count - start : LOOKUP_GROUP;
+        const uint8_t *group = digests + start * stride;
+        uint8_t *result = found + start;
+        search_state states[LOOKUP_GROUP];
+        size_t active[LOOKUP_GROUP]; // Searches still running
+        size_t active_count = 0;
+        uint8_t passed[LOOKUP_GROUP]; // Not ruled out by the filter
+
+        for (size_t i = 0; filtered && i < n; i++) {
+            digest_filter_prefetch(&set->filter, group + i * stride);
+        }
+        for (size_t i = 0; i < n; i++) {
+            const uint8_t *digest = group + i * stride;
+            result[i] = 0;
+            passed[i] = !filtered || digest_filter_may_contain(&set->filter, digest);
+            if (!passed[i]) {
+                digest_filter_count(&set->filter, 0, 0);
+            } else if (set->compact.high) {
+                digest_compact_prefetch(&set->compact, digest);
+                active[active_count++] = i; // Searched below in one pass
+            } else if (search_start(set_records(set), SHA256_DIGEST_SIZE, set->count, digest, &states[i])) {
+                __builtin_prefetch(set->digests[states[i].mid]);
+                active[active_count++] = i;
+            }
+        }
+
+        if (set->compact.high) {
+            for (size_t a = 0; a < active_count; a++) {
+                size_t i = active[a];
+                result[i] = digest_compact_contains(&set->compact, (const void *)set->digests, group + i * stride);
+            }
+        }
+        while (!set->compact.high && active_count > 0) { // One probe per running search per round
+            size_t still = 0;
+            for (size_t a = 0; a < active_count; a++) {
+                size_t i = active[a];
+                int status = search_step(set_records(set), SHA256_DIGEST_SIZE, group + i * stride, &states[i]);
+                if (status < 0) {
+                    __builtin_prefetch(set->digests[states[i].mid]);
+                    active[still++] = i;
+                } else {
+                    result[i] = status;
+                }
+            }
+            active_count = still;
+        }
+        for (size_t i = 0; filtered && i < n; i++) {
+            if (passed[i]) {
+                digest_filter_count(&set->filter, 1, result[i]);
+            }
+        }
+    }
+}
+
+void digest_set_free(digest_set *set) {
+    digest_filter_free(&set->filter);
+    digest_compact_free(&set->compact);
+    free(set->digests);
+    free(set->refs);
+    set->digests = NULL;
+    set->refs = NULL;
+    set->count = set->capacity = 0;
+}
+
+size_t digest_set_memory(const digest_set *set) {
+    size_t bytes = set->capacity * SHA256_DIGEST_SIZE + set->filter.block_count * FILTER_BLOCK_SIZE +
+                   set->compact.bytes;
+    if (set->capacity == 0 && !set->compact.high) {
+        bytes += set->count * SHA256_DIGEST_SIZE; // Mapped, but every page is touched by searches
+    }
+    return bytes;
+}
+
+// One line of a credentials or delta file
+typedef struct {
+    uint8_t username[SHA256_DIGEST_SIZE];
+    uint8_t password[SHA256_DIGEST_SIZE];
+    size_t order; // Position in the file, so the last of repeated lines wins
+    int op; // 1 to add the line, -1 to remove it
+} cred_line;
+
+// Same line first, then file order
+static int line_compare(const void *a, const void *b) {
+    const cred_line *x = a, *y = b;
+    int cmp = memcmp(x->username, y->username, SHA256_DIGEST_SIZE * 2);
+    if (cmp == 0) {
+        cmp = (x->order > y->order) - (x->order < y->order);
+    }
+    return cmp;
+}
+
+// Parse a credentials or delta file of "<64 hex>:<64 hex>" lines into *lines, each
+// distinct line once. In a delta file lines may start with '+' (add, the default) or
+// '-' (remove), and the last of repeated lines decides; *lines is malloc'd
+static int read_lines(const char *filename, int delta, cred_line **lines, size_t *count) {
+    FILE *file = fopen(filename, "r"); // Open the credentials file for reading
+    if (!file) {
+        return -1;
+    }
+
+    cred_line *list = NULL;
+    size_t n = 0, capacity = 0;
+    char line[LINE_SIZE]; // Buffer to hold each line from the file
+    size_t skipped = 0; // Lines that are not "<64 hex>:<64 hex>"
+    while (fgets(line, sizeof(line), file)) {
+        line[strcspn(line, "\r\n")] = 0; // Remove newline characters from the line
+        if (line[0] == '\0') {
+            continue; // Blank line
+        }
+
+        int op = 1;
+        char *entry = line;
+        if (delta && (line[0] == '+' || line[0] == '-')) { // Delta file operation
+            op = line[0] == '-' ? -1 : 1;
+            entry++;
+        }
+
+        if (n == capacity) { // Grow geometrically
+            capacity = capacity ? capacity * 2 : INITIAL_CAPACITY;
+            cred_line *grown = realloc(list, capacity * sizeof(*list));
+            if (!grown) {
+                fclose(file);
+                free(list);
+                return -1; // Out of memory
+            }
+            list = grown;
+        }
+        cred_line *next = &list[n];
+        if (strlen(entry) != SHA256_HEX_SIZE * 2 + 1 || entry[SHA256_HEX_SIZE] != ':' ||
+            hex_to_digest(entry, next->username) != 0 ||
+            hex_to_digest(entry + SHA256_HEX_SIZE + 1, next->password) != 0) {
+            skipped++;
+            continue;
+        }
+        next->order = n++;
+        next->op = op;
+    }
+    fclose(file); // Close the file
+
+    if (skipped) {
+        fprintf(stderr, "Skipped %zu malformed lines in %s\n", skipped, filename);
+    }
+    size_t unique = 0;
+    if (n > 0) {
+        qsort(list, n, sizeof(*list), line_compare);
+        for (size_t i = 0; i < n; i++) {
+            if (i + 1 < n && memcmp(list[i].username, list[i + 1].username, SHA256_DIGEST_SIZE * 2) == 0) {
+                continue; // A later copy of the line follows
+            }
+            list[unique++] = list[i];
+        }
+    }
+    *lines = list;
+    *count = unique;
+    return 0;
+}
+
+// Add the digests and pair of one line to `index`, each if `shard` owns it
+static int add_line(cred_index *index, const cred_line *line, uint64_t pair, const shard_map *map, int shard) {
+    if ((!map || shard_owner(map, line->username) == shard) &&
+        digest_set_add(&index->usernames, line->username) != 0) {
+        return -1;
+    }
+    if ((!map || shard_owner(map, line->password) == shard) &&
+        digest_set_add(&index->passwords, line->password) != 0) {
+        return -1;
+    }
+    return (!map || shard_owner_key(map, pair) == shard) ? pair_set_add(&index->pairs, pair) : 0;
+}
+
+// Sort every set of an index built by add_line, counting the lines behind each digest
+static int finalize_lines(cred_index *index) {
+    pair_set_finalize(&index->pairs);
+    return digest_set_finalize_counted(&index->usernames) == 0 && digest_set_finalize_counted(&index->passwords) == 0
+               ? 0 : -1;
+}
+
+// Parse a credentials file into `index`. With a shard map, digests and pairs other
+// shards own are dropped, but the line counts of the kept digests cover every line
+static int load_lines(const char *filename, cred_index *index, const shard_map *map, int shard) {
+    cred_line *lines;
+    size_t count;
+    memset(index, 0, sizeof(*index));
+    if (read_lines(filename, 0, &lines, &count) != 0) {
+        return -1;
+    }
+    int status = 0;
+    for (size_t i = 0; i < count && status == 0; i++) {
+        status = add_line(index, &lines[i], pair_fingerprint(lines[i].username, lines[i].password), map, shard);
+    }
+    free(lines);
+    if (status != 0 || finalize_lines(index) != 0) {
+        cred_index_free(index);
+        return -1; // Out of memory
+    }
+    return 0;
+}
+
+int cred_index_load(cred_index *index, const char *filename) {
+    return load_lines(filename, index, NULL, 0);
+}
+
+// 1 if the line counts of `set` are known
+static int digest_set_counted(const digest_set *set) {
+    return set->refs != NULL || set->count == 0;
+}
+
+// out = base + add - remove, in one pass over the sorted sets. The line count of each
+// digest goes up by the lines of `add` holding it and down by those of `remove`, and
+// the digest is dropped at zero. If base has no counts, `remove` must be empty and
+// out has none either
+static int digest_set_merge(digest_set *out, const digest_set *base, const digest_set *add,
+                            const digest_set *remove) {
+    memset(out, 0, sizeof(*out));
+    size_t capacity = base->count + add->count;
+    int counted = digest_set_counted(base);
+    if (capacity == 0) {
+        return 0;
+    }
+    out->digests = malloc(capacity * SHA256_DIGEST_SIZE);
+    out->refs = counted ? malloc(capacity * DIGEST_REF_SIZE) : NULL;
+    if (!out->digests || (counted && !out->refs)) {
+        digest_set_free(out);
+        return -1;
+    }
+    out->capacity = capacity;
+
+    size_t i = 0, j = 0, r = 0; // Positions in base, add and remove
+    while (i < base->count || j < add->count) {
+        const uint8_t *next; // Smallest remaining digest
+        uint64_t refs = 0; // Lines holding it
+        int cmp = i == base->count ? 1 : j == add->count ? -1 : memcmp(base->digests[i], add->digests[j],
+                                                                         SHA256_DIGEST_SIZE);
+        if (cmp <= 0) {
+            next = base->digests[i];
+            refs = counted ? ref_value(base->refs[i]) : 0;
+            i++;
+        }
+        if (cmp >= 0) {
+            next = add->digests[j];
+            refs += ref_value(add->refs[j]);
+            j++;
+        }
+        while (r < remove->count && memcmp(remove->digests[r], next, SHA256_DIGEST_SIZE) < 0) {
+            r++;
+        }
+        if (r < remove->count && memcmp(remove->digests[r], next, SHA256_DIGEST_SIZE) == 0 && refs < UINT32_MAX) {
+            uint32_t removed = ref_value(remove->refs[r]);
+            if (refs <= removed) {
+                continue; // No remaining line holds it
+            }
+            refs -= removed;
+        }
+        memcpy(out->digests[out->count], next, SHA256_DIGEST_SIZE);
+        if (counted) {
+            store_ref(out->refs[out->count], refs);
+        }
+        out->count++;
+    }
+    return 0;
+}
+
+int cred_index_apply_delta(cred_index *index, const cred_index *base, const char *filename,
+                           const shard_map *map, int shard) {
+    cred_line *lines;
+    size_t count;
+    if (read_lines(filename, 1, &lines, &count) != 0) {
+        return -1;
+    }
+    cred_index add, remove; // Lines base gains and lines it loses
+    memset(&add, 0, sizeof(add));
+    memset(&remove, 0, sizeof(remove));
+    int status = 0;
+    for (size_t i = 0; i < count && status == 0; i++) {
+        uint64_t pair = pair_fingerprint(lines[i].username, lines[i].password);
+        // Without the pair, base cannot tell whether it holds the line, so the delta is believed
+        int known = base->pairs.indexed && (!map || shard_owner_key(map, pair) == shard);
+        if (known && pair_set_contains(&base->pairs, pair) == (lines[i].op > 0)) {
+            continue; // Adds a line base holds, or removes one it does not
+        }
+        status = add_line(lines[i].op > 0 ? &add : &remove, &lines[i], pair, map, shard);
+    }
+    free(lines);
+    if (status == 0 && (finalize_lines(&add) != 0 || finalize_lines(&remove) != 0)) {
+        status = -1; // Out of memory
+    }
+    if (status == 0 && ((remove.usernames.count > 0 && !digest_set_counted(&base->usernames)) ||
+                        (remove.passwords.count > 0 && !digest_set_counted(&base->passwords)))) {
+        fprintf(stderr, "%s removes lines, but the credentials have no line counts: rebuild the index file "
+                        "with build-index\n", filename);
+        errno = EINVAL; // Removing the digests could delist ones other lines hold
+        status = -1;
+    }
+
+    memset(index, 0, sizeof(*index));
+    if (status == 0 &&
+        (digest_set_merge(&index->usernames, &base->usernames, &add.usernames, &remove.usernames) != 0 ||
+         digest_set_merge(&index->passwords, &base->passwords, &add.passwords, &remove.passwords) != 0 ||
+         pair_set_merge(&index->pairs, &base->pairs, &add.pairs, &remove.pairs) != 0)) {
+        cred_index_free(index);
+        status = -1; // Out of memory
+    }
+    cred_index_free(&add);
+    cred_index_free(&remove);
+    return status;
+}
+
+// Store `value` as 8 big-endian bytes
+static void put_u64(uint8_t *buf, uint64_t value) {
+    for (int i = 0; i < 8; i++) {
+        buf[i] = (uint8_t)(value >> (56 - i * 8));
+    }
+}
+
+static uint64_t get_u64(const uint8_t *buf) {
+    uint64_t value = 0;
+    for (int i = 0; i < 8; i++) {
+        value = (value << 8) | buf[i];
+    }
+    return value;
+}
+
+// SHA-256 of both digest arrays, their line counts if any and the pairs, in file order
+static void index_checksum(const cred_index *index, uint8_t checksum[SHA256_DIGEST_SIZE]) {
+    SHA256_CTX ctx;
+    sha256_init(&ctx);
+    sha256_update(&ctx, (const uint8_t *)index->usernames.digests, index->usernames.count * SHA256_DIGEST_SIZE);
+    sha256_update(&ctx, (const uint8_t *)index->passwords.digests, index->passwords.count * SHA256_DIGEST_SIZE);
+    if (index->usernames.refs) {
+        sha256_update(&ctx, (const uint8_t *)index->usernames.refs, index->usernames.count * DIGEST_REF_SIZE);
+        sha256_update(&ctx, (const uint8_t *)index->passwords.refs, index->passwords.count * DIGEST_REF_SIZE);
+    }
+    sha256_update(&ctx, (const uint8_t *)index->pairs.keys, index->pairs.count * PAIR_KEY_SIZE);
+    sha256_final(&ctx, checksum);
+}
+
+int cred_index_writer_open(cred_index_writer *w, const char *filename) {
+    memset(w, 0, sizeof(*w));
+    // Write beside the target and rename, so a server never maps a half-written file
+    if (snprintf(w->tmp, sizeof(w->tmp), "%s.tmp", filename) >= (int)sizeof(w->tmp)) {
+        errno = ENAMETOOLONG;
+        return -1;
+    }
+    w->filename = filename;
+    w->file = fopen(w->tmp, "wb");
+    if (!w->file) {
+        return -1;
+    }
+    setvbuf(w->file, NULL, _IOFBF, WRITER_BUFFER_SIZE);
+    uint8_t header[CRED_INDEX_HEADER_SIZE] = {0}; // Filled in by cred_index_writer_close
+    w->refs = tmpfile(); // Unlinked already, gone with the writer
+    if (!w->refs || fwrite(header, sizeof(header), 1, w->file) != 1) {
+        cred_index_writer_abort(w);
+        return -1;
+    }
+    w->counted = 1;
+    sha256_init(&w->checksum);
+    return 0;
+}
+
+int cred_index_writer_put(cred_index_writer *w, int field, const uint8_t (*digests)[SHA256_DIGEST_SIZE],
+                          const uint8_t (*refs)[DIGEST_REF_SIZE], size_t count) {
+    if (field < w->field || field > 1) {
+        errno = EINVAL; // Every username must precede the first password
+        return -1;
+    }
+    w->field = field;
+    w->counts[field] += count;
+    if (!refs) {
+        w->counted = 0; // The file gets no counts at all
+    } else if (w->counted && fwrite(refs, DIGEST_REF_SIZE, count, w->refs) != count) {
+        return -1;
+    }
+    sha256_update(&w->checksum, (const uint8_t *)digests, count * SHA256_DIGEST_SIZE);
+    return fwrite(digests, SHA256_DIGEST_SIZE, count, w->file) == count ? 0 : -1;
+}
+
+// After the last password, copy the line counts in behind the digests
+static int writer_end_digests(cred_index_writer *w) {
+    if (w->field == 2) {
+        return 0;
+    }
+    w->field = 2; // Nothing but pairs may follow
+    if (!w->counted) {
+        return 0;
+    }
+    uint8_t buffer[65536];
+    size_t n;
+    rewind(w->refs);
+    while ((n = fread(buffer, 1, sizeof(buffer), w->refs)) > 0) {
+        sha256_update(&w->checksum, buffer, n);
+        if (fwrite(buffer, 1, n, w->file) != n) {
+            return -1;
+        }
+    }
+    return ferror(w->refs) ? -1 : 0;
+}
+
+int cred_index_writer_put_pairs(cred_index_writer *w, const uint8_t (*keys)[PAIR_KEY_SIZE], size_t count) {
+    if (writer_end_digests(w) != 0) {
+        return -1;
+    }
+    w->pairs = 1;
+    sha256_update(&w->checksum, (const uint8_t *)keys, count * PAIR_KEY_SIZE);
+    return fwrite(keys, PAIR_KEY_SIZE, count, w->file) == count ? 0 : -1;
+}
+
+int cred_index_writer_close(cred_index_writer *w) {
+    if (writer_end_digests(w) != 0) {
+        cred_index_writer_abort(w);
+        return -1;
+    }
+    fclose(w->refs);
+    w->refs = NULL;
+    uint8_t header[CRED_INDEX_HEADER_SIZE] = {0};
+    memcpy(header, CRED_INDEX_MAGIC, 8);
+    header[11] = CRED_INDEX_VERSION; // 32-bit version at offset 8
+    header[15] = (w->pairs ? CRED_INDEX_PAIRS : 0) | (w->counted ? CRED_INDEX_REFS : 0); // 32-bit flags at offset 12
+    put_u64(header + 16, w->counts[0]);
+    put_u64(header + 24, w->counts[1]);
+    sha256_final(&w->checksum, header + 32);
+    int ok = fseek(w->file, 0, SEEK_SET) == 0 && fwrite(header, sizeof(header), 1, w->file) == 1;
+    int closed = fclose(w->file) == 0;
+    w->file = NULL;
+    if (!ok || !closed || rename(w->tmp, w->filename) != 0) {
+        cred_index_writer_abort(w);
+        return -1;
+    }
+    return 0;
+}
+
+void cred_index_writer_abort(cred_index_writer *w) {
+    int saved = errno;
+    if (w->file) {
+        fclose(w->file);
+        w->file = NULL;
+    }
+    if (w->refs) {
+        fclose(w->refs);
+        w->refs = NULL;
+    }
+    unlink(w->tmp);
+    errno = saved;
+}
+
+int cred_index_save(const cred_index *index, const char *filename) {
+    cred_index_writer w;
+    if (cred_index_writer_open(&w, filename) != 0) {
+        return -1;
+    }
+    int counted = index->usernames.refs && index->passwords.refs; // Kept only if both sets have them
+    if (cred_index_writer_put(&w, 0, (const void *)index->usernames.digests,
+                              counted ? (const void *)index->usernames.refs : NULL, index->usernames.count) != 0 ||
+        cred_index_writer_put(&w, 1, (const void *)index->passwords.digests,
+                              counted ? (const void *)index->passwords.refs : NULL, index->passwords.count) != 0 ||
+        (index->pairs.indexed &&
+         cred_index_writer_put_pairs(&w, (const void *)index->pairs.keys, index->pairs.count) != 0)) {
+        cred_index_writer_abort(&w);
+        return -1;
+    }
+    return cred_index_writer_close(&w);
+}
+
+int cred_index_map(cred_index *index, const char *filename) {
+    int fd = open(filename, O_RDONLY | O_CLOEXEC);
+    if (fd < 0) {
+        return -1;
+    }
+    struct stat st;
+    if (fstat(fd, &st) != 0) {
+        close(fd);
+        return -1;
+    }
+    if ((size_t)st.st_size < CRED_INDEX_HEADER_SIZE) {
+        close(fd);
+        errno = EINVAL; // Too short to be an index file
+        return -1;
+    }
+
+    void *map = mmap(NULL, st.st_size, PROT_READ, MAP_SHARED, fd, 0);
+    close(fd); // The mapping keeps the file alive
+    if (map == MAP_FAILED) {
+        return -1;
+    }
+
+    const uint8_t *header = map;
+    uint64_t version = get_u64(header + 8) >> 32;
+    uint32_t flags = (uint32_t)get_u64(header + 8); // Always zero in version 1
+    uint64_t usernames = get_u64(header + 16);
+    uint64_t passwords = get_u64(header + 24);
+    uint64_t expected = CRED_INDEX_HEADER_SIZE; // Size of the header and digests
+    if (memcmp(header, CRED_INDEX_MAGIC, 8) != 0 || version < 1 || version > CRED_INDEX_VERSION ||
+        (flags & ~(CRED_INDEX_PAIRS | CRED_INDEX_REFS)) != 0 ||
+        usernames > (UINT64_MAX - expected) / SHA256_DIGEST_SIZE ||
+        passwords > (UINT64_MAX - expected) / SHA256_DIGEST_SIZE - usernames ||
+        expected + (usernames + passwords) * SHA256_DIGEST_SIZE > (uint64_t)st.st_size) {
+        munmap(map, st.st_size);
+        errno = EINVAL; // Wrong magic, unknown version or truncated
+        return -1;
+    }
+    expected += (usernames + passwords) * SHA256_DIGEST_SIZE;
+    uint64_t refs = expected; // Offset of the line counts
+    if (flags & CRED_INDEX_REFS) {
+        if ((usernames + passwords) * DIGEST_REF_SIZE > (uint64_t)st.st_size - expected) {
+            munmap(map, st.st_size);
+            errno = EINVAL; // Truncated
+            return -1;
+        }
+        expected += (usernames + passwords) * DIGEST_REF_SIZE;
+    }
+    uint64_t pair_bytes = st.st_size - expected; // The pair section fills the rest
+    if ((flags & CRED_INDEX_PAIRS) ? pair_bytes % PAIR_KEY_SIZE != 0 : pair_bytes != 0) {
+        munmap(map, st.st_size);
+        errno = EINVAL; // Truncated, or trailing bytes
+        return -1;
+    }
+    madvise(map, st.st_size, MADV_RANDOM); // Lookups jump around, readahead only wastes cache
+
+    memset(index, 0, sizeof(*index));
+    index->map = map;
+    index->map_size = st.st_size;
+    index->usernames.digests = (void *)(header + CRED_INDEX_HEADER_SIZE); // Never written through
+    index->usernames.count = usernames;
+    index->passwords.digests = index->usernames.digests + usernames;
+    index->passwords.count = passwords;
+    if (flags & CRED_INDEX_REFS) {
+        index->usernames.refs = (void *)(header + refs);
+        index->passwords.refs = index->usernames.refs + usernames;
+    }
+    index->pairs.keys = (void *)(header + expected);
+    index->pairs.count = pair_bytes / PAIR_KEY_SIZE;
+    index->pairs.indexed = (flags & CRED_INDEX_PAIRS) != 0;
+    return 0;
+}
+
+// 1 if every digest is strictly greater than the one before it
+static int digest_set_sorted(const digest_set *set) {
+    for (size_t i = 1; i < set->count; i++) {
+        if (memcmp(set->digests[i - 1], set->digests[i], SHA256_DIGEST_SIZE) >= 0) {
+            return 0;
+        }
+    }
+    return 1;
+}
+
+// 1 if every fingerprint is strictly greater than the one before it
+static int pair_set_sorted(const pair_set *set) {
+    for (size_t i = 1; i < set->count; i++) {
+        if (memcmp(set->keys[i - 1], set->keys[i], PAIR_KEY_SIZE) >= 0) {
+            return 0;
+        }
+    }
+    return 1;
+}
+
+int cred_index_verify(const cred_index *index) {
+    if (!index->map) {
+        errno = EINVAL; // Only index files carry a checksum
+        return -1;
+    }
+    uint8_t checksum[SHA256_DIGEST_SIZE];
+    index_checksum(index, checksum);
+    if (memcmp(checksum, (const uint8_t *)index->map + 32, SHA256_DIGEST_SIZE) != 0 ||
+        !digest_set_sorted(&index->usernames) || !digest_set_sorted(&index->passwords) ||
+        !pair_set_sorted(&index->pairs)) {
+        errno = EINVAL; // Corrupted or not built by cred_index_save
+        return -1;
+    }
+    return 0;
+}
+
+int cred_index_is_file(const char *filename) {
+    FILE *file = fopen(filename, "rb");
+    if (!file) {
+        return 0;
+    }
+    char magic[8];
+    int is_index = fread(magic, 1, sizeof(magic), file) == sizeof(magic) &&
+                   memcmp(magic, CRED_INDEX_MAGIC, sizeof(magic)) == 0;
+    fclose(file);
+    return is_index;
+}
+
+int cred_index_open(cred_index *index, const char *filename) {
+    return cred_index_is_file(filename) ? cred_index_map(index, filename) : cred_index_load(index, filename);
+}
+
+// Copy the digests of `set` that `shard` owns, and their line counts; the result stays sorted
+static int digest_set_select(digest_set *out, const digest_set *set, const shard_map *map, int shard) {
+    memset(out, 0, sizeof(*out));
+    for (size_t i = 0; i < set->count; i++) {
+        if (shard_owner(map, set->digests[i]) != shard) {
+            continue;
+        }
+        if (set->refs && out->count == out->capacity) { // Keep the counts as long as the digests
+            size_t capacity = out->capacity ? out->capacity * 2 : INITIAL_CAPACITY;
+            void *grown = realloc(out->refs, capacity * DIGEST_REF_SIZE);
+            if (!grown) {
+                digest_set_free(out);
+                return -1;
+            }
+            out->refs = grown;
+        }
+        if (set->refs) {
+            memcpy(out->refs[out->count], set->refs[i], DIGEST_REF_SIZE);
+        }
+        if (digest_set_add(out, set->digests[i]) != 0) {
+            digest_set_free(out);
+            return -1;
+        }
+    }
+    return 0;
+}
+
+// 1 if `shard` owns every digest of `set`
+static int digest_set_owned(const digest_set *set, const shard_map *map, int shard) {
+    for (size_t i = 0; i < set->count; i++) {
+        if (shard_owner(map, set->digests[i]) != shard) {
+            return 0;
+        }
+    }
+    return 1;
+}
+
+int cred_index_select(cred_index *index, const cred_index *source, const shard_map *map, int shard) {
+    memset(index, 0, sizeof(*index));
+    if (digest_set_select(&index->usernames, &source->usernames, map, shard) != 0 ||
+        digest_set_select(&index->passwords, &source->passwords, map, shard) != 0 ||
+        pair_set_select(&index->pairs, &source->pairs, map, shard) != 0) {
+        cred_index_free(index);
+        return -1;
+    }
+    return 0;
+}
+
+int cred_index_open_shard(cred_index *index, const char *filename, const shard_map *map, int shard) {
+    if (!map) {
+        return cred_index_open(index, filename);
+    }
+    if (!cred_index_is_file(filename)) {
+        return load_lines(filename, index, map, shard); // Never holds other shards' digests
+    }
+    if (cred_index_map(index, filename) != 0) {
+        return -1;
+    }
+    if (digest_set_owned(&index->usernames, map, shard) && digest_set_owned(&index->passwords, map, shard) &&
+        pair_set_owned(&index->pairs, map, shard)) {
+        return 0; // A per-shard index file, serve it from the mapping
+    }
+    cred_index selected;
+    int status = cred_index_select(&selected, index, map, shard);
+    cred_index_free(index);
+    *index = selected;
+    return status;
+}
+
+int cred_index_build_filters(cred_index *index, int bits_per_key) {
+    if (digest_filter_build(&index->usernames.filter, (const void *)index->usernames.digests,
+                            index->usernames.count, bits_per_key) != 0 ||
+        digest_filter_build(&index->passwords.filter, (const void *)index->passwords.digests,
+                            index->passwords.count, bits_per_key) != 0) {
+        digest_filter_free(&index->usernames.filter);
+        digest_filter_free(&index->passwords.filter);
+        return -1; // Out of memory
+    }
+    return 0;
+}
+
+int cred_index_build_ranges(cred_index *index) {
+    return range_index_build(&index->password_ranges, (const void *)index->passwords.digests,
+                             index->passwords.count);
+}
+
+// Move heap-allocated digests to an unlinked temporary index file and map it, so their
+// pages can be evicted and read back on demand
+static int cred_index_move_to_file(cred_index *index) {
+    const char *tmpdir = getenv("TMPDIR") ? getenv("TMPDIR") : "/tmp";
+    char path[4096];
+    if (snprintf(path, sizeof(path), "%s/cred-index-XXXXXX", tmpdir) >= (int)sizeof(path)) {
+        errno = ENAMETOOLONG;
+        return -1;
+    }
+    int fd = mkstemp(path);
+    if (fd < 0) {
+        return -1;
+    }
+    close(fd);
+    cred_index mapped;
+    if (cred_index_save(index, path) != 0 || cred_index_map(&mapped, path) != 0) {
+        int saved = errno;
+        unlink(path);
+        errno = saved;
+        return -1;
+    }
+    unlink(path); // The mapping keeps the file alive
+    mapped.usernames.filter = index->usernames.filter; // Keep anything already built
+    mapped.passwords.filter = index->passwords.filter;
+    mapped.password_ranges = index->password_ranges;
+    free(index->usernames.digests);
+    free(index->passwords.digests);
+    free(index->usernames.refs);
+    free(index->passwords.refs);
+    free(index->pairs.keys); // Mapped from the file like the digests
+    *index = mapped;
+    return 0;
+}
+
+int cred_index_build_compact(cred_index *index) {
+    if (!index->map && cred_index_move_to_file(index) != 0) {
+        return -1;
+    }
+    if (digest_compact_build(&index->usernames.compact, (const void *)index->usernames.digests,
+                             index->usernames.count) != 0 ||
+        digest_compact_build(&index->passwords.compact, (const void *)index->passwords.digests,
+                             index->passwords.count) != 0) {
+        digest_compact_free(&index->usernames.compact);
+        return -1; // Out of memory
+    }
+    madvise(index->map, index->map_size, MADV_DONTNEED); // Only hits read the digests from now on
+    return 0;
+}
+
+int cred_index_place(cred_index *index, int numa_node) {
+    digest_set *sets[2] = {&index->usernames, &index->passwords};
+    int copied = 0; // Digests and pairs already in huge pages
+    if (index->map && !index->usernames.compact.high) { // Page-cache pages of a mapped file stay small
+        void *copies[3] = {NULL, NULL, NULL};
+        size_t sizes[3] = {sets[0]->count * SHA256_DIGEST_SIZE, sets[1]->count * SHA256_DIGEST_SIZE,
+                           index->pairs.count * PAIR_KEY_SIZE};
+        const void *sources[3] = {sets[0]->digests, sets[1]->digests, index->pairs.keys};
+        for (int f = 0; f < 3; f++) {
+            if (!(copies[f] = hugemem_alloc(sizes[f], numa_node))) {
+                free(copies[0]);
+                free(copies[1]);
+                return -1;
+            }
+            memcpy(copies[f], sources[f], sizes[f]);
+        }
+        munmap(index->map, index->map_size); // Heap allocated from here on
+        index->map = NULL;
+        index->map_size = 0;
+        for (int f = 0; f < 2; f++) {
+            sets[f]->digests = copies[f];
+            sets[f]->refs = NULL; // Were in the mapping, and lookups never need them
+        }
+        index->pairs.keys = copies[2];
+        copied = 1;
+    }
+    if (!index->map && !copied &&
+        hugemem_move((void **)&index->pairs.keys, index->pairs.count * PAIR_KEY_SIZE, numa_node) != 0) {
+        return -1;
+    }
+    if (!index->map) {
+        index->pairs.capacity = index->pairs.count;
+    }
+    for (int f = 0; f < 2; f++) {
+        if (!index->map && !copied &&
+            hugemem_move((void **)&sets[f]->digests, sets[f]->count * SHA256_DIGEST_SIZE, numa_node) != 0) {
+            return -1;
+        }
+        if (!index->map) {
+            sets[f]->capacity = sets[f]->count; // Unused slots were not copied
+        }
+        if (hugemem_move((void **)&sets[f]->filter.blocks, sets[f]->filter.block_count * FILTER_BLOCK_SIZE,
+                         numa_node) != 0 ||
+            digest_compact_place(&sets[f]->compact, numa_node) != 0) {
+            return -1;
+        }
+    }
+    return 0;
+}
+
+void cred_index_free(cred_index *index) {
+    range_index_free(&index->password_ranges);
+    if (index->map) {
+        digest_filter_free(&index->usernames.filter);
+        digest_filter_free(&index->passwords.filter);
+        digest_compact_free(&index->usernames.compact);
+        digest_compact_free(&index->passwords.compact);
+        munmap(index->map, index->map_size);
+        memset(index, 0, sizeof(*index));
+        return;
+    }
+    digest_set_free(&index->usernames);
+    digest_set_free(&index->passwords);
+    pair_set_free(&index->pairs);
+}
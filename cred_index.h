@@ -0,0 +1,131 @@
+// cred_index.h
+// In-memory index of breached credential hashes. Each field (username/email and
+// password) gets its own set of 32-byte binary digests kept in a sorted array, so a
+// lookup is an interpolation search over uniformly distributed keys instead of a
+// strcmp scan over 65-byte hex strings.
+//
+// The sets can also be compiled offline into an index file (see build_index.c) that
+// the server maps read-only, so startup does not parse text and every process on a
+// host shares the same page-cache pages. Layout, integers in network order:
+//   0  magic           CRED_INDEX_MAGIC
+//   8  version         CRED_INDEX_VERSION
+//   12 flags           CRED_INDEX_PAIRS if the file has a pair section,
+//                      CRED_INDEX_REFS if it has line counts
+//   16 username count
+//   24 password count
+//   32 checksum        SHA-256 of everything after the header
+//   64 username digests, sorted, then password digests, sorted, then the line count
+//      of each username and then each password digest, then the pair fingerprints
+//      (pair.h), sorted, filling the rest of the file
+// Version 1 files have no flags and no pair section, and are still mapped.
+//
+// A delta file has the credentials file's line format; lines starting with '+' (or
+// nothing) add a line and lines starting with '-' remove one, the last of repeated
+// lines winning. Every digest carries the number of distinct lines holding it, so a
+// removal takes a username or password out of its set once no remaining line holds
+// it; sets without these counts (version 1 files, or files written before them)
+// refuse removals. Whether a line is already held is told by its pair fingerprint,
+// except on a sharded server for a line whose pair another shard owns, which is taken
+// at its word. Applying a delta is a linear merge with the sorted sets, not a full
+// reload.
+//
+// In a sharded deployment (see shard.h) a server keeps only the digests and pairs its
+// shard owns.
+// A text file is filtered while it is parsed; an index file written for the shard is
+// mapped as usual, and a whole-corpus index file is copied down to the owned digests.
+
+#ifndef _CRED_INDEX_H_
+#define _CRED_INDEX_H_
+
+#include <stddef.h>
+#include <stdint.h>
+#include <stdio.h>
+#include "sha256_lib.h"
+#include "filter.h"
+#include "compact.h"
+#include "range.h"
+#include "shard.h"
+#include "pair.h"
+
+#define SHA256_HEX_SIZE (SHA256_DIGEST_SIZE * 2) // Length of a digest written as hex
+
+#define CRED_INDEX_MAGIC "CREDIDX\0" // First 8 bytes of an index file
+#define CRED_INDEX_VERSION 2 // Current index file layout
+#define CRED_INDEX_PAIRS 0x1 // Header flag: pair fingerprints follow the password digests
+#define CRED_INDEX_REFS 0x2 // Header flag: line counts follow the password digests
+#define DIGEST_REF_SIZE 4 // Bytes per stored line count
+#define CRED_INDEX_HEADER_SIZE 64 // Bytes before the first digest
+
+// Sorted, de-duplicated array of binary SHA-256 digests
+typedef struct {
+    uint8_t (*digests)[SHA256_DIGEST_SIZE]; // Digests in ascending memcmp order
+    size_t count; // Number of digests stored
+    size_t capacity; // Number of digests allocated
+    uint8_t (*refs)[DIGEST_REF_SIZE]; // Big-endian count of the distinct lines holding each digest, NULL if unknown
+    digest_filter filter; // Optional pre-filter checked before searching
+    digest_compact compact; // Optional compressed directory searched instead of `digests`
+} digest_set;
+
+// Index file being written front to back, for sets too large to hold in memory
+typedef struct {
+    FILE *file; // Temporary file beside the target
+    char tmp[4096]; // Its name
+    FILE *refs; // Line counts of the digests written so far, copied in after the last password
+    const char *filename; // Target name, replaced on close
+    SHA256_CTX checksum; // Running checksum of the digests
+    uint64_t counts[2]; // Usernames and passwords written
+    int field; // 0 while writing usernames, 1 once passwords have started, 2 once pairs have
+    int counted; // Set CRED_INDEX_REFS: every digest came with its line count
+    int pairs; // Set CRED_INDEX_PAIRS, even if no pair was written
+} cred_index_writer;
+
+// Username/email and password digests loaded from one credentials file
+typedef struct {
+    digest_set usernames; // Left-hand side of each "user:password" line
+    digest_set passwords; // Right-hand side of each "user:password" line
+    pair_set pairs; // Fingerprint of each line's username and password together
+    range_index password_ranges; // Precomputed k-anonymity replies, empty unless built
+    void *map; // Mapped index file backing both sets, NULL if they are heap allocated
+    size_t map_size; // Length of the mapping
+} cred_index;
+
+int hex_value(char c); // Value of one hex digit, -1 if it is not one
+int hex_to_digest(const char *hex, uint8_t digest[SHA256_DIGEST_SIZE]); // Parse 64 hex chars, 0 on success
+void digest_to_hex(const uint8_t digest[SHA256_DIGEST_SIZE], char hex[SHA256_HEX_SIZE + 1]); // Format as lowercase hex
+
+int digest_set_add(digest_set *set, const uint8_t digest[SHA256_DIGEST_SIZE]); // Append a digest, 0 on success
+void digest_set_finalize(digest_set *set); // Sort and de-duplicate after the last add
+size_t digest_sort_unique(uint8_t (*digests)[SHA256_DIGEST_SIZE], size_t count); // Sort in place, returns the distinct count
+int digest_set_contains(const digest_set *set, const uint8_t digest[SHA256_DIGEST_SIZE]); // 1 if present
+void digest_set_contains_batch(const digest_set *set, const uint8_t *digests, size_t stride, size_t count,
+                               uint8_t *found); // found[i] = 1 if the digest at digests + i * stride is present
+void digest_set_free(digest_set *set); // Release the digest array, filter and directory
+size_t digest_set_memory(const digest_set *set); // Bytes that must stay resident to search the set
+
+int cred_index_load(cred_index *index, const char *filename); // Load a credentials*-sha256.txt file, 0 on success
+int cred_index_apply_delta(cred_index *index, const cred_index *base, const char *filename,
+                           const shard_map *map, int shard); // Merge a delta file into a copy of base, 0 on success
+int cred_index_save(const cred_index *index, const char *filename); // Write an index file, 0 on success
+int cred_index_writer_open(cred_index_writer *w, const char *filename); // Start writing an index file, 0 on success
+int cred_index_writer_put(cred_index_writer *w, int field, const uint8_t (*digests)[SHA256_DIGEST_SIZE],
+                          const uint8_t (*refs)[DIGEST_REF_SIZE],
+                          size_t count); // Append sorted digests of field 0 (usernames), then 1 (passwords), refs may be NULL
+int cred_index_writer_put_pairs(cred_index_writer *w, const uint8_t (*keys)[PAIR_KEY_SIZE],
+                                size_t count); // Append sorted pair fingerprints after the last password
+int cred_index_writer_close(cred_index_writer *w); // Fill in the header and rename into place, 0 on success
+void cred_index_writer_abort(cred_index_writer *w); // Discard the partial file
+int cred_index_is_file(const char *filename); // 1 if the file starts with CRED_INDEX_MAGIC
+int cred_index_map(cred_index *index, const char *filename); // Map an index file read-only, 0 on success
+int cred_index_verify(const cred_index *index); // Check a mapped index's checksum and order, 0 if intact
+int cred_index_open(cred_index *index, const char *filename); // Map an index file or load a text file, 0 on success
+int cred_index_select(cred_index *index, const cred_index *source,
+                      const shard_map *map, int shard); // Copy the digests and pairs `shard` owns, 0 on success
+int cred_index_open_shard(cred_index *index, const char *filename,
+                          const shard_map *map, int shard); // cred_index_open keeping only `shard`'s digests and pairs
+int cred_index_build_filters(cred_index *index, int bits_per_key); // Add a pre-filter to both sets, 0 on success
+int cred_index_build_ranges(cred_index *index); // Precompute password range replies, 0 on success
+int cred_index_build_compact(cred_index *index); // Search both sets through compressed directories, 0 on success
+int cred_index_place(cred_index *index, int numa_node); // Move searched arrays to huge pages (hugemem.h), 0 on success
+void cred_index_free(cred_index *index); // Release the sets or unmap the file
+
+#endif
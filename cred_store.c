@@ -0,0 +1,65 @@
+// cred_store.c
+#include <assert.h>
+#include <stdlib.h>
+#include <unistd.h>
+#include "cred_store.h"
+
+#define GRACE_POLL_US 1000 // How often the publisher rechecks readers during a grace period
+
+// Epoch a reader entered in, 0 while it is outside any burst
+typedef struct {
+    uint64_t epoch;
+    char pad[64 - sizeof(uint64_t)]; // One cache line per reader, so entering never contends
+} reader_slot;
+
+static reader_slot readers[CRED_STORE_MAX_READERS];
+static int reader_count; // Slots handed out
+static uint64_t global_epoch = 1; // Advanced by every publish
+static cred_index *current; // Index new bursts see
+
+void cred_store_init(cred_index *index) {
+    current = index;
+}
+
+int cred_store_register(void) {
+    int slot = __atomic_fetch_add(&reader_count, 1, __ATOMIC_RELAXED);
+    return slot < CRED_STORE_MAX_READERS ? slot : -1;
+}
+
+const cred_index *cred_store_enter(int slot) {
+    assert(slot >= 0 && slot < CRED_STORE_MAX_READERS); // An unregistered reader would go unseen by publish
+    __atomic_store_n(&readers[slot].epoch, __atomic_load_n(&global_epoch, __ATOMIC_ACQUIRE), __ATOMIC_RELAXED);
+    __atomic_thread_fence(__ATOMIC_SEQ_CST); // Announce the epoch before reading the pointer
+    return __atomic_load_n(&current, __ATOMIC_ACQUIRE);
+}
+
+void cred_store_leave(int slot) {
+    assert(slot >= 0 && slot < CRED_STORE_MAX_READERS);
+    __atomic_store_n(&readers[slot].epoch, 0, __ATOMIC_RELEASE);
+}
+
+const cred_index *cred_store_current(void) {
+    return __atomic_load_n(&current, __ATOMIC_ACQUIRE);
+}
+
+void cred_store_publish(cred_index *index) {
+    cred_index *old = current;
+    __atomic_store_n(&current, index, __ATOMIC_RELEASE);
+    __atomic_thread_fence(__ATOMIC_SEQ_CST); // Swap before inspecting readers
+    uint64_t target = __atomic_add_fetch(&global_epoch, 1, __ATOMIC_SEQ_CST);
+
+    // A reader still in an older epoch may hold `old`; wait for it to leave or re-enter
+    int count = __atomic_load_n(&reader_count, __ATOMIC_RELAXED);
+    for (int i = 0; i < count && i < CRED_STORE_MAX_READERS; i++) {
+        while (1) {
+            uint64_t epoch = __atomic_load_n(&readers[i].epoch, __ATOMIC_ACQUIRE);
+            if (epoch == 0 || epoch >= target) {
+                break;
+            }
+            usleep(GRACE_POLL_US);
+        }
+    }
+
+    cred_index_free(old);
+    free(old);
+}
@@ -0,0 +1,22 @@
+// cred_store.h
+// The credential index currently being served, replaceable while the server runs.
+// Readers bracket each burst of lookups with cred_store_enter/cred_store_leave and
+// never take a lock. The reload thread publishes a new index and frees the old one
+// after a grace period: once every reader has left or re-entered since the swap, no
+// one can still hold the old pointer (quiescent-state-based reclamation).
+
+#ifndef _CRED_STORE_H_
+#define _CRED_STORE_H_
+
+#include "cred_index.h"
+
+#define CRED_STORE_MAX_READERS 1024 // Reader threads that can register
+
+void cred_store_init(cred_index *index); // Serve `index` (heap allocated, owned by the store)
+int cred_store_register(void); // Reader slot for the calling thread, -1 if none are left
+const cred_index *cred_store_enter(int slot); // Start a burst of lookups with a registered slot, returns the index to use
+void cred_store_leave(int slot); // End the burst; the returned index must not be used after this
+const cred_index *cred_store_current(void); // Latest index, for the publishing thread only
+void cred_store_publish(cred_index *index); // Swap in `index`, then wait for readers and free the old one
+
+#endif
@@ -0,0 +1,109 @@
+// filter.c
+#include <stdlib.h>
+#include <string.h>
+#include "filter.h"
+
+// 8 digest bytes as a big-endian integer
+static uint64_t digest_word(const uint8_t *bytes) {
+    uint64_t word = 0;
+    for (int i = 0; i < 8; i++) {
+        word = (word << 8) | bytes[i];
+    }
+    return word;
+}
+
+// Block for a digest: bytes 8-15 scaled onto the block count (bytes 0-7 order the sorted set)
+static size_t filter_block(const digest_filter *filter, const uint8_t *digest) {
+    return (size_t)(((unsigned __int128)digest_word(digest + 8) * filter->block_count) >> 64);
+}
+
+// Nine-bit positions inside the block, taken from bytes 16-23
+static uint64_t filter_bits(const uint8_t *digest) {
+    return digest_word(digest + 16);
+}
+
+int digest_filter_build(digest_filter *filter, const uint8_t (*digests)[SHA256_DIGEST_SIZE],
+                        size_t count, int bits_per_key) {
+    memset(filter, 0, sizeof(*filter));
+    filter->counters = calloc(1, sizeof(*filter->counters));
+    if (!filter->counters) {
+        return -1;
+    }
+    if (count == 0) {
+        return 0; // An empty filter rejects nothing; lookups go straight to the empty set
+    }
+
+    size_t bits = count * (size_t)bits_per_key;
+    filter->block_count = (bits + FILTER_BLOCK_SIZE * 8 - 1) / (FILTER_BLOCK_SIZE * 8);
+    filter->blocks = calloc(filter->block_count, FILTER_BLOCK_SIZE);
+    if (!filter->blocks) {
+        digest_filter_free(filter);
+        return -1;
+    }
+
+    for (size_t i = 0; i < count; i++) {
+        uint8_t *block = filter->blocks[filter_block(filter, digests[i])];
+        uint64_t word = filter_bits(digests[i]);
+        for (int j = 0; j < FILTER_PROBES; j++, word >>= 9) {
+            unsigned bit = word & 511;
+            block[bit / 8] |= 1 << (bit % 8);
+        }
+    }
+    return 0;
+}
+
+int digest_filter_load(digest_filter *filter, const void *data, size_t size) {
+    memset(filter, 0, sizeof(*filter));
+    if (size == 0 || size % FILTER_BLOCK_SIZE != 0) {
+        return -1; // Not a whole number of blocks
+    }
+    filter->blocks = malloc(size);
+    if (!filter->blocks) {
+        return -1;
+    }
+    memcpy(filter->blocks, data, size);
+    filter->block_count = size / FILTER_BLOCK_SIZE;
+    return 0;
+}
+
+int digest_filter_may_contain(const digest_filter *filter, const uint8_t digest[SHA256_DIGEST_SIZE]) {
+    if (filter->block_count == 0) {
+        return 1; // No filter, cannot rule anything out
+    }
+    const uint8_t *block = filter->blocks[filter_block(filter, digest)];
+    uint64_t word = filter_bits(digest);
+    for (int j = 0; j < FILTER_PROBES; j++, word >>= 9) {
+        unsigned bit = word & 511;
+        if (!(block[bit / 8] & (1 << (bit % 8)))) {
+            return 0;
+        }
+    }
+    return 1;
+}
+
+void digest_filter_prefetch(const digest_filter *filter, const uint8_t digest[SHA256_DIGEST_SIZE]) {
+    if (filter->block_count > 0) {
+        __builtin_prefetch(filter->blocks[filter_block(filter, digest)]);
+    }
+}
+
+void digest_filter_count(const digest_filter *filter, int passed, int found) {
+    filter_counters *c = filter->counters;
+    if (!c) {
+        return;
+    }
+    if (!passed) {
+        __atomic_fetch_add(&c->rejected, 1, __ATOMIC_RELAXED);
+        return;
+    }
+    __atomic_fetch_add(&c->passed, 1, __ATOMIC_RELAXED);
+    if (!found) {
+        __atomic_fetch_add(&c->false_positives, 1, __ATOMIC_RELAXED);
+    }
+}
+
+void digest_filter_free(digest_filter *filter) {
+    free(filter->blocks);
+    free(filter->counters);
+    memset(filter, 0, sizeof(*filter));
+}
@@ -0,0 +1,41 @@
+// filter.h
+// Blocked Bloom filter over SHA-256 digests, consulted before the sorted digest
+// search so that most misses are answered from one cache line. Each key sets
+// FILTER_PROBES bits inside a single 64-byte block; the block and bit positions are
+// taken straight from digest bytes the search does not use, since they are already
+// uniform. The byte layout is the wire format sent to clients, so it does not
+// depend on host endianness: bit b of a block is bit b % 8 of byte b / 8.
+
+#ifndef _FILTER_H_
+#define _FILTER_H_
+
+#include <stddef.h>
+#include <stdint.h>
+#include "sha256_lib.h"
+
+#define FILTER_BLOCK_SIZE 64 // Bytes per block, one cache line
+#define FILTER_PROBES 7 // Bits set per key
+#define FILTER_BITS_PER_KEY 10 // Default size, about 1% false positives
+
+// Lookup outcomes, updated with relaxed atomics by every server thread
+typedef struct {
+    uint64_t rejected; // Definite negatives answered by the filter alone
+    uint64_t passed; // Keys the filter could not rule out
+    uint64_t false_positives; // Passed keys the full search did not find
+} filter_counters;
+
+typedef struct {
+    uint8_t (*blocks)[FILTER_BLOCK_SIZE]; // Filter bits
+    size_t block_count; // Number of blocks, 0 if no filter was built
+    filter_counters *counters; // Statistics, NULL for filters received from a server
+} digest_filter;
+
+int digest_filter_build(digest_filter *filter, const uint8_t (*digests)[SHA256_DIGEST_SIZE],
+                        size_t count, int bits_per_key); // Build over `count` digests, 0 on success
+int digest_filter_load(digest_filter *filter, const void *data, size_t size); // Copy a received filter, 0 on success
+int digest_filter_may_contain(const digest_filter *filter, const uint8_t digest[SHA256_DIGEST_SIZE]); // 0 if surely absent
+void digest_filter_prefetch(const digest_filter *filter, const uint8_t digest[SHA256_DIGEST_SIZE]); // Start loading the digest's block
+void digest_filter_count(const digest_filter *filter, int passed, int found); // Record one lookup outcome
+void digest_filter_free(digest_filter *filter); // Release the blocks and counters
+
+#endif
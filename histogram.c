@@ -0,0 +1,63 @@
+// histogram.c
+#include "histogram.h"
+
+#define SUB_COUNT (1 << HIST_SUB_BITS)
+
+static unsigned hist_index(uint64_t value) {
+    if (value < SUB_COUNT) {
+        return (unsigned)value; // Exact
+    }
+    unsigned exponent = 63 - __builtin_clzll(value); // Position of the top bit, >= HIST_SUB_BITS
+    unsigned sub = (unsigned)(value >> (exponent - HIST_SUB_BITS)) & (SUB_COUNT - 1);
+    return ((exponent - HIST_SUB_BITS + 1) << HIST_SUB_BITS) + sub;
+}
+
+// Largest value that lands in bucket `index`
+static uint64_t hist_upper(unsigned index) {
+    if (index < SUB_COUNT) {
+        return index;
+    }
+    unsigned exponent = (index >> HIST_SUB_BITS) + HIST_SUB_BITS - 1;
+    uint64_t sub = index & (SUB_COUNT - 1);
+    uint64_t width = 1ULL << (exponent - HIST_SUB_BITS);
+    return ((SUB_COUNT + sub) << (exponent - HIST_SUB_BITS)) + (width - 1);
+}
+
+void hist_record(histogram *h, uint64_t value) {
+    h->counts[hist_index(value)]++;
+    h->total++;
+    h->sum += (double)value;
+    if (value > h->max) {
+        h->max = value;
+    }
+}
+
+void hist_merge(histogram *dst, const histogram *src) {
+    for (unsigned i = 0; i < HIST_BUCKETS; i++) {
+        dst->counts[i] += src->counts[i];
+    }
+    dst->total += src->total;
+    dst->sum += src->sum;
+    if (src->max > dst->max) {
+        dst->max = src->max;
+    }
+}
+
+uint64_t hist_percentile(const histogram *h, double percentile) {
+    if (h->total == 0) {
+        return 0;
+    }
+    uint64_t rank = (uint64_t)(percentile / 100.0 * h->total + 0.5); // Values at or below the answer
+    if (rank < 1) {
+        rank = 1;
+    }
+    uint64_t seen = 0;
+    for (unsigned i = 0; i < HIST_BUCKETS; i++) {
+        seen += h->counts[i];
+        if (seen >= rank) {
+            uint64_t upper = hist_upper(i);
+            return upper < h->max ? upper : h->max; // Never report more than was seen
+        }
+    }
+    return h->max;
+}
@@ -0,0 +1,26 @@
+// histogram.h
+// Log-linear latency histogram in the style of HdrHistogram: values below
+// 2^HIST_SUB_BITS are counted exactly, larger ones in 2^HIST_SUB_BITS sub-buckets per
+// power of two, so any recorded value is reported within about 1.6% using a fixed
+// 30 KB of counters and no allocation.
+
+#ifndef _HISTOGRAM_H_
+#define _HISTOGRAM_H_
+
+#include <stdint.h>
+
+#define HIST_SUB_BITS 6 // log2 of the sub-buckets per power of two
+#define HIST_BUCKETS ((64 - HIST_SUB_BITS + 1) << HIST_SUB_BITS) // Covers every uint64_t value
+
+typedef struct {
+    uint64_t counts[HIST_BUCKETS]; // Values recorded per bucket
+    uint64_t total; // Number of values recorded
+    uint64_t max; // Largest value recorded, exact
+    double sum; // Sum of values, for the mean
+} histogram;
+
+void hist_record(histogram *h, uint64_t value); // Count one value
+void hist_merge(histogram *dst, const histogram *src); // Add src's counts into dst
+uint64_t hist_percentile(const histogram *h, double percentile); // Upper bound of the bucket holding it, 0 if empty
+
+#endif
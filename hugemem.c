@@ -0,0 +1,65 @@
+// hugemem.c
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+#include <errno.h>
+#include <unistd.h>
+#include <sys/mman.h>
+#include <sys/syscall.h>
+#include <linux/mempolicy.h>
+#include "hugemem.h"
+
+void *hugemem_alloc(size_t size, int numa_node) {
+    size_t rounded = (size + HUGEMEM_PAGE_SIZE - 1) & ~(size_t)(HUGEMEM_PAGE_SIZE - 1); // Whole huge pages
+    void *block;
+    int err = posix_memalign(&block, HUGEMEM_PAGE_SIZE, rounded ? rounded : HUGEMEM_PAGE_SIZE);
+    if (err != 0) {
+        errno = err;
+        return NULL;
+    }
+    madvise(block, rounded, MADV_HUGEPAGE); // Fails only without THP support, leaving normal pages
+
+    if (numa_node >= 0) { // Raw system call, so libnuma is not needed
+        unsigned long mask[16] = {0}; // Up to 1024 nodes
+        if (numa_node >= (int)(sizeof(mask) * 8)) {
+            free(block);
+            errno = EINVAL;
+            return NULL;
+        }
+        mask[numa_node / (sizeof(long) * 8)] = 1UL << (numa_node % (sizeof(long) * 8));
+        if (syscall(SYS_mbind, block, rounded, MPOL_BIND, mask, sizeof(mask) * 8, 0) != 0) {
+            int saved = errno;
+            free(block);
+            errno = saved;
+            return NULL;
+        }
+    }
+    return block;
+}
+
+int hugemem_move(void **block, size_t size, int numa_node) {
+    if (!*block || size == 0) {
+        return 0;
+    }
+    void *moved = hugemem_alloc(size, numa_node);
+    if (!moved) {
+        return -1;
+    }
+    memcpy(moved, *block, size); // First touch, so the pages are faulted in huge and on the node
+    free(*block);
+    *block = moved;
+    return 0;
+}
+
+int hugemem_available(void) {
+    char mode[128] = ""; // e.g. "always [madvise] never"
+    FILE *file = fopen("/sys/kernel/mm/transparent_hugepage/enabled", "r");
+    if (!file) {
+        return 0;
+    }
+    if (!fgets(mode, sizeof(mode), file)) {
+        mode[0] = '\0';
+    }
+    fclose(file);
+    return strstr(mode, "[never]") == NULL && mode[0] != '\0';
+}
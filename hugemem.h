@@ -0,0 +1,23 @@
+// hugemem.h
+// Placement of the large arrays searched on every lookup. With 4 KB pages a probe
+// into a multi-gigabyte array misses the TLB as well as the cache, and the page walk
+// is a second dependent DRAM access; backed by 2 MB transparent huge pages the page
+// tables for the whole array stay cached. On machines with several NUMA nodes the
+// arrays can also be bound to the node whose cores serve requests.
+//
+// Blocks come from posix_memalign, aligned to the huge page size and advised before
+// their first touch, so the kernel faults them in as huge pages and free() releases
+// them like any other heap block.
+
+#ifndef _HUGEMEM_H_
+#define _HUGEMEM_H_
+
+#include <stddef.h>
+
+#define HUGEMEM_PAGE_SIZE (2 << 20) // Transparent huge page size on x86-64 and arm64
+
+void *hugemem_alloc(size_t size, int numa_node); // Huge-page block bound to numa_node (-1 for any), NULL on error
+int hugemem_move(void **block, size_t size, int numa_node); // Copy a heap block into hugemem_alloc memory, 0 on success
+int hugemem_available(void); // 1 if the kernel honours MADV_HUGEPAGE
+
+#endif
@@ -0,0 +1,663 @@
+// ingest.c
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+#include <errno.h>
+#include <fcntl.h>
+#include <unistd.h>
+#include <pthread.h>
+#include "cred_index.h"
+#include "sha256_lib.h"
+#include "ingest.h"
+
+#define CHUNKS_PER_WORKER 2 // Chunks queued or being parsed per worker, besides the one being read
+#define PLAIN_BATCH 128 // Plain lines hashed per sha256_batch call
+#define MERGE_BUFFER 2048 // Digests read from a run file, or handed to the writer, at a time
+#define MIN_RUN 4096 // Smallest run buffer per worker and field, whatever the budget
+#define FIELDS 3 // Usernames, passwords and pair fingerprints
+#define PAIRS 2 // Field of the pair fingerprints
+#define LINK_SIZE (SHA256_DIGEST_SIZE + PAIR_KEY_SIZE) // Username or password record: digest, then its line's pair
+
+static const size_t field_width[FIELDS] = {LINK_SIZE, LINK_SIZE, PAIR_KEY_SIZE}; // Bytes per record
+
+// Input bytes cut at a line end
+typedef struct {
+    char *data; // INGEST_CHUNK_SIZE bytes
+    size_t len; // Bytes filled
+} chunk;
+
+// Sorted, de-duplicated run of one field spilled to an unlinked file
+typedef struct {
+    FILE *file; // Positioned at the start once every run is written
+    size_t count; // Records in the file
+} spill;
+
+// Records of one field parsed by a worker since its last spill
+typedef struct {
+    uint8_t *records; // `limit` records of the field's width
+    size_t count; // Records buffered
+} run_buffer;
+
+// State shared by the reader, the workers and the merge
+typedef struct {
+    const ingest_options *options;
+    pthread_mutex_t lock;
+    pthread_cond_t queued; // A chunk was queued, input ended or a worker failed
+    pthread_cond_t freed; // A chunk was handed back or a worker failed
+    chunk *chunks; // Every chunk
+    chunk **queue; // Ring of filled chunks waiting for a worker
+    size_t head, pending; // First queued chunk and number queued
+    chunk **idle; // Chunks free to read into
+    size_t idle_count;
+    size_t chunk_count; // Size of `chunks`, `queue` and `idle`
+    int finished; // No more chunks will be queued
+    int error; // errno of the first failure, 0 while all is well
+    spill *spills[FIELDS]; // Runs of each field on disk
+    size_t spill_count[FIELDS], spill_capacity[FIELDS];
+} ingest_job;
+
+// One parsing thread and its run buffers
+typedef struct {
+    ingest_job *job;
+    pthread_t thread;
+    run_buffer runs[FIELDS]; // Usernames, passwords and pairs parsed since the last spill
+    size_t limit; // Records per buffer before it is spilled
+    unsigned long long lines, skipped; // Counted here, summed after the join
+} ingest_worker;
+
+// Record the first failure and wake everyone so they stop
+static void fail(ingest_job *job, int error) {
+    pthread_mutex_lock(&job->lock);
+    if (!job->error) {
+        job->error = error ? error : EIO;
+    }
+    pthread_cond_broadcast(&job->queued);
+    pthread_cond_broadcast(&job->freed);
+    pthread_mutex_unlock(&job->lock);
+}
+
+// Wait for a free chunk, NULL if a worker failed
+static chunk *take_idle(ingest_job *job) {
+    pthread_mutex_lock(&job->lock);
+    while (job->idle_count == 0 && !job->error) {
+        pthread_cond_wait(&job->freed, &job->lock);
+    }
+    chunk *c = job->error ? NULL : job->idle[--job->idle_count];
+    pthread_mutex_unlock(&job->lock);
+    if (c) {
+        c->len = 0;
+    }
+    return c;
+}
+
+static void give_idle(ingest_job *job, chunk *c) {
+    pthread_mutex_lock(&job->lock);
+    job->idle[job->idle_count++] = c;
+    pthread_cond_signal(&job->freed);
+    pthread_mutex_unlock(&job->lock);
+}
+
+static void submit(ingest_job *job, chunk *c) {
+    pthread_mutex_lock(&job->lock);
+    job->queue[(job->head + job->pending++) % job->chunk_count] = c;
+    pthread_cond_signal(&job->queued);
+    pthread_mutex_unlock(&job->lock);
+}
+
+// Next filled chunk, NULL once the input is exhausted or a worker failed
+static chunk *next_chunk(ingest_job *job) {
+    pthread_mutex_lock(&job->lock);
+    while (job->pending == 0 && !job->finished && !job->error) {
+        pthread_cond_wait(&job->queued, &job->lock);
+    }
+    chunk *c = NULL;
+    if (job->pending > 0 && !job->error) {
+        c = job->queue[job->head];
+        job->head = (job->head + 1) % job->chunk_count;
+        job->pending--;
+    }
+    pthread_mutex_unlock(&job->lock);
+    return c;
+}
+
+static int link_compare(const void *a, const void *b) {
+    return memcmp(a, b, LINK_SIZE);
+}
+
+// Sort and de-duplicate `count` records of `field` in place, returns the distinct count.
+// A username or password record repeats only where its whole line does, so what is left
+// of a digest's records is one per distinct line holding it
+static size_t sort_unique(int field, uint8_t *records, size_t count) {
+    if (field == PAIRS) {
+        return pair_sort_unique((void *)records, count);
+    }
+    if (count == 0) {
+        return 0;
+    }
+    qsort(records, count, LINK_SIZE, link_compare);
+    size_t unique = 1;
+    for (size_t i = 1; i < count; i++) {
+        if (memcmp(records + i * LINK_SIZE, records + (unique - 1) * LINK_SIZE, LINK_SIZE) != 0) {
+            memcpy(records + unique++ * LINK_SIZE, records + i * LINK_SIZE, LINK_SIZE);
+        }
+    }
+    return unique;
+}
+
+// Sort and de-duplicate one full buffer and write it to a new run file
+static int spill_run(ingest_worker *w, int field) {
+    ingest_job *job = w->job;
+    run_buffer *run = &w->runs[field];
+    size_t count = sort_unique(field, run->records, run->count);
+    run->count = 0;
+
+    char path[4096];
+    if (snprintf(path, sizeof(path), "%s/ingest-XXXXXX", job->options->tmpdir) >= (int)sizeof(path)) {
+        errno = ENAMETOOLONG;
+        return -1;
+    }
+    int fd = mkstemp(path);
+    if (fd < 0) {
+        return -1;
+    }
+    unlink(path); // Removed by the kernel when closed, even if we crash
+    FILE *file = fdopen(fd, "w+b");
+    if (!file) {
+        close(fd);
+        return -1;
+    }
+    if (fwrite(run->records, field_width[field], count, file) != count || fflush(file) != 0) {
+        fclose(file);
+        return -1;
+    }
+
+    pthread_mutex_lock(&job->lock);
+    if (job->spill_count[field] == job->spill_capacity[field]) {
+        size_t capacity = job->spill_capacity[field] ? job->spill_capacity[field] * 2 : 16;
+        spill *grown = realloc(job->spills[field], capacity * sizeof(*grown));
+        if (!grown) {
+            pthread_mutex_unlock(&job->lock);
+            fclose(file);
+            return -1;
+        }
+        job->spills[field] = grown;
+        job->spill_capacity[field] = capacity;
+    }
+    job->spills[field][job->spill_count[field]++] = (spill){file, count};
+    pthread_mutex_unlock(&job->lock);
+    return 0;
+}
+
+// Buffer one record of `field`, spilling a full buffer first
+static int buffer_record(ingest_worker *w, int field, const uint8_t *record) {
+    run_buffer *run = &w->runs[field];
+    if (run->count == w->limit && spill_run(w, field) != 0) {
+        return -1;
+    }
+    memcpy(run->records + run->count++ * field_width[field], record, field_width[field]);
+    return 0;
+}
+
+// Buffer one line's username and password digests and pair fingerprint, each if this shard keeps it
+static int keep(ingest_worker *w, const uint8_t username[SHA256_DIGEST_SIZE],
+                const uint8_t password[SHA256_DIGEST_SIZE]) {
+    const ingest_options *options = w->job->options;
+    uint64_t key = pair_fingerprint(username, password);
+    uint8_t links[2][LINK_SIZE]; // Each digest followed by the pair, stored big-endian like pair_set
+    const uint8_t *pair = links[0] + SHA256_DIGEST_SIZE;
+    for (int f = 0; f < 2; f++) {
+        memcpy(links[f], f == 0 ? username : password, SHA256_DIGEST_SIZE);
+        for (int i = 0; i < PAIR_KEY_SIZE; i++) {
+            links[f][SHA256_DIGEST_SIZE + i] = (uint8_t)(key >> (56 - i * 8));
+        }
+    }
+    if ((!options->map || shard_owner(options->map, username) == options->shard) &&
+        buffer_record(w, 0, links[0]) != 0) {
+        return -1;
+    }
+    if ((!options->map || shard_owner(options->map, password) == options->shard) &&
+        buffer_record(w, 1, links[1]) != 0) {
+        return -1;
+    }
+    if ((!options->map || shard_owner_key(options->map, key) == options->shard) &&
+        buffer_record(w, PAIRS, pair) != 0) {
+        return -1;
+    }
+    return 0;
+}
+
+// Hash `count` plain lines, usernames at even and passwords at odd positions of `msgs`
+static int hash_plain(ingest_worker *w, const uint8_t **msgs, const size_t *lens, size_t count) {
+    uint8_t digests[PLAIN_BATCH * 2][SHA256_DIGEST_SIZE];
+    sha256_batch(msgs, lens, count * 2, digests);
+    for (size_t i = 0; i < count; i++) {
+        if (keep(w, digests[i * 2], digests[i * 2 + 1]) != 0) {
+            return -1;
+        }
+    }
+    return 0;
+}
+
+static int parse_chunk(ingest_worker *w, const chunk *c) {
+    const uint8_t *msgs[PLAIN_BATCH * 2];
+    size_t lens[PLAIN_BATCH * 2];
+    size_t batched = 0; // Plain lines waiting in msgs/lens
+    const char *pos = c->data, *end = c->data + c->len;
+    while (pos < end) {
+        const char *line = pos;
+        const char *nl = memchr(line, '\n', end - line);
+        size_t len = nl ? (size_t)(nl - line) : (size_t)(end - line);
+        pos = nl ? nl + 1 : end;
+        if (len > 0 && line[len - 1] == '\r') {
+            len--;
+        }
+        if (len == 0) {
+            continue; // Blank line
+        }
+        w->lines++;
+
+        if (w->job->options->plain) {
+            const char *colon = memchr(line, ':', len); // Passwords may contain ':', usernames may not
+            if (!colon) {
+                w->skipped++;
+                continue;
+            }
+            msgs[batched * 2] = (const uint8_t *)line;
+            lens[batched * 2] = colon - line;
+            msgs[batched * 2 + 1] = (const uint8_t *)colon + 1;
+            lens[batched * 2 + 1] = len - (colon - line) - 1;
+            if (++batched == PLAIN_BATCH) {
+                if (hash_plain(w, msgs, lens, batched) != 0) {
+                    return -1;
+                }
+                batched = 0;
+            }
+            continue;
+        }
+
+        uint8_t username[SHA256_DIGEST_SIZE], password[SHA256_DIGEST_SIZE];
+        if (len != SHA256_HEX_SIZE * 2 + 1 || line[SHA256_HEX_SIZE] != ':' ||
+            hex_to_digest(line, username) != 0 || hex_to_digest(line + SHA256_HEX_SIZE + 1, password) != 0) {
+            w->skipped++;
+            continue;
+        }
+        if (keep(w, username, password) != 0) {
+            return -1;
+        }
+    }
+    return batched ? hash_plain(w, msgs, lens, batched) : 0;
+}
+
+static void *ingest_loop(void *arg) {
+    ingest_worker *w = arg;
+    chunk *c;
+    while ((c = next_chunk(w->job))) {
+        if (parse_chunk(w, c) != 0) {
+            fail(w->job, errno);
+        }
+        give_idle(w->job, c);
+    }
+    return NULL;
+}
+
+// Queue one input file chunk by chunk, carrying each partial last line into the next chunk
+static int read_input(ingest_job *job, const char *filename, ingest_totals *totals) {
+    int fd = open(filename, O_RDONLY);
+    if (fd < 0) {
+        return -1;
+    }
+    posix_fadvise(fd, 0, 0, POSIX_FADV_SEQUENTIAL); // Larger readahead
+    chunk *c = take_idle(job);
+    while (c) {
+        ssize_t n = read(fd, c->data + c->len, INGEST_CHUNK_SIZE - c->len);
+        if (n < 0 && errno == EINTR) {
+            continue;
+        }
+        if (n < 0) {
+            int saved = errno;
+            give_idle(job, c);
+            close(fd);
+            errno = saved;
+            return -1;
+        }
+        if (n == 0) {
+            break; // End of file
+        }
+        totals->bytes += n;
+        c->len += n;
+        if (c->len < INGEST_CHUNK_SIZE) {
+            continue;
+        }
+
+        chunk *next = take_idle(job);
+        if (!next) {
+            give_idle(job, c);
+            c = NULL;
+            break;
+        }
+        size_t cut = c->len; // A line longer than a whole chunk is split and skipped as malformed
+        while (cut > 0 && c->data[cut - 1] != '\n') {
+            cut--;
+        }
+        if (cut == 0) {
+            cut = c->len;
+        }
+        next->len = c->len - cut;
+        memcpy(next->data, c->data + cut, next->len);
+        c->len = cut;
+        submit(job, c);
+        c = next;
+    }
+    close(fd);
+    if (!c) {
+        errno = job->error; // A worker failed
+        return -1;
+    }
+    if (c->len > 0) {
+        submit(job, c); // Last line may lack its newline
+    } else {
+        give_idle(job, c);
+    }
+    return 0;
+}
+
+// One sorted run being merged: a worker's last buffer or a file read MERGE_BUFFER at a time
+typedef struct {
+    const uint8_t *records; // Buffered records
+    size_t width; // Bytes per record
+    size_t pos, count; // Next buffered record and number buffered
+    FILE *file; // NULL for an in-memory run
+    uint8_t *buffer; // Read buffer of a file run
+    size_t left; // Records of the file not read yet
+} merge_source;
+
+// Make sure the source has a current digest, 0 once it is exhausted
+static int source_ready(merge_source *s) {
+    if (s->pos < s->count) {
+        return 1;
+    }
+    if (!s->file || s->left == 0) {
+        return 0;
+    }
+    size_t n = s->left < MERGE_BUFFER ? s->left : MERGE_BUFFER;
+    if (fread(s->buffer, s->width, n, s->file) != n) {
+        errno = ferror(s->file) ? EIO : EINVAL; // Run file shorter than written
+        return -1;
+    }
+    s->records = s->buffer;
+    s->pos = 0;
+    s->count = n;
+    s->left -= n;
+    return 1;
+}
+
+static inline const uint8_t *source_head(const merge_source *s) {
+    return s->records + s->pos * s->width;
+}
+
+// Restore the min-heap order of `heap` (indices into `sources`) below position i
+static void sift_down(size_t *heap, size_t size, const merge_source *sources, size_t i) {
+    while (1) {
+        size_t smallest = i, left = 2 * i + 1, right = left + 1;
+        if (left < size && memcmp(source_head(&sources[heap[left]]), source_head(&sources[heap[smallest]]),
+                                  sources->width) < 0) {
+            smallest = left;
+        }
+        if (right < size && memcmp(source_head(&sources[heap[right]]), source_head(&sources[heap[smallest]]),
+                                   sources->width) < 0) {
+            smallest = right;
+        }
+        if (smallest == i) {
+            return;
+        }
+        size_t tmp = heap[i];
+        heap[i] = heap[smallest];
+        heap[smallest] = tmp;
+        i = smallest;
+    }
+}
+
+// Merged output of one field on its way to the writer
+typedef struct {
+    cred_index_writer *writer;
+    int field;
+    uint8_t *records; // MERGE_BUFFER digests or pair fingerprints
+    uint8_t (*refs)[DIGEST_REF_SIZE]; // Line count of each buffered digest
+    size_t count; // Records buffered
+} merge_output;
+
+// Hand the buffered records to the writer
+static int put_records(merge_output *out) {
+    size_t count = out->count;
+    out->count = 0;
+    if (out->field == PAIRS) {
+        return cred_index_writer_put_pairs(out->writer, (const void *)out->records, count);
+    }
+    return cred_index_writer_put(out->writer, out->field, (const void *)out->records, (const void *)out->refs, count);
+}
+
+// Buffer one distinct digest held by `lines` lines, or one pair fingerprint
+static int emit(merge_output *out, const uint8_t *record, uint64_t lines) {
+    if (out->field == PAIRS) {
+        memcpy(out->records + out->count * PAIR_KEY_SIZE, record, PAIR_KEY_SIZE);
+    } else {
+        memcpy(out->records + out->count * SHA256_DIGEST_SIZE, record, SHA256_DIGEST_SIZE);
+        if (lines > UINT32_MAX) {
+            lines = UINT32_MAX;
+        }
+        for (int i = 0; i < DIGEST_REF_SIZE; i++) {
+            out->refs[out->count][i] = (uint8_t)(lines >> (24 - i * 8));
+        }
+    }
+    return ++out->count == MERGE_BUFFER ? put_records(out) : 0;
+}
+
+// Merge every run of one field into the writer, dropping duplicates across runs and
+// counting the distinct lines behind each username or password digest
+static int merge_field(ingest_job *job, ingest_worker *workers, int field, cred_index_writer *writer,
+                       unsigned long long *unique) {
+    int threads = job->options->threads;
+    size_t width = field_width[field];
+    size_t total = threads + job->spill_count[field];
+    merge_source *sources = calloc(total, sizeof(*sources));
+    size_t *heap = malloc(total * sizeof(*heap));
+    merge_output out = {writer, field, malloc(MERGE_BUFFER * SHA256_DIGEST_SIZE),
+                        malloc(MERGE_BUFFER * DIGEST_REF_SIZE), 0};
+    int result = -1;
+    if (!sources || !heap || !out.records || !out.refs) {
+        goto done;
+    }
+    for (int t = 0; t < threads; t++) {
+        run_buffer *run = &workers[t].runs[field];
+        sources[t].records = run->records;
+        sources[t].width = width;
+        sources[t].count = sort_unique(field, run->records, run->count);
+    }
+    for (size_t r = 0; r < job->spill_count[field]; r++) {
+        merge_source *s = &sources[threads + r];
+        s->width = width;
+        s->file = job->spills[field][r].file;
+        s->left = job->spills[field][r].count;
+        s->buffer = malloc(MERGE_BUFFER * width);
+        if (!s->buffer || fseek(s->file, 0, SEEK_SET) != 0) {
+            goto done;
+        }
+    }
+
+    size_t size = 0;
+    for (size_t i = 0; i < total; i++) {
+        int ready = source_ready(&sources[i]);
+        if (ready < 0) {
+            goto done;
+        }
+        if (ready) {
+            heap[size++] = i;
+        }
+    }
+    for (size_t i = size / 2; i-- > 0;) {
+        sift_down(heap, size, sources, i);
+    }
+
+    uint8_t last[LINK_SIZE]; // Last record taken, valid once `lines` > 0
+    uint64_t lines = 0; // Distinct lines seen holding the digest of `last`
+    size_t key_width = field == PAIRS ? PAIR_KEY_SIZE : SHA256_DIGEST_SIZE; // Bytes written per record
+    while (size > 0) {
+        merge_source *s = &sources[heap[0]];
+        const uint8_t *next = source_head(s);
+        if (lines == 0 || memcmp(next, last, width) != 0) { // Not the same line again
+            if (lines > 0 && memcmp(next, last, key_width) == 0) {
+                lines++; // Same digest on another line
+            } else {
+                if (lines > 0 && emit(&out, last, lines) != 0) {
+                    goto done;
+                }
+                lines = 1;
+                (*unique)++;
+            }
+            memcpy(last, next, width);
+        }
+        s->pos++;
+        int ready = source_ready(s);
+        if (ready < 0) {
+            goto done;
+        }
+        if (!ready) {
+            heap[0] = heap[--size];
+        }
+        sift_down(heap, size, sources, 0);
+    }
+    if (lines > 0 && emit(&out, last, lines) != 0) {
+        goto done;
+    }
+    // Pairs are put even if there are none, so the file records that they were indexed
+    result = out.count || field == PAIRS ? put_records(&out) : 0;
+
+done:
+    if (sources) {
+        int saved = errno;
+        for (size_t r = 0; r < job->spill_count[field]; r++) {
+            free(sources[threads + r].buffer);
+        }
+        errno = saved;
+    }
+    free(sources);
+    free(heap);
+    free(out.records);
+    free(out.refs);
+    return result;
+}
+
+int ingest_files(const char *const *inputs, int count, const char *output,
+                 const ingest_options *options, ingest_totals *totals) {
+    ingest_job job = {.options = options};
+    int threads = options->threads;
+    memset(totals, 0, sizeof(*totals));
+    pthread_mutex_init(&job.lock, NULL);
+    pthread_cond_init(&job.queued, NULL);
+    pthread_cond_init(&job.freed, NULL);
+
+    int result = -1, started = 0;
+    job.chunk_count = threads * CHUNKS_PER_WORKER + 1;
+    job.chunks = calloc(job.chunk_count, sizeof(*job.chunks));
+    job.queue = calloc(job.chunk_count, sizeof(*job.queue));
+    job.idle = calloc(job.chunk_count, sizeof(*job.idle));
+    ingest_worker *workers = calloc(threads, sizeof(*workers));
+    if (!job.chunks || !job.queue || !job.idle || !workers) {
+        goto done;
+    }
+    for (size_t i = 0; i < job.chunk_count; i++) {
+        if (!(job.chunks[i].data = malloc(INGEST_CHUNK_SIZE))) {
+            goto done;
+        }
+        job.idle[job.idle_count++] = &job.chunks[i];
+    }
+
+    size_t line_bytes = 0; // Every line adds at most one record to each buffer
+    for (int f = 0; f < FIELDS; f++) {
+        line_bytes += field_width[f];
+    }
+    size_t limit = options->memory / line_bytes / threads;
+    if (limit < MIN_RUN) {
+        limit = MIN_RUN;
+    }
+    for (int t = 0; t < threads; t++) {
+        workers[t].job = &job;
+        workers[t].limit = limit;
+        for (int f = 0; f < FIELDS; f++) {
+            if (!(workers[t].runs[f].records = malloc(limit * field_width[f]))) {
+                goto done;
+            }
+        }
+    }
+    for (; started < threads; started++) {
+        if (pthread_create(&workers[started].thread, NULL, ingest_loop, &workers[started]) != 0) {
+            fail(&job, EAGAIN);
+            break;
+        }
+    }
+
+    for (int i = 0; i < count && started == threads; i++) {
+        if (read_input(&job, inputs[i], totals) != 0) {
+            pthread_mutex_lock(&job.lock);
+            int worker_failed = job.error != 0;
+            pthread_mutex_unlock(&job.lock);
+            if (!worker_failed) {
+                fprintf(stderr, "Failed to read %s: %s\n", inputs[i], strerror(errno));
+            }
+            fail(&job, errno);
+            break;
+        }
+    }
+    pthread_mutex_lock(&job.lock);
+    job.finished = 1;
+    pthread_cond_broadcast(&job.queued);
+    pthread_mutex_unlock(&job.lock);
+    for (int t = 0; t < started; t++) {
+        pthread_join(workers[t].thread, NULL);
+        totals->lines += workers[t].lines;
+        totals->skipped += workers[t].skipped;
+    }
+    totals->runs = job.spill_count[0] + job.spill_count[1] + job.spill_count[PAIRS];
+    if (job.error) {
+        errno = job.error;
+        goto done;
+    }
+
+    cred_index_writer writer;
+    if (cred_index_writer_open(&writer, output) != 0) {
+        goto done;
+    }
+    if (merge_field(&job, workers, 0, &writer, &totals->unique[0]) != 0 ||
+        merge_field(&job, workers, 1, &writer, &totals->unique[1]) != 0 ||
+        merge_field(&job, workers, PAIRS, &writer, &totals->unique[PAIRS]) != 0) {
+        cred_index_writer_abort(&writer);
+        goto done;
+    }
+    result = cred_index_writer_close(&writer);
+
+done:;
+    int saved = errno;
+    for (int f = 0; f < FIELDS; f++) {
+        for (size_t r = 0; r < job.spill_count[f]; r++) {
+            fclose(job.spills[f][r].file);
+        }
+        free(job.spills[f]);
+    }
+    for (int t = 0; workers && t < threads; t++) {
+        for (int f = 0; f < FIELDS; f++) {
+            free(workers[t].runs[f].records);
+        }
+    }
+    for (size_t i = 0; job.chunks && i < job.chunk_count; i++) {
+        free(job.chunks[i].data);
+    }
+    free(workers);
+    free(job.chunks);
+    free(job.queue);
+    free(job.idle);
+    pthread_cond_destroy(&job.queued);
+    pthread_cond_destroy(&job.freed);
+    pthread_mutex_destroy(&job.lock);
+    errno = saved;
+    return result;
+}
@@ -0,0 +1,46 @@
+// ingest.h
+// Builds an index file from credential dumps larger than memory. One thread reads the
+// inputs in large chunks (cut at line ends) and hands them to worker threads that
+// parse them, hashing plain "user:password" lines with sha256_batch or decoding
+// "<64 hex>:<64 hex>" lines, into per-worker buffers of each field: usernames and
+// passwords, each followed by its line's pair fingerprint (pair.h), and the pair
+// fingerprints alone. A full buffer is sorted, de-duplicated and written to an
+// unlinked temporary file as a sorted run. Finally every run of a field, on disk or
+// still in memory, is merged in one pass through a heap, dropping duplicates across
+// runs and counting the distinct lines behind each digest, straight into a
+// cred_index_writer, so memory stays within the configured budget whatever the input
+// size.
+
+#ifndef _INGEST_H_
+#define _INGEST_H_
+
+#include <stddef.h>
+#include "shard.h"
+
+#define INGEST_CHUNK_SIZE (8 << 20) // Bytes read from an input at a time
+#define INGEST_DEFAULT_MEMORY ((size_t)1 << 30) // Digest buffer budget when none is given
+
+// How to read the inputs and where to spill
+typedef struct {
+    int plain; // Lines are clear-text "user:password" rather than hex digests
+    int threads; // Parsing and hashing workers
+    size_t memory; // Bytes of digests and pairs buffered across all workers before spilling a run
+    const char *tmpdir; // Directory for run files
+    const shard_map *map; // Keep only digests and pairs `shard` owns, NULL for all
+    int shard; // Shard of `map` to keep
+} ingest_options;
+
+// Totals reported after an ingest
+typedef struct {
+    unsigned long long bytes; // Input bytes read
+    unsigned long long lines; // Non-blank lines seen
+    unsigned long long skipped; // Lines that did not parse
+    unsigned long long runs; // Sorted runs spilled to disk
+    unsigned long long unique[3]; // Distinct usernames, passwords and pairs written
+} ingest_totals;
+
+// Parse `count` input files into the index file `output`, 0 on success
+int ingest_files(const char *const *inputs, int count, const char *output,
+                 const ingest_options *options, ingest_totals *totals);
+
+#endif
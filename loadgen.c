@@ -0,0 +1,409 @@
+// loadgen.c
+// Load generator for the server. Threads each drive a share of the connections with
+// their own epoll set and send single-digest CHECK_BATCH frames, drawing hits from a
+// credentials file and misses from random digests. Closed-loop mode keeps a fixed
+// number of requests outstanding per connection; open-loop mode sends at a fixed
+// total rate regardless of replies and measures latency from each request's scheduled
+// time, so a stalled server shows up as queueing delay instead of a lower send rate.
+// With -x each connection is a shared-memory session (shm.h) instead of a socket.
+#define _GNU_SOURCE // epoll_pwait2
+#include <stdio.h> // Standard I/O library
+#include <stdlib.h> // Standard library for memory allocation, process control, etc.
+#include <string.h> // String handling functions
+#include <errno.h> // Error codes
+#include <time.h> // Monotonic clock
+#include <unistd.h> // POSIX API for Unix-like systems
+#include <pthread.h> // Worker threads
+#include <sys/epoll.h> // Event loop
+#include <sys/socket.h> // Socket API
+#include "cred_index.h" // Credentials file for hits
+#include "protocol.h" // Binary frames and byte_buf
+#include "histogram.h" // Latency percentiles
+#include "net.h" // Connection setup
+#include "shm.h" // Shared-memory sessions
+
+#define MAX_INFLIGHT 1024 // Outstanding requests tracked per connection
+#define MAX_EVENTS 64 // Events handled per epoll_wait call
+#define READ_CHUNK 16384 // Bytes read per recv call
+
+// One connection and the send times of its unanswered requests, oldest first
+typedef struct {
+    int fd; // Connected socket, or the session's eventfd with -x
+    int shared; // Shared-memory session in `shm`
+    shm_channel shm;
+    byte_buf in; // Reply bytes not yet parsed
+    byte_buf out; // Request bytes the socket has not accepted yet
+    uint64_t sent_at[MAX_INFLIGHT]; // Scheduled send time of each outstanding request (ns)
+    uint32_t head, tail; // Ring of outstanding requests
+} lg_conn;
+
+// Settings shared by every thread
+typedef struct {
+    const char *host; // Host name or Unix socket path; the attach socket with -x
+    int port;
+    int shared; // Shared-memory transport instead of sockets
+    int connections; // Total connections
+    int threads; // Event-loop threads
+    int depth; // Closed loop: requests outstanding per connection
+    double rate; // Open loop: total requests per second, 0 for closed loop
+    double duration; // Seconds to run
+    double hit_ratio; // Fraction of requests for stored digests
+    const cred_index *index; // Source of hits
+} lg_config;
+
+// Per-thread state and results
+typedef struct {
+    const lg_config *cfg;
+    int conn_count; // This thread's share of the connections
+    lg_conn *conns;
+    int epoll_fd;
+    uint64_t rng; // xorshift state
+    histogram latency; // Nanoseconds from scheduled send to reply
+    uint64_t sent, received, found, errors, overflow; // Counters
+    pthread_t thread;
+} lg_worker;
+
+static uint64_t now_ns(void) {
+    struct timespec ts;
+    clock_gettime(CLOCK_MONOTONIC, &ts);
+    return (uint64_t)ts.tv_sec * 1000000000ULL + ts.tv_nsec;
+}
+
+static uint64_t next_random(lg_worker *w) {
+    w->rng ^= w->rng << 13;
+    w->rng ^= w->rng >> 7;
+    w->rng ^= w->rng << 17;
+    return w->rng;
+}
+
+static int flush_conn(lg_conn *c);
+
+// Queue one request on a connection, -1 if the connection must be dropped
+static int send_request(lg_worker *w, lg_conn *c, uint64_t scheduled) {
+    if (c->tail - c->head == MAX_INFLIGHT) {
+        w->overflow++; // Server is too far behind on this connection
+        return 0;
+    }
+
+    uint8_t frame[BIN_HEADER_SIZE + SHA256_DIGEST_SIZE];
+    const cred_index *index = w->cfg->index;
+    int password = next_random(w) & 1; // Alternate fields at random
+    const digest_set *set = password ? &index->passwords : &index->usernames;
+    uint8_t *digest = frame + BIN_HEADER_SIZE;
+    if (set->count > 0 && (next_random(w) % 1000000) < w->cfg->hit_ratio * 1000000) {
+        memcpy(digest, set->digests[next_random(w) % set->count], SHA256_DIGEST_SIZE); // Hit
+    } else {
+        for (int i = 0; i < SHA256_DIGEST_SIZE; i += 8) { // Miss, with overwhelming probability
+            uint64_t r = next_random(w);
+            memcpy(digest + i, &r, 8);
+        }
+    }
+    bin_header hdr = {BIN_VERSION, BIN_OP_CHECK_BATCH, password ? BIN_FIELD_PASSWORD : BIN_FIELD_USERNAME,
+                      c->tail, 1, SHA256_DIGEST_SIZE};
+    bin_header_encode(&hdr, frame);
+
+    c->sent_at[c->tail++ % MAX_INFLIGHT] = scheduled;
+    w->sent++;
+    if (byte_buf_append(&c->out, frame, sizeof(frame)) != 0) {
+        return -1;
+    }
+    return flush_conn(c);
+}
+
+// Send queued request bytes until the socket is full, -1 on error
+static int flush_conn(lg_conn *c) {
+    if (c->shared) {
+        ssize_t n = shm_write(&c->shm, c->out.data + c->out.off, byte_buf_pending(&c->out));
+        if (n < 0) {
+            return -1; // Corrupt ring
+        }
+        byte_buf_consume(&c->out, n);
+        return 0; // The rest goes when the server frees space
+    }
+    while (byte_buf_pending(&c->out) > 0) {
+        ssize_t n = send(c->fd, c->out.data + c->out.off, byte_buf_pending(&c->out), MSG_NOSIGNAL);
+        if (n > 0) {
+            byte_buf_consume(&c->out, n);
+        } else if (n < 0 && errno == EINTR) {
+            continue;
+        } else if (n < 0 && (errno == EAGAIN || errno == EWOULDBLOCK)) {
+            break; // Retried on the next send
+        } else {
+            return -1;
+        }
+    }
+    return 0;
+}
+
+static void drop_conn(lg_worker *w, lg_conn *c) {
+    epoll_ctl(w->epoll_fd, EPOLL_CTL_DEL, c->fd, NULL);
+    if (c->shared) {
+        shm_close(&c->shm); // Closes the eventfd too
+    } else {
+        close(c->fd);
+    }
+    c->fd = -1;
+    w->errors++;
+}
+
+// Read replies, record their latency and, in closed loop, send replacements
+static void service_conn(lg_worker *w, lg_conn *c) {
+    char chunk[READ_CHUNK];
+    if (c->shared) {
+        shm_wait_done(&c->shm); // Reset the eventfd before draining the ring
+    }
+    while (1) {
+        ssize_t n = c->shared ? shm_read(&c->shm, chunk, sizeof(chunk)) : recv(c->fd, chunk, sizeof(chunk), 0);
+        if (n == 0 && c->shared) {
+            break; // Ring drained
+        }
+        if (n > 0) {
+            if (byte_buf_append(&c->in, chunk, n) != 0) {
+                drop_conn(w, c);
+                return;
+            }
+        } else if (n < 0 && errno == EINTR) {
+            continue;
+        } else if (n < 0 && (errno == EAGAIN || errno == EWOULDBLOCK)) {
+            break;
+        } else {
+            drop_conn(w, c); // Server closed the connection
+            return;
+        }
+    }
+
+    uint64_t now = now_ns();
+    while (byte_buf_pending(&c->in) >= BIN_HEADER_SIZE) {
+        bin_header hdr;
+        const uint8_t *raw = (const uint8_t *)c->in.data + c->in.off;
+        if (bin_header_decode(raw, &hdr) != 0) {
+            drop_conn(w, c); // Not a binary reply
+            return;
+        }
+        if (byte_buf_pending(&c->in) < BIN_HEADER_SIZE + (size_t)hdr.length) {
+            break;
+        }
+        if (c->head == c->tail) {
+            drop_conn(w, c); // Reply without a request
+            return;
+        }
+        hist_record(&w->latency, now - c->sent_at[c->head++ % MAX_INFLIGHT]);
+        w->received++;
+        if (hdr.field != BIN_STATUS_OK) {
+            w->errors++;
+        } else if (hdr.length > 0 && (raw[BIN_HEADER_SIZE] & 1)) {
+            w->found++;
+        }
+        byte_buf_consume(&c->in, BIN_HEADER_SIZE + hdr.length);
+        if (w->cfg->rate == 0 && send_request(w, c, now_ns()) != 0) {
+            drop_conn(w, c);
+            return;
+        }
+    }
+    if (flush_conn(c) != 0) { // Retry anything the socket refused earlier
+        drop_conn(w, c);
+    }
+}
+
+static void *lg_loop(void *arg) {
+    lg_worker *w = arg;
+    const lg_config *cfg = w->cfg;
+    struct epoll_event events[MAX_EVENTS];
+
+    uint64_t start = now_ns();
+    uint64_t end = start + (uint64_t)(cfg->duration * 1e9);
+    double thread_rate = cfg->rate * w->conn_count / cfg->connections; // This thread's share
+    uint64_t interval = thread_rate > 0 ? (uint64_t)(1e9 / thread_rate) : 0;
+    uint64_t next_send = start; // Open loop: scheduled time of the next request
+    int rr = 0; // Open loop: next connection to use
+
+    if (cfg->rate == 0) { // Closed loop: fill every connection's window
+        for (int i = 0; i < w->conn_count; i++) {
+            for (int d = 0; d < cfg->depth; d++) {
+                if (w->conns[i].fd >= 0 && send_request(w, &w->conns[i], start) != 0) {
+                    drop_conn(w, &w->conns[i]);
+                }
+            }
+        }
+    }
+
+    while (1) {
+        uint64_t now = now_ns();
+        if (now >= end) {
+            break;
+        }
+        while (interval && next_send <= now) { // Open loop: send everything that is due
+            for (int tries = 0; tries < w->conn_count; tries++) {
+                lg_conn *c = &w->conns[rr++ % w->conn_count];
+                if (c->fd >= 0) {
+                    if (send_request(w, c, next_send) != 0) {
+                        drop_conn(w, c);
+                    }
+                    break;
+                }
+            }
+            next_send += interval;
+        }
+
+        // Sleep until the next scheduled send or the end, with nanosecond precision so the
+        // open-loop schedule is kept without spinning
+        uint64_t wake = interval && next_send < end ? next_send : end;
+        int ready = 0; // Shared-memory sessions with replies already waiting
+        for (int i = 0; i < w->conn_count; i++) {
+            lg_conn *c = &w->conns[i];
+            if (c->shared && c->fd >= 0 && shm_wait_prepare(&c->shm, byte_buf_pending(&c->out) > 0)) {
+                ready = 1;
+            }
+        }
+        if (ready) {
+            wake = now; // Do not sleep, service them below
+        }
+        struct timespec timeout = {(wake - now) / 1000000000ULL, (wake - now) % 1000000000ULL};
+        int n = epoll_pwait2(w->epoll_fd, events, MAX_EVENTS, &timeout, NULL);
+        if (n < 0 && errno != EINTR) {
+            perror("epoll_wait");
+            break;
+        }
+        for (int i = 0; i < n; i++) {
+            lg_conn *c = events[i].data.ptr;
+            if (c->fd >= 0) {
+                service_conn(w, c);
+            }
+        }
+        for (int i = 0; ready && i < w->conn_count; i++) {
+            if (w->conns[i].shared && w->conns[i].fd >= 0) {
+                service_conn(w, &w->conns[i]);
+            }
+        }
+    }
+    return NULL;
+}
+
+// Open this worker's connections and register them, -1 if none could be opened
+static int lg_connect(lg_worker *w) {
+    w->epoll_fd = epoll_create1(EPOLL_CLOEXEC);
+    w->conns = calloc(w->conn_count, sizeof(*w->conns));
+    if (w->epoll_fd < 0 || !w->conns) {
+        return -1;
+    }
+    for (int i = 0; i < w->conn_count; i++) {
+        lg_conn *c = &w->conns[i];
+        if (w->cfg->shared) {
+            if (shm_attach(&c->shm, w->cfg->host) != 0) {
+                return -1;
+            }
+            c->shared = 1;
+            c->fd = c->shm.wake_fd; // Signalled when the server moves data
+        } else {
+            c->fd = net_connect(w->cfg->host, w->cfg->port);
+            if (c->fd < 0 || set_nonblocking(c->fd) != 0) {
+                return -1;
+            }
+        }
+        struct epoll_event ev;
+        ev.events = EPOLLIN; // Level-triggered, replies are drained each wakeup
+        ev.data.ptr = c;
+        if (epoll_ctl(w->epoll_fd, EPOLL_CTL_ADD, c->fd, &ev) < 0) {
+            return -1;
+        }
+    }
+    return 0;
+}
+
+static void usage(const char *prog) {
+    fprintf(stderr, "Usage: %s [-c connections] [-t threads] [-d seconds] [-r rate | -p depth] "
+                    "[-h hit_ratio] <host> <port> <credentials_file>\n"
+                    "       %s -x [options] <shm_socket> 0 <credentials_file>\n", prog, prog);
+    exit(EXIT_FAILURE);
+}
+
+int main(int argc, char *argv[]) {
+    lg_config cfg = {NULL, 0, 0, 16, 1, 1, 0, 10, 0.5, NULL};
+    int opt;
+    while ((opt = getopt(argc, argv, "c:t:d:r:p:h:x")) != -1) { // Parse optional flags
+        if (opt == 'c' && atoi(optarg) > 0) {
+            cfg.connections = atoi(optarg);
+        } else if (opt == 't' && atoi(optarg) > 0) {
+            cfg.threads = atoi(optarg);
+        } else if (opt == 'd' && atof(optarg) > 0) {
+            cfg.duration = atof(optarg);
+        } else if (opt == 'r' && atof(optarg) > 0) {
+            cfg.rate = atof(optarg);
+        } else if (opt == 'p' && atoi(optarg) > 0 && atoi(optarg) <= MAX_INFLIGHT) {
+            cfg.depth = atoi(optarg);
+        } else if (opt == 'h' && atof(optarg) >= 0 && atof(optarg) <= 1) {
+            cfg.hit_ratio = atof(optarg);
+        } else if (opt == 'x') {
+            cfg.shared = 1;
+        } else {
+            usage(argv[0]);
+        }
+    }
+    if (argc - optind != 3) {
+        usage(argv[0]);
+    }
+    cfg.host = argv[optind];
+    cfg.port = atoi(argv[optind + 1]);
+    if (cfg.threads > cfg.connections) {
+        cfg.threads = cfg.connections;
+    }
+
+    cred_index index;
+    if (cred_index_open(&index, argv[optind + 2]) != 0) {
+        perror("Failed to load credentials file");
+        exit(EXIT_FAILURE);
+    }
+    cfg.index = &index;
+
+    lg_worker *workers = calloc(cfg.threads, sizeof(*workers));
+    if (!workers) {
+        exit(EXIT_FAILURE);
+    }
+    for (int t = 0; t < cfg.threads; t++) { // Spread connections evenly
+        lg_worker *w = &workers[t];
+        w->cfg = &cfg;
+        w->conn_count = cfg.connections / cfg.threads + (t < cfg.connections % cfg.threads);
+        w->rng = 0x9E3779B97F4A7C15ULL * (t + 1);
+        if (lg_connect(w) != 0) {
+            fprintf(stderr, "Could not open %d connections\n", cfg.connections);
+            exit(EXIT_FAILURE);
+        }
+    }
+
+    if (cfg.rate > 0) {
+        printf("Open loop: %.0f requests/sec over %d connections for %.1f s, %.0f%% hits\n",
+               cfg.rate, cfg.connections, cfg.duration, cfg.hit_ratio * 100);
+    } else {
+        printf("Closed loop: %d outstanding per connection over %d connections for %.1f s, %.0f%% hits\n",
+               cfg.depth, cfg.connections, cfg.duration, cfg.hit_ratio * 100);
+    }
+    fflush(stdout);
+
+    uint64_t start = now_ns();
+    for (int t = 0; t < cfg.threads; t++) {
+        pthread_create(&workers[t].thread, NULL, lg_loop, &workers[t]);
+    }
+    static histogram latency; // Merged results
+    uint64_t sent = 0, received = 0, found = 0, errors = 0, overflow = 0;
+    for (int t = 0; t < cfg.threads; t++) {
+        pthread_join(workers[t].thread, NULL);
+        hist_merge(&latency, &workers[t].latency);
+        sent += workers[t].sent;
+        received += workers[t].received;
+        found += workers[t].found;
+        errors += workers[t].errors;
+        overflow += workers[t].overflow;
+    }
+    double elapsed = (now_ns() - start) / 1e9;
+
+    printf("Requests: %llu sent, %llu answered (%.1f%% found), %llu errors, %llu not sent (window full)\n",
+           (unsigned long long)sent, (unsigned long long)received,
+           received ? 100.0 * found / received : 0.0, (unsigned long long)errors, (unsigned long long)overflow);
+    printf("Throughput: %.0f requests/sec\n", received / elapsed);
+    printf("Latency (us): mean %.1f  p50 %.1f  p90 %.1f  p99 %.1f  p99.9 %.1f  max %.1f\n",
+           latency.total ? latency.sum / latency.total / 1000 : 0.0,
+           hist_percentile(&latency, 50) / 1000.0, hist_percentile(&latency, 90) / 1000.0,
+           hist_percentile(&latency, 99) / 1000.0, hist_percentile(&latency, 99.9) / 1000.0,
+           latency.max / 1000.0);
+    return 0;
+}
@@ -0,0 +1,118 @@
+// log.c
+#include <stdio.h>
+#include <stdarg.h>
+#include <string.h>
+#include <unistd.h>
+#include <pthread.h>
+#include "log.h"
+
+#define LOG_POLL_US 1000 // Writer sleep when the ring is empty
+#define LOG_FLUSH_POLLS 100 // How long log_flush waits, in LOG_POLL_US steps
+
+// One queued message; `sequence` says whose turn the slot is
+typedef struct {
+    uint64_t sequence; // Position + 1 once written, position + LOG_RING_SLOTS once read
+    char text[LOG_MESSAGE_SIZE]; // Formatted message without the newline
+} log_slot;
+
+int log_level = LOG_INFO;
+
+static log_slot ring[LOG_RING_SLOTS];
+static uint64_t tail; // Next position producers claim
+static uint64_t head; // Next position the writer reads, only written by the writer
+static uint64_t dropped; // Messages lost to a full ring
+static int started; // Writer thread running
+
+static void *log_loop(void *arg) {
+    (void)arg;
+    while (1) {
+        int wrote = 0;
+        flockfile(stdout); // Keep each message whole next to other stdout writers
+        while (1) {
+            log_slot *slot = &ring[head & (LOG_RING_SLOTS - 1)];
+            if (__atomic_load_n(&slot->sequence, __ATOMIC_ACQUIRE) != head + 1) {
+                break; // Not written yet
+            }
+            fputs(slot->text, stdout);
+            fputc('\n', stdout);
+            __atomic_store_n(&slot->sequence, head + LOG_RING_SLOTS, __ATOMIC_RELEASE); // Free for the next lap
+            __atomic_store_n(&head, head + 1, __ATOMIC_RELEASE);
+            wrote = 1;
+        }
+        funlockfile(stdout);
+        if (wrote) {
+            fflush(stdout); // One write for the whole batch
+        } else {
+            usleep(LOG_POLL_US);
+        }
+    }
+    return NULL;
+}
+
+void log_write(int level, const char *fmt, ...) {
+    (void)level;
+    va_list args;
+    if (!__atomic_load_n(&started, __ATOMIC_ACQUIRE)) { // No writer yet, print directly
+        va_start(args, fmt);
+        vprintf(fmt, args);
+        va_end(args);
+        putchar('\n');
+        return;
+    }
+
+    uint64_t pos = __atomic_load_n(&tail, __ATOMIC_RELAXED);
+    log_slot *slot;
+    while (1) {
+        slot = &ring[pos & (LOG_RING_SLOTS - 1)];
+        int64_t lag = (int64_t)(__atomic_load_n(&slot->sequence, __ATOMIC_ACQUIRE) - pos);
+        if (lag == 0) { // Free for this position, try to claim it
+            if (__atomic_compare_exchange_n(&tail, &pos, pos + 1, 1, __ATOMIC_RELAXED, __ATOMIC_RELAXED)) {
+                break;
+            }
+        } else if (lag < 0) { // Still holds a message from the previous lap
+            __atomic_fetch_add(&dropped, 1, __ATOMIC_RELAXED);
+            return;
+        } else {
+            pos = __atomic_load_n(&tail, __ATOMIC_RELAXED); // Another producer took it
+        }
+    }
+    va_start(args, fmt);
+    vsnprintf(slot->text, sizeof(slot->text), fmt, args);
+    va_end(args);
+    __atomic_store_n(&slot->sequence, pos + 1, __ATOMIC_RELEASE); // Hand it to the writer
+}
+
+int log_parse_level(const char *name) {
+    static const char *names[] = {"error", "warn", "info", "debug"};
+    for (int i = 0; i < (int)(sizeof(names) / sizeof(names[0])); i++) {
+        if (strcmp(name, names[i]) == 0) {
+            return i;
+        }
+    }
+    return -1;
+}
+
+int log_start(void) {
+    for (uint64_t i = 0; i < LOG_RING_SLOTS; i++) {
+        ring[i].sequence = i; // Slot i is free for position i
+    }
+    pthread_t thread;
+    if (pthread_create(&thread, NULL, log_loop, NULL) != 0) {
+        return -1;
+    }
+    pthread_detach(thread);
+    __atomic_store_n(&started, 1, __ATOMIC_RELEASE);
+    return 0;
+}
+
+void log_flush(void) {
+    for (int i = 0; i < LOG_FLUSH_POLLS && __atomic_load_n(&started, __ATOMIC_ACQUIRE) &&
+                    __atomic_load_n(&head, __ATOMIC_ACQUIRE) != __atomic_load_n(&tail, __ATOMIC_ACQUIRE); i++) {
+        usleep(LOG_POLL_US);
+    }
+    fflush(stdout);
+}
+
+uint64_t log_dropped(void) {
+    return __atomic_load_n(&dropped, __ATOMIC_RELAXED);
+}
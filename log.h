@@ -0,0 +1,37 @@
+// log.h
+// Leveled logging that never blocks the caller on I/O. Messages are formatted into a
+// fixed ring of slots (a bounded multi-producer queue with per-slot sequence numbers,
+// so producers only contend on one atomic counter) and written out by a background
+// thread in batches. When the ring is full a message is dropped and counted rather
+// than stalling an event loop. Before log_start, messages are written synchronously.
+
+#ifndef _LOG_H_
+#define _LOG_H_
+
+#include <stdint.h>
+
+#define LOG_ERROR 0 // Failures
+#define LOG_WARN 1 // Recoverable problems
+#define LOG_INFO 2 // Startup, reloads, periodic output (default)
+#define LOG_DEBUG 3 // Every request
+
+#define LOG_RING_SLOTS 4096 // Messages buffered before dropping, a power of two
+#define LOG_MESSAGE_SIZE 240 // Longest message kept, including the terminator
+
+extern int log_level; // Messages above this level are skipped before formatting
+
+// Log a printf-style message if `level` is enabled; costs one branch when it is not
+#define LOG(level, ...)                       \
+    do {                                      \
+        if ((level) <= log_level) {           \
+            log_write((level), __VA_ARGS__);  \
+        }                                     \
+    } while (0)
+
+void log_write(int level, const char *fmt, ...) __attribute__((format(printf, 2, 3))); // Queue one message
+int log_parse_level(const char *name); // LOG_* for "error", "warn", "info" or "debug", -1 otherwise
+int log_start(void); // Start the writer thread, 0 on success
+void log_flush(void); // Wait briefly for queued messages to be written
+uint64_t log_dropped(void); // Messages lost because the ring was full
+
+#endif
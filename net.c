@@ -0,0 +1,189 @@
+// net.c
+#include <stdio.h>
+#include <string.h>
+#include <unistd.h>
+#include <fcntl.h>
+#include <netdb.h>
+#include <sys/stat.h>
+#include <sys/un.h>
+#include <arpa/inet.h>
+#include <netinet/tcp.h>
+#include "net.h"
+
+int tcp_listen(int port, int backlog) {
+    int fd = socket(AF_INET, SOCK_STREAM, 0); // Create socket
+    if (fd < 0) {
+        perror("Socket failed"); // Print error if socket creation fails
+        return -1;
+    }
+
+    // Reuse the address after a restart, and let several sockets share the port so
+    // each server thread can have its own accept queue
+    int opt = 1;
+    if (setsockopt(fd, SOL_SOCKET, SO_REUSEADDR, &opt, sizeof(opt)) ||
+        setsockopt(fd, SOL_SOCKET, SO_REUSEPORT, &opt, sizeof(opt))) {
+        perror("setsockopt"); // Print error if setting socket options fails
+        close(fd);
+        return -1;
+    }
+
+    struct sockaddr_in address; // Structure to hold server address
+    memset(&address, 0, sizeof(address));
+    address.sin_family = AF_INET; // Set address family to Internet
+    address.sin_addr.s_addr = INADDR_ANY; // Accept connections from any IP address
+    address.sin_port = htons(port); // Set port number
+
+    if (bind(fd, (struct sockaddr *)&address, sizeof(address)) < 0) {
+        perror("Bind failed"); // Print error if binding fails
+        close(fd);
+        return -1;
+    }
+
+    if (listen(fd, backlog) < 0) {
+        perror("Listen failed"); // Print error if listening fails
+        close(fd);
+        return -1;
+    }
+    return fd;
+}
+
+int set_nonblocking(int fd) {
+    int flags = fcntl(fd, F_GETFL, 0);
+    if (flags < 0) {
+        return -1;
+    }
+    return fcntl(fd, F_SETFL, flags | O_NONBLOCK);
+}
+
+// Socket of `type` connected to host:port, -1 on error
+static int inet_connect(const char *host, int port, int type) {
+    struct addrinfo hints, *addrs;
+    memset(&hints, 0, sizeof(hints));
+    hints.ai_family = AF_INET; // Set address family to Internet
+    hints.ai_socktype = type;
+    char service[16];
+    snprintf(service, sizeof(service), "%d", port);
+
+    int err = getaddrinfo(host, service, &hints, &addrs); // Resolve names as well as dotted addresses
+    if (err != 0) {
+        fprintf(stderr, "Invalid address %s: %s\n", host, gai_strerror(err));
+        return -1;
+    }
+
+    int fd = socket(AF_INET, type, 0); // Create socket
+    if (fd < 0) {
+        perror("Socket creation error"); // Print error if socket creation fails
+        freeaddrinfo(addrs);
+        return -1;
+    }
+    if (connect(fd, addrs->ai_addr, addrs->ai_addrlen) < 0) {
+        perror("Connection failed"); // Print error if connection fails
+        close(fd);
+        freeaddrinfo(addrs);
+        return -1;
+    }
+    freeaddrinfo(addrs);
+    return fd;
+}
+
+int tcp_connect(const char *host, int port) {
+    int fd = inet_connect(host, port, SOCK_STREAM);
+    if (fd >= 0) {
+        int opt = 1; // Requests are small, send them at once
+        setsockopt(fd, IPPROTO_TCP, TCP_NODELAY, &opt, sizeof(opt));
+    }
+    return fd;
+}
+
+int udp_bind(int port) {
+    int fd = socket(AF_INET, SOCK_DGRAM | SOCK_CLOEXEC, 0);
+    if (fd < 0) {
+        perror("Socket failed");
+        return -1;
+    }
+
+    int opt = 1; // Each server thread binds its own socket and the kernel spreads senders over them
+    if (setsockopt(fd, SOL_SOCKET, SO_REUSEPORT, &opt, sizeof(opt))) {
+        perror("setsockopt");
+        close(fd);
+        return -1;
+    }
+
+    struct sockaddr_in address;
+    memset(&address, 0, sizeof(address));
+    address.sin_family = AF_INET;
+    address.sin_addr.s_addr = INADDR_ANY;
+    address.sin_port = htons(port);
+    if (bind(fd, (struct sockaddr *)&address, sizeof(address)) < 0) {
+        perror("Bind failed");
+        close(fd);
+        return -1;
+    }
+    return fd;
+}
+
+int udp_connect(const char *host, int port) {
+    return inet_connect(host, port, SOCK_DGRAM);
+}
+
+// Fill in a Unix domain socket address, -1 if the path does not fit
+static int unix_address(const char *path, struct sockaddr_un *address) {
+    memset(address, 0, sizeof(*address));
+    address->sun_family = AF_UNIX;
+    if (strlen(path) >= sizeof(address->sun_path)) {
+        fprintf(stderr, "Socket path too long: %s\n", path);
+        return -1;
+    }
+    strcpy(address->sun_path, path);
+    return 0;
+}
+
+int unix_listen(const char *path, int backlog) {
+    struct sockaddr_un address;
+    if (unix_address(path, &address) != 0) {
+        return -1;
+    }
+    int fd = socket(AF_UNIX, SOCK_STREAM | SOCK_CLOEXEC, 0);
+    if (fd < 0) {
+        perror("Socket failed");
+        return -1;
+    }
+
+    struct stat st; // A socket left behind by a previous run would make bind fail
+    if (stat(path, &st) == 0 && S_ISSOCK(st.st_mode)) {
+        unlink(path);
+    }
+    if (bind(fd, (struct sockaddr *)&address, sizeof(address)) < 0) {
+        perror("Bind failed");
+        close(fd);
+        return -1;
+    }
+    if (listen(fd, backlog) < 0) {
+        perror("Listen failed");
+        close(fd);
+        return -1;
+    }
+    return fd;
+}
+
+int unix_connect(const char *path) {
+    struct sockaddr_un address;
+    if (unix_address(path, &address) != 0) {
+        return -1;
+    }
+    int fd = socket(AF_UNIX, SOCK_STREAM | SOCK_CLOEXEC, 0);
+    if (fd < 0) {
+        perror("Socket creation error");
+        return -1;
+    }
+    if (connect(fd, (struct sockaddr *)&address, sizeof(address)) < 0) {
+        perror("Connection failed");
+        close(fd);
+        return -1;
+    }
+    return fd;
+}
+
+int net_connect(const char *host, int port) {
+    return strchr(host, '/') ? unix_connect(host) : tcp_connect(host, port);
+}
@@ -0,0 +1,18 @@
+// net.h
+// Socket setup helpers shared by the server I/O paths and the client. Same-host
+// clients can skip the TCP stack by naming a Unix domain socket path as the host;
+// single-datagram lookups can skip connections entirely over UDP.
+
+#ifndef _NET_H_
+#define _NET_H_
+
+int tcp_listen(int port, int backlog); // Bound, listening SO_REUSEADDR/SO_REUSEPORT socket, -1 on error
+int set_nonblocking(int fd); // Set O_NONBLOCK, 0 on success
+int tcp_connect(const char *host, int port); // Connected TCP_NODELAY socket, -1 on error
+int udp_bind(int port); // SO_REUSEPORT UDP socket bound to the port on every address, -1 on error
+int udp_connect(const char *host, int port); // UDP socket connected to host:port, so only its replies arrive, -1 on error
+int unix_listen(const char *path, int backlog); // Listening Unix domain socket, replacing a stale one, -1 on error
+int unix_connect(const char *path); // Connected Unix domain socket, -1 on error
+int net_connect(const char *host, int port); // unix_connect if host is a path (contains '/'), else tcp_connect
+
+#endif
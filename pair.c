@@ -0,0 +1,183 @@
+// pair.c
+#include <stdlib.h>
+#include <string.h>
+#include "pair.h"
+#include "search.h"
+
+#define INITIAL_CAPACITY 1024 // First allocation for a pair set
+
+// Inverse of search_key: the big-endian bytes a fingerprint is stored as
+static void store_key(uint8_t *bytes, uint64_t key) {
+    for (int i = 0; i < 8; i++) {
+        bytes[i] = (uint8_t)(key >> (56 - i * 8));
+    }
+}
+
+uint64_t pair_fingerprint(const uint8_t username[SHA256_DIGEST_SIZE], const uint8_t password[SHA256_DIGEST_SIZE]) {
+    // Bytes 8..15 rather than the leading bytes the sets sort and shard by, so a pair's
+    // ring position does not follow either digest's. The filters read these bytes too,
+    // which costs nothing: pair sets have no filter, and the mix below spreads the keys
+    uint64_t h = search_key(username + 8) ^ (search_key(password + 8) * 0x9e3779b97f4a7c15ULL);
+    h ^= h >> 32;
+    h *= 0xd6e8feb86659fd93ULL;
+    h ^= h >> 32;
+    return h;
+}
+
+int pair_set_add(pair_set *set, uint64_t key) {
+    if (set->count == set->capacity) { // Grow geometrically
+        size_t capacity = set->capacity ? set->capacity * 2 : INITIAL_CAPACITY;
+        void *grown = realloc(set->keys, capacity * PAIR_KEY_SIZE);
+        if (!grown) {
+            return -1; // Out of memory
+        }
+        set->keys = grown;
+        set->capacity = capacity;
+    }
+    store_key(set->keys[set->count++], key);
+    return 0;
+}
+
+static int key_compare(const void *a, const void *b) {
+    return memcmp(a, b, PAIR_KEY_SIZE);
+}
+
+// Least significant digit radix sort, a byte per pass: fingerprints are plain integers,
+// so this beats a comparison sort several times over. -1 if the scratch arrays cannot
+// be allocated
+static int radix_sort(uint8_t (*keys)[PAIR_KEY_SIZE], size_t count) {
+    uint64_t *values = malloc(count * sizeof(*values));
+    uint64_t *scratch = malloc(count * sizeof(*scratch));
+    if (!values || !scratch) {
+        free(values);
+        free(scratch);
+        return -1;
+    }
+    for (size_t i = 0; i < count; i++) {
+        values[i] = search_key(keys[i]);
+    }
+    for (int shift = 0; shift < 64; shift += 8) {
+        size_t offsets[257] = {0};
+        for (size_t i = 0; i < count; i++) {
+            offsets[((values[i] >> shift) & 0xff) + 1]++;
+        }
+        for (int d = 0; d < 256; d++) {
+            offsets[d + 1] += offsets[d];
+        }
+        for (size_t i = 0; i < count; i++) {
+            scratch[offsets[(values[i] >> shift) & 0xff]++] = values[i];
+        }
+        uint64_t *sorted = scratch; // Sorted on the bytes up to this one
+        scratch = values;
+        values = sorted;
+    }
+    for (size_t i = 0; i < count; i++) {
+        store_key(keys[i], values[i]);
+    }
+    free(values);
+    free(scratch);
+    return 0;
+}
+
+size_t pair_sort_unique(uint8_t (*keys)[PAIR_KEY_SIZE], size_t count) {
+    if (count == 0) {
+        return 0;
+    }
+    if (radix_sort(keys, count) != 0) {
+        qsort(keys, count, PAIR_KEY_SIZE, key_compare); // Slower, but needs no memory
+    }
+
+    size_t unique = 1; // A pair repeated across dumps is stored once
+    for (size_t i = 1; i < count; i++) {
+        if (memcmp(keys[i], keys[unique - 1], PAIR_KEY_SIZE) != 0) {
+            memcpy(keys[unique++], keys[i], PAIR_KEY_SIZE);
+        }
+    }
+    return unique;
+}
+
+void pair_set_finalize(pair_set *set) {
+    set->indexed = 1;
+    if (set->count == 0) {
+        return;
+    }
+    set->count = pair_sort_unique(set->keys, set->count);
+
+    void *shrunk = realloc(set->keys, set->count * PAIR_KEY_SIZE); // Return the slack
+    if (shrunk) {
+        set->keys = shrunk;
+        set->capacity = set->count;
+    }
+}
+
+int pair_set_contains(const pair_set *set, uint64_t key) {
+    uint8_t target[PAIR_KEY_SIZE]; // Stored form of the key
+    store_key(target, key);
+    return search_find((const uint8_t *)set->keys, PAIR_KEY_SIZE, set->count, target);
+}
+
+int pair_set_merge(pair_set *out, const pair_set *base, const pair_set *add, const pair_set *remove) {
+    memset(out, 0, sizeof(*out));
+    out->indexed = base->indexed;
+    size_t capacity = base->count + add->count;
+    if (capacity == 0) {
+        return 0;
+    }
+    out->keys = malloc(capacity * PAIR_KEY_SIZE);
+    if (!out->keys) {
+        return -1;
+    }
+    out->capacity = capacity;
+
+    size_t i = 0, j = 0, r = 0; // Positions in base, add and remove
+    while (i < base->count || j < add->count) {
+        const uint8_t *next; // Smallest remaining fingerprint
+        if (j == add->count || (i < base->count && memcmp(base->keys[i], add->keys[j], PAIR_KEY_SIZE) <= 0)) {
+            next = base->keys[i++];
+            if (j < add->count && memcmp(next, add->keys[j], PAIR_KEY_SIZE) == 0) {
+                j++; // Already present
+            }
+        } else {
+            next = add->keys[j++];
+        }
+        while (r < remove->count && memcmp(remove->keys[r], next, PAIR_KEY_SIZE) < 0) {
+            r++;
+        }
+        if (r < remove->count && memcmp(remove->keys[r], next, PAIR_KEY_SIZE) == 0) {
+            continue; // Removed by the delta
+        }
+        memcpy(out->keys[out->count++], next, PAIR_KEY_SIZE);
+    }
+    return 0;
+}
+
+int pair_set_select(pair_set *out, const pair_set *set, const shard_map *map, int shard) {
+    memset(out, 0, sizeof(*out));
+    out->indexed = set->indexed;
+    for (size_t i = 0; i < set->count; i++) {
+        uint64_t key = search_key(set->keys[i]);
+        if (shard_owner_key(map, key) == shard && pair_set_add(out, key) != 0) {
+            pair_set_free(out);
+            return -1;
+        }
+    }
+    return 0;
+}
+
+int pair_set_owned(const pair_set *set, const shard_map *map, int shard) {
+    for (size_t i = 0; i < set->count; i++) {
+        if (shard_owner_key(map, search_key(set->keys[i])) != shard) {
+            return 0;
+        }
+    }
+    return 1;
+}
+
+void pair_set_free(pair_set *set) {
+    free(set->keys);
+    memset(set, 0, sizeof(*set));
+}
+
+size_t pair_set_memory(const pair_set *set) {
+    return (set->capacity ? set->capacity : set->count) * PAIR_KEY_SIZE; // Mapped pages are all touched too
+}
@@ -0,0 +1,48 @@
+// pair.h
+// Index of the exact username/password pairs of a credentials file. check_both
+// otherwise tests each field against its own set and cannot tell a breached pair from a
+// username and a password that come from unrelated lines. Each line contributes one
+// PAIR_KEY_SIZE-byte fingerprint mixed from both digests, kept sorted like a digest set,
+// so a pair costs 8 bytes instead of the 64 of its digests and is found with one
+// interpolation search. Digests are already uniform, so a multiply-xorshift mix is
+// enough: two distinct pairs share a fingerprint with probability 2^-64, and a lookup
+// against n pairs is a false positive with probability n / 2^64.
+//
+// Fingerprints are stored big-endian, the order they sort and the byte layout of the
+// pair section of an index file, so a mapped file is searched in place. In a sharded
+// deployment a pair belongs to the shard owning its fingerprint as a ring key, which
+// a client computes with pair_fingerprint like the server does.
+
+#ifndef _PAIR_H_
+#define _PAIR_H_
+
+#include <stddef.h>
+#include <stdint.h>
+#include "sha256_lib.h"
+#include "shard.h"
+
+#define PAIR_KEY_SIZE 8 // Bytes per stored fingerprint
+
+// Sorted, de-duplicated array of pair fingerprints
+typedef struct {
+    uint8_t (*keys)[PAIR_KEY_SIZE]; // Big-endian fingerprints in ascending order
+    size_t count; // Number of fingerprints stored
+    size_t capacity; // Number of fingerprints allocated
+    int indexed; // 0 if the source had no pair section, so no pair can be answered
+} pair_set;
+
+uint64_t pair_fingerprint(const uint8_t username[SHA256_DIGEST_SIZE],
+                          const uint8_t password[SHA256_DIGEST_SIZE]); // Fingerprint of one pair
+int pair_set_add(pair_set *set, uint64_t key); // Append a fingerprint, 0 on success
+size_t pair_sort_unique(uint8_t (*keys)[PAIR_KEY_SIZE], size_t count); // Sort in place, returns the distinct count
+void pair_set_finalize(pair_set *set); // Sort and de-duplicate after the last add
+int pair_set_contains(const pair_set *set, uint64_t key); // 1 if present
+int pair_set_merge(pair_set *out, const pair_set *base, const pair_set *add,
+                   const pair_set *remove); // out = (base + add) - remove, 0 on success
+int pair_set_select(pair_set *out, const pair_set *set, const shard_map *map,
+                    int shard); // Copy the fingerprints `shard` owns, 0 on success
+int pair_set_owned(const pair_set *set, const shard_map *map, int shard); // 1 if `shard` owns every fingerprint
+void pair_set_free(pair_set *set); // Release the array
+size_t pair_set_memory(const pair_set *set); // Bytes that must stay resident to search the set
+
+#endif
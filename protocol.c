@@ -0,0 +1,361 @@
+// protocol.c
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+#include "protocol.h"
+#include "reload.h"
+#include "stats.h"
+#include "log.h"
+
+#define OP_USERNAME 1 // Check a username/email hash
+#define OP_PASSWORD 2 // Check a password hash
+#define OP_BOTH 3 // Check a username/email hash and a password hash
+#define OP_EXIT 4 // Close the connection
+#define OP_RANGE 5 // Return every password suffix under a hash prefix
+#define OP_RELOAD_FULL 6 // Reload the credentials file
+#define OP_RELOAD_DELTA 7 // Merge the delta file
+#define OP_STATS 8 // Report counters and latency percentiles
+
+#define NEED_MORE -1 // A frame is not fully buffered yet
+
+// Prefix and total length of each text request
+static const struct {
+    const char *prefix; // Command name including the ':' separator
+    size_t length; // Full message length including the hash payload
+    int op; // Operation code
+} text_ops[] = {
+    {TEXT_CHECK_USERNAME, sizeof(TEXT_CHECK_USERNAME) - 1 + SHA256_HEX_SIZE, OP_USERNAME},
+    {TEXT_CHECK_PASSWORD, sizeof(TEXT_CHECK_PASSWORD) - 1 + SHA256_HEX_SIZE, OP_PASSWORD},
+    {TEXT_CHECK_BOTH, sizeof(TEXT_CHECK_BOTH) - 1 + SHA256_HEX_SIZE * 2 + 1, OP_BOTH},
+    {TEXT_RANGE, sizeof(TEXT_RANGE) - 1 + RANGE_PREFIX_HEX, OP_RANGE},
+    {TEXT_RELOAD_FULL, sizeof(TEXT_RELOAD_FULL) - 1, OP_RELOAD_FULL},
+    {TEXT_RELOAD_DELTA, sizeof(TEXT_RELOAD_DELTA) - 1, OP_RELOAD_DELTA},
+    {TEXT_STATS, sizeof(TEXT_STATS) - 1, OP_STATS},
+    {TEXT_EXIT, sizeof(TEXT_EXIT) - 1, OP_EXIT},
+};
+
+#define TEXT_OP_COUNT (sizeof(text_ops) / sizeof(text_ops[0]))
+
+static void (*reload_hook)(int kind); // Set by the server when reloads are possible
+
+void protocol_set_reload_hook(void (*hook)(int kind)) {
+    reload_hook = hook;
+}
+
+int byte_buf_append(byte_buf *buf, const void *data, size_t len) {
+    if (buf->off > 0 && buf->off == buf->len) { // Everything consumed, start over
+        buf->off = buf->len = 0;
+    }
+    if (buf->len + len > buf->cap) {
+        if (buf->off > 0) { // Reclaim the consumed prefix before growing
+            memmove(buf->data, buf->data + buf->off, buf->len - buf->off);
+            buf->len -= buf->off;
+            buf->off = 0;
+        }
+        if (buf->len + len > buf->cap) {
+            size_t cap = buf->cap ? buf->cap : 1024;
+            while (cap < buf->len + len) {
+                cap *= 2;
+            }
+            char *grown = realloc(buf->data, cap);
+            if (!grown) {
+                return -1; // Out of memory
+            }
+            buf->data = grown;
+            buf->cap = cap;
+        }
+    }
+    memcpy(buf->data + buf->len, data, len);
+    buf->len += len;
+    return 0;
+}
+
+void byte_buf_consume(byte_buf *buf, size_t len) {
+    buf->off += len;
+    if (buf->off >= buf->len) { // Fully drained
+        buf->off = buf->len = 0;
+    }
+}
+
+size_t byte_buf_pending(const byte_buf *buf) {
+    return buf->len - buf->off;
+}
+
+void byte_buf_free(byte_buf *buf) {
+    free(buf->data);
+    memset(buf, 0, sizeof(*buf));
+}
+
+// Look up one hex hash in a digest set; malformed hashes are never found
+static int lookup_hex(const digest_set *set, const char *hex) {
+    uint8_t digest[SHA256_DIGEST_SIZE]; // Binary form of the queried hash
+    return hex_to_digest(hex, digest) == 0 && digest_set_contains(set, digest);
+}
+
+static int reply(byte_buf *out, const char *text) {
+    return byte_buf_append(out, text, strlen(text));
+}
+
+// Answer one complete text request that arrived at `start`
+static int answer_text(const cred_index *index, int op, const char *payload, byte_buf *out, uint64_t start,
+                       int admin) {
+    char username_hash[SHA256_HEX_SIZE + 1] = {0}; // Buffer to hold username hash
+    char password_hash[SHA256_HEX_SIZE + 1] = {0}; // Buffer to hold password hash
+
+    if (op == OP_USERNAME) {
+        memcpy(username_hash, payload, SHA256_HEX_SIZE); // Copy username hash from request
+        LOG(LOG_DEBUG, "Received username hash: %s", username_hash); // Debug print
+        int found = lookup_hex(&index->usernames, username_hash);
+        stats_request(STAT_CHECK_USERNAME, 1, found, start);
+        return reply(out, found ? "Found" : "Not Found");
+    }
+
+    if (op == OP_RELOAD_FULL || op == OP_RELOAD_DELTA) {
+        stats_request(STAT_ADMIN, 0, 0, start);
+        if (!reload_hook || !admin) {
+            return reply(out, "Unsupported"); // Not from the Unix domain socket
+        }
+        reload_hook(op == OP_RELOAD_FULL ? RELOAD_FULL : RELOAD_DELTA); // Rebuilt on the reload thread
+        return reply(out, "Reloading");
+    }
+
+    if (op == OP_STATS) {
+        static __thread char text[STATS_TEXT_SIZE]; // Rendered snapshot, reused per thread
+        size_t len = stats_format(index, text, sizeof(text));
+        stats_request(STAT_ADMIN, 0, 0, start);
+        return byte_buf_append(out, text, len);
+    }
+
+    if (op == OP_RANGE) {
+        uint32_t prefix = 0; // Bucket number from the hex prefix
+        for (int i = 0; i < RANGE_PREFIX_HEX; i++) {
+            int v = hex_value(payload[i]);
+            if (v < 0) {
+                stats_request(STAT_RANGE, 0, 0, start);
+                return reply(out, "Range Invalid\n");
+            }
+            prefix = (prefix << 4) | v;
+        }
+        size_t len;
+        const char *bucket = range_index_get(&index->password_ranges, prefix, &len); // Prebuilt reply
+        stats_request(STAT_RANGE, 0, 0, start);
+        return bucket ? byte_buf_append(out, bucket, len) : reply(out, "Range Unsupported\n"); // Server started without -r
+    }
+
+    if (op == OP_PASSWORD) {
+        memcpy(password_hash, payload, SHA256_HEX_SIZE); // Copy password hash from request
+        LOG(LOG_DEBUG, "Received password hash: %s", password_hash); // Debug print
+        int found = lookup_hex(&index->passwords, password_hash);
+        stats_request(STAT_CHECK_PASSWORD, 1, found, start);
+        return reply(out, found ? "Found" : "Not Found");
+    }
+
+    memcpy(username_hash, payload, SHA256_HEX_SIZE); // Copy username hash
+    memcpy(password_hash, payload + SHA256_HEX_SIZE + 1, SHA256_HEX_SIZE); // Copy password hash
+    LOG(LOG_DEBUG, "Received both hashes - Username: %s, Password: %s", username_hash, password_hash); // Debug print
+    uint8_t username[SHA256_DIGEST_SIZE], password[SHA256_DIGEST_SIZE];
+    if (hex_to_digest(username_hash, username) != 0 || hex_to_digest(password_hash, password) != 0) {
+        stats_request(STAT_CHECK_BOTH, 2, 0, start);
+        return reply(out, "NotFound"); // Malformed hashes are never found
+    }
+    if (index->pairs.indexed && pair_set_contains(&index->pairs, pair_fingerprint(username, password))) {
+        stats_request(STAT_CHECK_BOTH, 1, 1, start);
+        return reply(out, "FoundPair"); // Breached together on one line, answered with a single probe
+    }
+    int found_username = digest_set_contains(&index->usernames, username); // Search username set
+    int found_password = digest_set_contains(&index->passwords, password); // Search password set
+    stats_request(STAT_CHECK_BOTH, 2, found_username + found_password, start);
+    if (found_username && found_password) {
+        return reply(out, "FoundBoth"); // Both are found, but not as a pair (or the index has no pairs)
+    } else if (found_username) {
+        return reply(out, "FoundUsernameOnly"); // Only username is found
+    } else if (found_password) {
+        return reply(out, "FoundPasswordOnly"); // Only password is found
+    }
+    return reply(out, "NotFound"); // Neither is found
+}
+
+// Append a reply header, and the payload if there is one
+static int reply_binary(byte_buf *out, const bin_header *request, uint8_t status,
+                        uint32_t count, const uint8_t *payload, uint32_t length) {
+    bin_header hdr = {BIN_VERSION, request->op, status, request->request_id, count, length};
+    uint8_t raw[BIN_HEADER_SIZE];
+    bin_header_encode(&hdr, raw);
+    if (byte_buf_append(out, raw, sizeof(raw)) != 0) {
+        return -1;
+    }
+    return length ? byte_buf_append(out, payload, length) : 0;
+}
+
+// Answer a CHECK_BATCH frame whose header and payload are fully buffered. Each field
+// is looked up as one batch so the index can overlap the cache misses of its digests.
+static int answer_batch(const cred_index *index, const bin_header *hdr, const uint8_t *payload, byte_buf *out,
+                        uint64_t start) {
+    static __thread uint8_t bitmap[(BIN_MAX_BATCH * 2 + 7) / 8]; // Reply bits, reused per thread
+    static __thread uint8_t found[2][BIN_MAX_BATCH]; // Per-digest results of each field
+    size_t bitmap_size = bin_bitmap_size(hdr->field, hdr->count);
+    memset(bitmap, 0, bitmap_size);
+
+    uint32_t hits = 0;
+    if (hdr->field == BIN_FIELD_PAIR) { // One fingerprint probe per item
+        for (uint32_t i = 0; i < hdr->count; i++) {
+            const uint8_t *item = payload + (size_t)i * SHA256_DIGEST_SIZE * 2;
+            if (pair_set_contains(&index->pairs, pair_fingerprint(item, item + SHA256_DIGEST_SIZE))) {
+                bitmap[i / 8] |= 1 << (i % 8);
+                hits++;
+            }
+        }
+    } else if (hdr->field == BIN_FIELD_BOTH) { // Pairs of username then password digests
+        size_t stride = SHA256_DIGEST_SIZE * 2;
+        digest_set_contains_batch(&index->usernames, payload, stride, hdr->count, found[0]);
+        digest_set_contains_batch(&index->passwords, payload + SHA256_DIGEST_SIZE, stride, hdr->count, found[1]);
+        for (uint32_t i = 0; i < hdr->count; i++) {
+            for (int f = 0; f < 2; f++) {
+                if (found[f][i]) {
+                    bitmap[(2 * i + f) / 8] |= 1 << ((2 * i + f) % 8);
+                    hits++;
+                }
+            }
+        }
+    } else {
+        const digest_set *set = hdr->field == BIN_FIELD_USERNAME ? &index->usernames : &index->passwords;
+        digest_set_contains_batch(set, payload, SHA256_DIGEST_SIZE, hdr->count, found[0]);
+        for (uint32_t i = 0; i < hdr->count; i++) {
+            if (found[0][i]) {
+                bitmap[i / 8] |= 1 << (i % 8);
+                hits++;
+            }
+        }
+    }
+    stats_request(STAT_BATCH, hdr->count * (hdr->field == BIN_FIELD_BOTH ? 2 : 1), hits, start);
+    return reply_binary(out, hdr, BIN_STATUS_OK, hdr->count, bitmap, bitmap_size);
+}
+
+// Answer a GET_FILTER frame with the requested field's filter bits
+static int answer_filter(const cred_index *index, const bin_header *hdr, byte_buf *out, uint64_t start) {
+    const digest_filter *filter = hdr->field == BIN_FIELD_USERNAME ? &index->usernames.filter
+                                                                   : &index->passwords.filter;
+    stats_request(STAT_FILTER, 0, 0, start);
+    if (filter->block_count == 0 || filter->block_count > UINT32_MAX / FILTER_BLOCK_SIZE) {
+        return reply_binary(out, hdr, BIN_STATUS_UNSUPPORTED, 0, NULL, 0); // None built, or too large for one frame
+    }
+    return reply_binary(out, hdr, BIN_STATUS_OK, filter->block_count,
+                        (const uint8_t *)filter->blocks, filter->block_count * FILTER_BLOCK_SIZE);
+}
+
+// Answer one binary frame whose payload is complete; PROTO_CLOSE if it asked to exit
+// or the reply could not be queued
+static int answer_frame(const cred_index *index, const bin_header *hdr, const uint8_t *payload, byte_buf *out,
+                        uint64_t start) {
+    int failed = 0;
+    if (hdr->version != BIN_VERSION) {
+        failed = reply_binary(out, hdr, BIN_STATUS_UNSUPPORTED, 0, NULL, 0);
+    } else if (hdr->op == BIN_OP_EXIT) {
+        return PROTO_CLOSE; // Client is done
+    } else if (hdr->op == BIN_OP_GET_FILTER) {
+        if ((hdr->field != BIN_FIELD_USERNAME && hdr->field != BIN_FIELD_PASSWORD) || hdr->length != 0) {
+            failed = reply_binary(out, hdr, BIN_STATUS_BAD_REQUEST, 0, NULL, 0);
+        } else {
+            failed = answer_filter(index, hdr, out, start);
+        }
+    } else if (hdr->op != BIN_OP_CHECK_BATCH) {
+        failed = reply_binary(out, hdr, BIN_STATUS_UNSUPPORTED, 0, NULL, 0);
+    } else if (hdr->field < BIN_FIELD_USERNAME || hdr->field > BIN_FIELD_PAIR ||
+               hdr->count == 0 || hdr->count > BIN_MAX_BATCH ||
+               hdr->length != (uint64_t)hdr->count * bin_item_size(hdr->field)) {
+        failed = reply_binary(out, hdr, BIN_STATUS_BAD_REQUEST, 0, NULL, 0);
+    } else if (hdr->field == BIN_FIELD_PAIR && !index->pairs.indexed) {
+        failed = reply_binary(out, hdr, BIN_STATUS_UNSUPPORTED, 0, NULL, 0); // Index built without pairs
+    } else {
+        failed = answer_batch(index, hdr, payload, out, start);
+    }
+    return failed ? PROTO_CLOSE : PROTO_OK;
+}
+
+// Handle the binary frame at the front of `in`: NEED_MORE if it is incomplete,
+// otherwise PROTO_OK or PROTO_CLOSE after consuming it
+static int process_binary(const cred_index *index, byte_buf *in, byte_buf *out, uint64_t start) {
+    const uint8_t *frame = (const uint8_t *)in->data + in->off;
+    if (byte_buf_pending(in) < BIN_HEADER_SIZE) {
+        return NEED_MORE; // Header not complete yet
+    }
+
+    bin_header hdr;
+    bin_header_decode(frame, &hdr);
+    if (hdr.length > BIN_MAX_PAYLOAD) {
+        reply_binary(out, &hdr, BIN_STATUS_BAD_REQUEST, 0, NULL, 0);
+        return PROTO_CLOSE; // Refuse to buffer it, and the stream cannot be resynchronised
+    }
+    if (byte_buf_pending(in) < BIN_HEADER_SIZE + (size_t)hdr.length) {
+        return NEED_MORE; // Payload not complete yet
+    }
+
+    int status = answer_frame(index, &hdr, frame + BIN_HEADER_SIZE, out, start);
+    byte_buf_consume(in, BIN_HEADER_SIZE + hdr.length);
+    return status;
+}
+
+int protocol_answer_datagram(const cred_index *index, const uint8_t *data, size_t len, byte_buf *out) {
+    uint64_t start = stats_now();
+    bin_header hdr;
+    if (len < BIN_HEADER_SIZE || bin_header_decode(data, &hdr) != 0) {
+        return -1; // Not a binary frame, there is no request ID to answer
+    }
+    if (hdr.length != len - BIN_HEADER_SIZE) {
+        return reply_binary(out, &hdr, BIN_STATUS_BAD_REQUEST, 0, NULL, 0); // Truncated, or more than one frame
+    }
+    if (hdr.op != BIN_OP_CHECK_BATCH) {
+        return reply_binary(out, &hdr, BIN_STATUS_UNSUPPORTED, 0, NULL, 0); // Filters do not fit a datagram
+    }
+    return answer_frame(index, &hdr, data + BIN_HEADER_SIZE, out, start) == PROTO_OK ? 0 : -1;
+}
+
+int protocol_process(const cred_index *index, byte_buf *in, byte_buf *out, int admin) {
+    while (byte_buf_pending(in) > 0) {
+        const char *msg = in->data + in->off; // Start of the next unconsumed request
+        size_t avail = byte_buf_pending(in); // Bytes available for it
+        uint64_t start = stats_now(); // Latency is measured from here to the queued reply
+
+        if ((uint8_t)msg[0] == BIN_MAGIC) { // Binary frame
+            int status = process_binary(index, in, out, start);
+            if (status == NEED_MORE) {
+                return PROTO_OK; // Wait for the rest of the frame
+            } else if (status == PROTO_CLOSE) {
+                return PROTO_CLOSE;
+            }
+            continue;
+        }
+
+        if (msg[0] == '\n' || msg[0] == '\r' || msg[0] == ' ') {
+            byte_buf_consume(in, 1); // Tolerate line endings from hand-typed requests
+            continue;
+        }
+
+        size_t i;
+        for (i = 0; i < TEXT_OP_COUNT; i++) {
+            size_t prefix_len = strlen(text_ops[i].prefix);
+            size_t cmp_len = avail < prefix_len ? avail : prefix_len;
+            if (memcmp(msg, text_ops[i].prefix, cmp_len) == 0) {
+                break; // Prefix matches as far as we have data
+            }
+        }
+        if (i == TEXT_OP_COUNT) {
+            reply(out, "Invalid Request"); // Unknown command, give up on this stream
+            return PROTO_CLOSE;
+        }
+        if (avail < text_ops[i].length) {
+            return PROTO_OK; // Wait for the rest of the request
+        }
+        if (text_ops[i].op == OP_EXIT) {
+            byte_buf_consume(in, text_ops[i].length);
+            return PROTO_CLOSE; // Client is done
+        }
+
+        const char *payload = msg + strlen(text_ops[i].prefix); // Hash part of the request
+        if (answer_text(index, text_ops[i].op, payload, out, start, admin) != 0) {
+            return PROTO_CLOSE; // Out of memory for the reply
+        }
+        byte_buf_consume(in, text_ops[i].length);
+    }
+    return PROTO_OK;
+}
@@ -0,0 +1,139 @@
+// protocol.h
+// Request parsing and reply generation shared by every server I/O path. Two wire
+// formats share one port and are told apart by the first byte of each request:
+//  - the text protocol sent by client.c ("check_username:<64 hex>" etc.), framed by
+//    the fixed length of each command (see range.h for the "range:" reply format), and
+//  - a versioned binary protocol with a fixed header carrying a request ID, so many
+//    requests can be pipelined and one CHECK_BATCH frame can carry thousands of digests.
+
+#ifndef _PROTOCOL_H_
+#define _PROTOCOL_H_
+
+#include <stddef.h>
+#include <stdint.h>
+#include "cred_index.h"
+
+// Text protocol messages sent by client.c
+#define TEXT_CHECK_USERNAME "check_username:" // Followed by 64 hex chars
+#define TEXT_CHECK_PASSWORD "check_password:" // Followed by 64 hex chars
+#define TEXT_CHECK_BOTH "check_both:" // Followed by <64 hex>:<64 hex>, answered FoundPair if they share a line
+#define TEXT_RANGE "range:" // Followed by RANGE_PREFIX_HEX hex chars of a password hash
+#define TEXT_RELOAD_FULL "reload_full" // Admin, Unix domain socket only: reload the credentials file in the background
+#define TEXT_RELOAD_DELTA "reload_delta" // Admin, Unix domain socket only: merge the delta file in the background
+#define TEXT_STATS "stats" // Counters and latency percentiles, see stats.h for the reply format
+#define TEXT_EXIT "exit" // Ends the connection
+
+// Binary protocol. Every frame starts with a 16-byte header, integers in network order:
+//   0  magic      BIN_MAGIC (never a printable character, so it cannot start a text request)
+//   1  version    BIN_VERSION
+//   2  op         BIN_OP_*
+//   3  field      request: BIN_FIELD_* / reply: BIN_STATUS_*
+//   4  request_id chosen by the client and echoed in the reply
+//   8  count      number of items in the payload
+//   12 length     payload length in bytes
+// A CHECK_BATCH request carries `count` raw 32-byte digests (64 bytes per item for
+// BIN_FIELD_BOTH and BIN_FIELD_PAIR: username digest then password digest). The reply
+// payload is a bitmap, least significant bit first: bit i is set if item i was found;
+// for BIN_FIELD_BOTH bit 2i is the username and bit 2i+1 the password of item i, and for
+// BIN_FIELD_PAIR bit i is set if item i appeared together on one line (see pair.h). A
+// server whose index has no pair section answers BIN_FIELD_PAIR with UNSUPPORTED.
+// A GET_FILTER request (no payload) asks for the pre-filter of one field; the reply's
+// count is the number of FILTER_BLOCK_SIZE blocks and its payload the filter bits (see
+// filter.h), or the status is UNSUPPORTED if the server runs without filters.
+// Over UDP (see udp.h) each datagram carries exactly one CHECK_BATCH frame of at most
+// BIN_MAX_DATAGRAM bytes and is answered by one datagram; other ops are UNSUPPORTED there.
+#define BIN_MAGIC 0xBC // First byte of every binary frame
+#define BIN_VERSION 1 // Current protocol version
+#define BIN_HEADER_SIZE 16 // Size of the fixed frame header
+#define BIN_MAX_BATCH 4096 // Most items in one CHECK_BATCH frame
+#define BIN_MAX_PAYLOAD (BIN_MAX_BATCH * SHA256_DIGEST_SIZE * 2) // Largest accepted payload
+#define BIN_MAX_DATAGRAM 8192 // Largest UDP request frame: 255 digests or 127 username/password items
+
+#define BIN_OP_CHECK_BATCH 0x01 // Look up `count` digests
+#define BIN_OP_EXIT 0x02 // Close the connection
+#define BIN_OP_GET_FILTER 0x03 // Download the pre-filter of one field
+
+#define BIN_FIELD_USERNAME 0x01 // Digests are usernames/emails
+#define BIN_FIELD_PASSWORD 0x02 // Digests are passwords
+#define BIN_FIELD_BOTH 0x03 // Items are username digest + password digest pairs
+#define BIN_FIELD_PAIR 0x04 // Same items as BOTH, looked up as one exact pair
+
+#define BIN_STATUS_OK 0x00 // Payload holds the answer
+#define BIN_STATUS_BAD_REQUEST 0x01 // Malformed frame, no payload
+#define BIN_STATUS_UNSUPPORTED 0x02 // Unknown version or op, no payload
+
+// Decoded binary frame header
+typedef struct {
+    uint8_t version; // Protocol version
+    uint8_t op; // Operation code
+    uint8_t field; // Field selector in requests, status in replies
+    uint32_t request_id; // Echoed back in the reply
+    uint32_t count; // Number of items
+    uint32_t length; // Payload length in bytes
+} bin_header;
+
+// Serialize a header into the first BIN_HEADER_SIZE bytes of `buf`
+static inline void bin_header_encode(const bin_header *hdr, uint8_t *buf) {
+    buf[0] = BIN_MAGIC;
+    buf[1] = hdr->version;
+    buf[2] = hdr->op;
+    buf[3] = hdr->field;
+    for (int i = 0; i < 4; i++) {
+        buf[4 + i] = (uint8_t)(hdr->request_id >> (24 - i * 8));
+        buf[8 + i] = (uint8_t)(hdr->count >> (24 - i * 8));
+        buf[12 + i] = (uint8_t)(hdr->length >> (24 - i * 8));
+    }
+}
+
+// Parse the first BIN_HEADER_SIZE bytes of `buf`, -1 if the magic byte is wrong
+static inline int bin_header_decode(const uint8_t *buf, bin_header *hdr) {
+    if (buf[0] != BIN_MAGIC) {
+        return -1;
+    }
+    hdr->version = buf[1];
+    hdr->op = buf[2];
+    hdr->field = buf[3];
+    hdr->request_id = hdr->count = hdr->length = 0;
+    for (int i = 0; i < 4; i++) {
+        hdr->request_id = (hdr->request_id << 8) | buf[4 + i];
+        hdr->count = (hdr->count << 8) | buf[8 + i];
+        hdr->length = (hdr->length << 8) | buf[12 + i];
+    }
+    return 0;
+}
+
+// Bytes per CHECK_BATCH item of `field`
+static inline size_t bin_item_size(uint8_t field) {
+    return field == BIN_FIELD_BOTH || field == BIN_FIELD_PAIR ? SHA256_DIGEST_SIZE * 2 : SHA256_DIGEST_SIZE;
+}
+
+// Bytes in the reply bitmap of a CHECK_BATCH with `count` items of `field`
+static inline size_t bin_bitmap_size(uint8_t field, uint32_t count) {
+    size_t bits = (size_t)count * (field == BIN_FIELD_BOTH ? 2 : 1);
+    return (bits + 7) / 8;
+}
+
+// Result of feeding buffered input to protocol_process
+#define PROTO_OK 0 // Keep the connection open
+#define PROTO_CLOSE 1 // Client asked to exit or sent an invalid request
+
+// Growable byte buffer with a consumed prefix, used for socket input and output
+typedef struct {
+    char *data; // Backing storage
+    size_t off; // Bytes already consumed from the front
+    size_t len; // Bytes stored, including the consumed prefix
+    size_t cap; // Bytes allocated
+} byte_buf;
+
+int byte_buf_append(byte_buf *buf, const void *data, size_t len); // Append bytes, 0 on success
+void byte_buf_consume(byte_buf *buf, size_t len); // Drop bytes from the front
+size_t byte_buf_pending(const byte_buf *buf); // Bytes not yet consumed
+void byte_buf_free(byte_buf *buf); // Release the storage
+
+int protocol_process(const cred_index *index, byte_buf *in, byte_buf *out,
+                     int admin); // Answer every complete request in `in`; admin commands only if `admin`
+int protocol_answer_datagram(const cred_index *index, const uint8_t *data, size_t len,
+                             byte_buf *out); // Answer a datagram holding one CHECK_BATCH frame, -1 to drop it
+void protocol_set_reload_hook(void (*hook)(int kind)); // Called with RELOAD_FULL/RELOAD_DELTA by admin commands
+
+#endif
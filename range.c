@@ -0,0 +1,71 @@
+// range.c
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+#include "range.h"
+
+// Bucket of a digest: its first RANGE_PREFIX_HEX hex characters as an integer
+static uint32_t digest_bucket(const uint8_t *digest) {
+    uint32_t top = ((uint32_t)digest[0] << 16) | ((uint32_t)digest[1] << 8) | digest[2];
+    return top >> (24 - RANGE_PREFIX_HEX * 4);
+}
+
+int range_index_build(range_index *ranges, const uint8_t (*digests)[SHA256_DIGEST_SIZE], size_t count) {
+    static const char hex_digits[] = "0123456789abcdef";
+    memset(ranges, 0, sizeof(*ranges));
+    ranges->offsets = calloc(RANGE_BUCKETS + 1, sizeof(*ranges->offsets));
+    if (!ranges->offsets) {
+        return -1;
+    }
+
+    // Digests are sorted, so each bucket is a contiguous run; size every reply first
+    size_t next = 0; // First digest not yet assigned to a bucket
+    size_t size = 0; // Blob bytes so far
+    for (uint32_t b = 0; b < RANGE_BUCKETS; b++) {
+        size_t first = next;
+        while (next < count && digest_bucket(digests[next]) == b) {
+            next++;
+        }
+        ranges->offsets[b] = size;
+        size += snprintf(NULL, 0, "Range %zu\n", next - first) + (next - first) * (RANGE_SUFFIX_HEX + 1);
+    }
+    ranges->offsets[RANGE_BUCKETS] = size;
+
+    ranges->blob = malloc(size + 1); // Room for the last snprintf terminator
+    if (!ranges->blob) {
+        range_index_free(ranges);
+        return -1;
+    }
+
+    next = 0;
+    for (uint32_t b = 0; b < RANGE_BUCKETS; b++) {
+        char *p = ranges->blob + ranges->offsets[b]; // Start of this bucket's reply
+        size_t first = next;
+        while (next < count && digest_bucket(digests[next]) == b) {
+            next++;
+        }
+        p += sprintf(p, "Range %zu\n", next - first);
+        for (size_t i = first; i < next; i++) {
+            for (int h = RANGE_PREFIX_HEX; h < SHA256_DIGEST_SIZE * 2; h++) { // Skip the shared prefix
+                uint8_t byte = digests[i][h / 2];
+                *p++ = hex_digits[h % 2 ? byte & 0x0f : byte >> 4];
+            }
+            *p++ = '\n';
+        }
+    }
+    return 0;
+}
+
+const char *range_index_get(const range_index *ranges, uint32_t prefix, size_t *len) {
+    if (!ranges->offsets || prefix >= RANGE_BUCKETS) {
+        return NULL;
+    }
+    *len = ranges->offsets[prefix + 1] - ranges->offsets[prefix];
+    return ranges->blob + ranges->offsets[prefix];
+}
+
+void range_index_free(range_index *ranges) {
+    free(ranges->blob);
+    free(ranges->offsets);
+    memset(ranges, 0, sizeof(*ranges));
+}
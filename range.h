@@ -0,0 +1,32 @@
+// range.h
+// k-anonymity range queries: a client sends only the first RANGE_PREFIX_HEX hex
+// characters of a password hash and gets back every stored suffix with that prefix,
+// then matches locally, so the server never learns which hash was checked. Replies
+// are built once at load time into one contiguous blob per prefix bucket, so serving
+// a query is a lookup and a copy:
+//   "Range <count>\n" followed by <count> lines of RANGE_SUFFIX_HEX hex characters + "\n"
+// A malformed prefix gets "Range Invalid\n", and a server without ranges "Range Unsupported\n".
+
+#ifndef _RANGE_H_
+#define _RANGE_H_
+
+#include <stddef.h>
+#include <stdint.h>
+#include "sha256_lib.h"
+
+#define RANGE_PREFIX_HEX 5 // Hex characters in a query prefix
+#define RANGE_SUFFIX_HEX (SHA256_DIGEST_SIZE * 2 - RANGE_PREFIX_HEX) // Hex characters per returned suffix
+#define RANGE_BUCKETS (1u << (RANGE_PREFIX_HEX * 4)) // One bucket per prefix
+
+// Precomputed replies for every prefix bucket
+typedef struct {
+    char *blob; // All replies back to back, in prefix order
+    size_t *offsets; // RANGE_BUCKETS + 1 offsets into blob, NULL if not built
+} range_index;
+
+int range_index_build(range_index *ranges, const uint8_t (*digests)[SHA256_DIGEST_SIZE],
+                      size_t count); // Build from sorted digests, 0 on success
+const char *range_index_get(const range_index *ranges, uint32_t prefix, size_t *len); // Reply for one bucket
+void range_index_free(range_index *ranges); // Release the replies
+
+#endif
@@ -0,0 +1,237 @@
+// reactor.c
+#define _GNU_SOURCE // accept4
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+#include <errno.h>
+#include <unistd.h>
+#include <pthread.h>
+#include <sys/epoll.h>
+#include <sys/socket.h>
+#include <netinet/in.h>
+#include <netinet/tcp.h>
+#include "net.h"
+#include "cred_store.h"
+#include "protocol.h"
+#include "stats.h"
+#include "reactor.h"
+
+#define MAX_EVENTS 256 // Events handled per epoll_wait call
+#define READ_CHUNK 16384 // Bytes read per recv call
+#define MAX_PENDING_OUTPUT (1 << 20) // Stop reading from a client that is not draining replies
+
+static char unix_listener; // Its address marks the Unix domain socket in epoll events
+
+// State of one client connection
+typedef struct {
+    int fd; // Client socket
+    byte_buf in; // Received bytes not yet forming a complete request
+    byte_buf out; // Replies not yet sent
+    int closing; // Close once `out` has been flushed
+    int admin; // Accepted on the Unix domain socket, so reload commands are allowed
+} connection;
+
+// One event-loop thread
+typedef struct {
+    int reader_slot; // This thread's cred_store reader slot
+    int listen_fd; // This thread's SO_REUSEPORT listening socket
+    int unix_fd; // Unix domain socket shared by every thread, -1 if none
+    int epoll_fd; // This thread's epoll set
+    pthread_t thread; // Thread running the loop
+} reactor;
+
+static void conn_close(reactor *r, connection *c) {
+    epoll_ctl(r->epoll_fd, EPOLL_CTL_DEL, c->fd, NULL);
+    close(c->fd); // Close the client socket
+    byte_buf_free(&c->in);
+    byte_buf_free(&c->out);
+    free(c);
+    stats_connection(0);
+}
+
+// Send as much pending output as the socket accepts, -1 on a fatal error
+static int conn_flush(connection *c) {
+    while (byte_buf_pending(&c->out) > 0) {
+        ssize_t sent = send(c->fd, c->out.data + c->out.off, byte_buf_pending(&c->out), MSG_NOSIGNAL);
+        if (sent > 0) {
+            byte_buf_consume(&c->out, sent);
+            stats_bytes(0, sent);
+        } else if (sent < 0 && errno == EINTR) {
+            continue;
+        } else if (sent < 0 && (errno == EAGAIN || errno == EWOULDBLOCK)) {
+            return 0; // Kernel buffer full, EPOLLOUT will resume
+        } else {
+            return -1;
+        }
+    }
+    return 0;
+}
+
+// Read everything available, answer complete requests and flush replies. Edge-triggered
+// events only come back once recv or send has said EAGAIN, so this returns only after
+// one of them has, or when the connection is closing
+static void conn_service(reactor *r, const cred_index *index, connection *c) {
+    char chunk[READ_CHUNK]; // Buffer to hold data from the client
+
+    while (1) {
+        int drained = 0; // recv said EAGAIN, the next EPOLLIN edge brings more requests
+        while (!c->closing && byte_buf_pending(&c->out) < MAX_PENDING_OUTPUT) {
+            ssize_t valread = recv(c->fd, chunk, sizeof(chunk), 0);
+            if (valread > 0) {
+                stats_bytes(valread, 0);
+                if (byte_buf_append(&c->in, chunk, valread) != 0 ||
+                    protocol_process(index, &c->in, &c->out, c->admin) == PROTO_CLOSE) {
+                    c->closing = 1; // Exit request, bad request or out of memory
+                }
+            } else if (valread == 0) {
+                c->closing = 1; // Client hung up
+            } else if (errno == EINTR) {
+                continue;
+            } else if (errno == EAGAIN || errno == EWOULDBLOCK) {
+                drained = 1; // Wait for the next edge
+                break;
+            } else {
+                conn_close(r, c); // Connection reset or similar
+                return;
+            }
+        }
+
+        if (conn_flush(c) != 0 || (c->closing && byte_buf_pending(&c->out) == 0)) {
+            conn_close(r, c);
+            return;
+        }
+        if (drained || c->closing || byte_buf_pending(&c->out) > 0) {
+            return; // EPOLLIN or EPOLLOUT resumes; unsent output means send said EAGAIN
+        }
+        // Reading paused at the output limit and the flush sent everything without EAGAIN,
+        // so no edge will report the requests still in the socket: read them now
+    }
+}
+
+// Accept every pending connection on a listening socket
+static void accept_clients(reactor *r, int listen_fd) {
+    while (1) {
+        int client_sock = accept4(listen_fd, NULL, NULL, SOCK_NONBLOCK | SOCK_CLOEXEC);
+        if (client_sock < 0) {
+            if (errno == EINTR || errno == ECONNABORTED) {
+                continue;
+            }
+            if (errno != EAGAIN && errno != EWOULDBLOCK) {
+                perror("Accept failed"); // Out of descriptors etc.; retry on the next event
+            }
+            return;
+        }
+
+        if (listen_fd == r->listen_fd) {
+            int opt = 1; // Replies are tiny, do not hold them back for coalescing
+            setsockopt(client_sock, IPPROTO_TCP, TCP_NODELAY, &opt, sizeof(opt));
+        }
+
+        connection *c = calloc(1, sizeof(*c));
+        if (!c) {
+            close(client_sock);
+            continue;
+        }
+        c->fd = client_sock;
+        c->admin = listen_fd == r->unix_fd; // Reachable only by local users the socket file lets in
+
+        struct epoll_event ev;
+        ev.events = EPOLLIN | EPOLLOUT | EPOLLRDHUP | EPOLLET; // Edge-triggered, registered once
+        ev.data.ptr = c;
+        if (epoll_ctl(r->epoll_fd, EPOLL_CTL_ADD, client_sock, &ev) < 0) {
+            perror("epoll_ctl");
+            close(client_sock);
+            free(c);
+            continue;
+        }
+        stats_connection(1);
+    }
+}
+
+static void *reactor_loop(void *arg) {
+    reactor *r = arg;
+    struct epoll_event events[MAX_EVENTS];
+
+    while (1) {
+        int n = epoll_wait(r->epoll_fd, events, MAX_EVENTS, -1); // Idle here, outside any reader burst
+        if (n < 0) {
+            if (errno == EINTR) {
+                continue;
+            }
+            perror("epoll_wait");
+            exit(EXIT_FAILURE);
+        }
+
+        const cred_index *index = cred_store_enter(r->reader_slot); // Fixed for this batch of events
+        for (int i = 0; i < n; i++) {
+            if (events[i].data.ptr == NULL) { // The listening socket
+                accept_clients(r, r->listen_fd);
+            } else if (events[i].data.ptr == &unix_listener) {
+                accept_clients(r, r->unix_fd); // Another thread may have taken it, accept4 then says EAGAIN
+            } else {
+                conn_service(r, index, events[i].data.ptr);
+            }
+        }
+        cred_store_leave(r->reader_slot); // Lets a reload free the index we just used
+    }
+    return NULL;
+}
+
+int reactor_run(int port, int unix_fd, int threads) {
+    reactor *reactors = calloc(threads, sizeof(*reactors));
+    if (!reactors) {
+        return -1;
+    }
+
+    // Set up every listener before starting any thread so bind errors surface at startup
+    for (int i = 0; i < threads; i++) {
+        reactor *r = &reactors[i];
+        r->reader_slot = cred_store_register();
+        if (r->reader_slot < 0) {
+            fprintf(stderr, "Too many threads\n");
+            return -1;
+        }
+        r->listen_fd = tcp_listen(port, SOMAXCONN);
+        if (r->listen_fd < 0 || set_nonblocking(r->listen_fd) < 0) {
+            return -1;
+        }
+        r->epoll_fd = epoll_create1(EPOLL_CLOEXEC);
+        if (r->epoll_fd < 0) {
+            perror("epoll_create1");
+            return -1;
+        }
+
+        struct epoll_event ev;
+        ev.events = EPOLLIN; // Level-triggered so a backlog is drained across iterations
+        ev.data.ptr = NULL; // Marks the listening socket
+        if (epoll_ctl(r->epoll_fd, EPOLL_CTL_ADD, r->listen_fd, &ev) < 0) {
+            perror("epoll_ctl");
+            return -1;
+        }
+
+        r->unix_fd = unix_fd;
+        ev.events = EPOLLIN | EPOLLEXCLUSIVE; // Shared by every thread, wake one per connection
+        ev.data.ptr = &unix_listener;
+        if (unix_fd >= 0 && epoll_ctl(r->epoll_fd, EPOLL_CTL_ADD, unix_fd, &ev) < 0) {
+            perror("epoll_ctl");
+            return -1;
+        }
+    }
+    if (unix_fd >= 0 && set_nonblocking(unix_fd) < 0) {
+        return -1;
+    }
+
+    printf("Server listening on port %d with %d event-loop threads\n", port, threads); // Print server listening message
+    fflush(stdout);
+
+    for (int i = 0; i < threads; i++) {
+        if (pthread_create(&reactors[i].thread, NULL, reactor_loop, &reactors[i]) != 0) {
+            perror("pthread_create");
+            return -1;
+        }
+    }
+    for (int i = 0; i < threads; i++) {
+        pthread_join(reactors[i].thread, NULL);
+    }
+    return 0;
+}
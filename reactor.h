@@ -0,0 +1,13 @@
+// reactor.h
+// Multi-threaded non-blocking server: each thread owns an epoll set and its own
+// SO_REUSEPORT listening socket, so the kernel spreads new connections across threads
+// and no lock is taken on the request path. All threads share the read-only index
+// published through cred_store, re-reading it after every epoll_wait. A Unix domain
+// socket for same-host clients, if given, is watched by every thread.
+
+#ifndef _REACTOR_H_
+#define _REACTOR_H_
+
+int reactor_run(int port, int unix_fd, int threads); // Serve until the process exits, -1 on setup error; unix_fd may be -1
+
+#endif
@@ -0,0 +1,154 @@
+// reload.c
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+#include <errno.h>
+#include <time.h>
+#include <unistd.h>
+#include <fcntl.h>
+#include <signal.h>
+#include <pthread.h>
+#include "cred_store.h"
+#include "log.h"
+#include "reload.h"
+
+static int wake_pipe[2] = {-1, -1}; // Pending requests, one byte each
+static const reload_config *config;
+static cred_index *file_index; // The credentials file alone, kept to merge delta files into; reload thread only
+
+// Log what searching each set keeps in memory
+static void report_memory(const cred_index *index, int huge_pages) {
+    const digest_set *sets[2] = {&index->usernames, &index->passwords};
+    double mb[2], per_hash[2];
+    for (int f = 0; f < 2; f++) {
+        size_t bytes = digest_set_memory(sets[f]);
+        mb[f] = bytes / 1e6;
+        per_hash[f] = sets[f]->count ? (double)bytes / sets[f]->count : 0;
+    }
+    LOG(LOG_INFO, "Memory: usernames %.1f MB (%.2f bytes/hash), passwords %.1f MB (%.2f bytes/hash), "
+        "pairs %.1f MB%s%s%s",
+        mb[0], per_hash[0], mb[1], per_hash[1], pair_set_memory(&index->pairs) / 1e6,
+        index->pairs.indexed ? "" : " (none indexed)",
+        index->usernames.compact.high ? ", full digests paged from disk" : "", huge_pages ? ", huge pages" : "");
+}
+
+cred_index *reload_build(const reload_config *cfg, int full) {
+    int delta = cfg->delta_path && access(cfg->delta_path, R_OK) == 0; // The served set is always file + delta
+    cred_index *loaded = NULL; // The credentials file, if it has to be opened
+    if (full || !delta || !file_index) {
+        if (!(loaded = malloc(sizeof(*loaded)))) {
+            return NULL;
+        }
+        if (cred_index_open_shard(loaded, cfg->path, cfg->shards, cfg->shard) != 0) { // Map an index file, or parse a text file
+            free(loaded);
+            return NULL;
+        }
+    }
+    cred_index *index = loaded; // Served as it is without a delta file
+    if (delta) {
+        index = malloc(sizeof(*index));
+        if (!index || cred_index_apply_delta(index, loaded ? loaded : file_index, cfg->delta_path, cfg->shards,
+                                             cfg->shard) != 0) {
+            free(index);
+            index = NULL;
+        }
+    }
+    if (index &&
+        ((cfg->filter_bits && cred_index_build_filters(index, cfg->filter_bits) != 0) || // Pre-filter negatives
+         (cfg->ranges && cred_index_build_ranges(index) != 0) || // Serve range: queries
+         (cfg->compact && cred_index_build_compact(index) != 0) || // Last, so the digests are left paged out
+         (cfg->huge_pages && cred_index_place(index, cfg->numa_node) != 0))) { // Once every array exists
+        if (index != loaded) { // Otherwise freed below
+            cred_index_free(index);
+            free(index);
+        }
+        index = NULL;
+    }
+    if (!index) {
+        if (loaded) {
+            int saved = errno;
+            cred_index_free(loaded);
+            free(loaded);
+            errno = saved;
+        }
+        return NULL;
+    }
+    if (loaded) { // Replace the file the next delta is merged into
+        if (file_index) {
+            cred_index_free(file_index);
+            free(file_index);
+        }
+        file_index = delta ? loaded : NULL; // Without a delta file it is the served index itself
+    }
+    report_memory(index, cfg->huge_pages);
+    return index;
+}
+
+void reload_request(int kind) {
+    char byte = (char)kind;
+    int saved = errno; // May run in a signal handler
+    if (wake_pipe[1] >= 0 && write(wake_pipe[1], &byte, 1) < 0) {
+        // Pipe full: enough requests are already queued
+    }
+    errno = saved;
+}
+
+static void reload_signal(int sig) {
+    reload_request(sig == SIGHUP ? RELOAD_FULL : RELOAD_DELTA);
+}
+
+static void *reload_loop(void *arg) {
+    (void)arg;
+    while (1) {
+        char kinds[64]; // Everything requested so far
+        ssize_t n = read(wake_pipe[0], kinds, sizeof(kinds));
+        if (n < 0 && errno == EINTR) {
+            continue;
+        }
+        if (n <= 0) {
+            return NULL;
+        }
+        int full = memchr(kinds, RELOAD_FULL, n) != NULL; // A full reload also applies the delta file
+        if (!full && !config->delta_path) {
+            LOG(LOG_WARN, "Delta reload requested but no delta file was given (-d)");
+            continue;
+        }
+
+        struct timespec start, end;
+        clock_gettime(CLOCK_MONOTONIC, &start);
+        cred_index *next = reload_build(config, full);
+        if (!next) {
+            LOG(LOG_ERROR, "%s failed, keeping the current credentials: %s", full ? "Reload" : "Delta", strerror(errno));
+            continue;
+        }
+        cred_store_publish(next); // Returns once no reader can see the old index
+        clock_gettime(CLOCK_MONOTONIC, &end);
+        LOG(LOG_INFO, "%s: %zu username and %zu password hashes, %zu pairs, swapped in %.3f seconds",
+               full ? "Reloaded" : "Applied delta", next->usernames.count, next->passwords.count, next->pairs.count,
+               (end.tv_sec - start.tv_sec) + (end.tv_nsec - start.tv_nsec) / 1e9);
+    }
+}
+
+int reload_start(const reload_config *cfg) {
+    config = cfg;
+    if (pipe(wake_pipe) != 0) {
+        return -1;
+    }
+    fcntl(wake_pipe[1], F_SETFL, O_NONBLOCK); // Never block a signal handler
+    fcntl(wake_pipe[0], F_SETFD, FD_CLOEXEC);
+    fcntl(wake_pipe[1], F_SETFD, FD_CLOEXEC);
+
+    pthread_t thread;
+    if (pthread_create(&thread, NULL, reload_loop, NULL) != 0) {
+        return -1;
+    }
+    pthread_detach(thread);
+
+    struct sigaction sa;
+    memset(&sa, 0, sizeof(sa));
+    sa.sa_handler = reload_signal;
+    sa.sa_flags = SA_RESTART; // Keep blocking accept/read calls going
+    sigaction(SIGHUP, &sa, NULL);
+    sigaction(SIGUSR1, &sa, NULL);
+    return 0;
+}
@@ -0,0 +1,37 @@
+// reload.h
+// Background rebuilding of the credential index. The served set is the credentials
+// file plus the delta file, if there is one. SIGHUP or the "reload_full" command reloads
+// both; SIGUSR1 or "reload_delta" merges the delta file again into the credentials
+// file's index, kept from the last full load, which is a linear pass instead of a parse
+// and sort of the whole corpus, and never applies the lines of an edited delta file
+// twice. Either way the new index, with its filters and range replies, is built on the
+// reload thread and swapped in through cred_store, so lookups never pause and in-flight
+// ones finish on the old index. Requests arriving during a rebuild are coalesced into
+// one more rebuild.
+
+#ifndef _RELOAD_H_
+#define _RELOAD_H_
+
+#include "cred_index.h"
+
+#define RELOAD_FULL 'F' // Reload the credentials file
+#define RELOAD_DELTA 'D' // Merge the delta file
+
+// What to build and from where
+typedef struct {
+    const char *path; // Credentials file or index file
+    const char *delta_path; // Delta file, NULL if delta reloads are disabled
+    int filter_bits; // Bits per key of the pre-filters, 0 for none
+    int ranges; // Build range replies
+    int compact; // Search through compressed directories, leaving full digests on disk
+    int huge_pages; // Move the searched arrays to huge pages
+    int numa_node; // NUMA node to bind them to, -1 for none
+    const shard_map *shards; // Shard map of a sharded deployment, NULL to serve every digest
+    int shard; // Index of this server's shard in `shards`
+} reload_config;
+
+cred_index *reload_build(const reload_config *cfg, int full); // File + delta, reopening the file if `full`
+int reload_start(const reload_config *cfg); // Start the reload thread and signal handlers, 0 on success
+void reload_request(int kind); // Ask for a RELOAD_FULL or RELOAD_DELTA; async-signal-safe
+
+#endif
@@ -0,0 +1,103 @@
+// search.h
+// Interpolation search over a sorted array of fixed-width records whose first 8 bytes,
+// read big-endian, are uniformly distributed: SHA-256 digests in a digest set and pair
+// fingerprints in a pair set. The position of a record is guessed from those leading
+// bytes, which lands within a few slots of the target, and after SEARCH_INTERPOLATION_STEPS
+// probes the search falls back to plain halving so a skewed array cannot make it linear.
+//
+// A search is a small state advanced one probe at a time, so a batch of searches can
+// be run in turns with each one's next probe prefetched (see cred_index.c). The
+// functions are inline because that loop is the hottest code of the server.
+
+#ifndef _SEARCH_H_
+#define _SEARCH_H_
+
+#include <stddef.h>
+#include <stdint.h>
+#include <string.h>
+
+#define SEARCH_INTERPOLATION_STEPS 8 // Probes before falling back to plain binary search
+
+// Position of one search, so several searches can be advanced in turns
+typedef struct {
+    size_t lo, hi; // Inclusive window still to search
+    size_t mid; // Slot to probe next
+    uint64_t key; // Leading bits of the record searched for
+    int step; // Probes made so far
+} search_state;
+
+// First 8 bytes of a record as a big-endian integer
+static inline uint64_t search_key(const uint8_t *record) {
+    uint64_t key = 0;
+    for (int i = 0; i < 8; i++) {
+        key = (key << 8) | record[i];
+    }
+    return key;
+}
+
+// Choose the next slot to probe in the window, 0 if the record cannot be in it
+static inline int search_next(const uint8_t *records, size_t width, search_state *s) {
+    if (s->lo > s->hi) {
+        return 0;
+    }
+    if (s->step >= SEARCH_INTERPOLATION_STEPS) { // Binary search bounds the worst case if interpolation has not converged
+        s->mid = s->lo + (s->hi - s->lo) / 2;
+        return 1;
+    }
+
+    uint64_t lo_key = search_key(records + s->lo * width);
+    uint64_t hi_key = search_key(records + s->hi * width);
+    if (s->key < lo_key || s->key > hi_key) {
+        return 0; // Outside the window, cannot be present
+    }
+    s->mid = s->lo;
+    if (hi_key > lo_key) {
+        s->mid += (size_t)((unsigned __int128)(s->key - lo_key) * (s->hi - s->lo) / (hi_key - lo_key));
+    }
+    return 1;
+}
+
+// Start a search for `target` among `count` records, 0 if it cannot be there
+static inline int search_start(const uint8_t *records, size_t width, size_t count, const uint8_t *target,
+                               search_state *s) {
+    if (count == 0) {
+        return 0;
+    }
+    s->lo = 0;
+    s->hi = count - 1;
+    s->key = search_key(target);
+    s->step = 0;
+    return search_next(records, width, s);
+}
+
+// Probe the chosen slot and narrow the window: 1 if found, 0 if absent, -1 to continue
+static inline int search_step(const uint8_t *records, size_t width, const uint8_t *target, search_state *s) {
+    int cmp = memcmp(target, records + s->mid * width, width);
+    s->step++;
+    if (cmp == 0) {
+        return 1;
+    }
+    if (cmp < 0) {
+        if (s->mid == 0) {
+            return 0; // Below the first record
+        }
+        s->hi = s->mid - 1;
+    } else {
+        s->lo = s->mid + 1;
+    }
+    return search_next(records, width, s) ? -1 : 0;
+}
+
+// Run one search to the end: 1 if `target` is among the records
+static inline int search_find(const uint8_t *records, size_t width, size_t count, const uint8_t *target) {
+    search_state s;
+    if (!search_start(records, width, count, target, &s)) {
+        return 0;
+    }
+    int found;
+    while ((found = search_step(records, width, target, &s)) < 0) {
+    }
+    return found;
+}
+
+#endif
@@ -2,194 +2,325 @@
 #include <stdlib.h> // Standard library for memory allocation, process control, etc.
 #include <string.h> // String handling functions
 #include <unistd.h> // POSIX API for Unix-like systems
-#include <arpa/inet.h> // Definitions for internet operations
 #include <signal.h> // Signal handling
+#include <errno.h> // Error codes
+#include <sys/socket.h> // Socket API
+#include <pthread.h> // Stats dump thread
+#include <time.h> // nanosleep
 #include "sha256_lib.h" // Custom SHA-256 library
+#include "cred_index.h" // Sorted binary digest sets
+#include "protocol.h" // Request parsing and replies
+#include "reactor.h" // Multi-threaded epoll server
+#include "uring.h" // io_uring server
+#include "shm_server.h" // Shared-memory transport for same-host clients
+#include "udp.h" // Connectionless single-datagram queries
+#include "net.h" // Socket setup helpers
+#include "cred_store.h" // Index currently being served
+#include "reload.h" // Background reloads
+#include "shard.h" // Sharded deployments
+#include "stats.h" // Request counters and latency histograms
+#include "log.h" // Asynchronous leveled logging
+#include "hugemem.h" // Huge-page placement of the index
 
 #define BUFFER_SIZE 1024 // Buffer size for reading data
-#define MAX_CREDENTIALS 1000000 // Maximum number of credentials
 
-char credentials[MAX_CREDENTIALS][SHA256_DIGEST_SIZE * 2 + 1]; // Array to store credentials
-int credential_count = 0; // Counter for the number of credentials
-int server_fd; // Server file descriptor
+reload_config credentials; // Where the served credentials come from and what to build
+int server_fd = -1; // Server file descriptor (blocking mode)
 
-void load_credentials(const char *filename); // Function to load credentials from a file
+// Backend the serving thread runs
+typedef struct {
+    int port; // TCP port
+    int unix_fd; // Listening Unix domain socket, -1 if none
+    int threads; // Event-loop threads
+    int blocking; // Serve one client at a time instead of running event loops
+    int use_uring; // Run io_uring loops instead of epoll loops
+} serve_config;
+int reader_slot = -1; // cred_store slot of the blocking accept loop
+shard_map shards; // Shard map of a sharded deployment, empty otherwise
+
+void load_credentials(void); // Function to load credentials and start serving them
 void handle_client(int client_sock); // Function to handle client connections
-void sigint_handler(int sig); // Signal handler for SIGINT
+void print_filter_stats(const char *name, const digest_filter *filter); // Report pre-filter effectiveness
+void *dump_stats(void *arg); // Print a stats snapshot every `*(double *)arg` seconds
+void *serve(void *arg); // Run the backend chosen by the flags; exits the process if it stops
+void serve_blocking(int port); // Accept and answer one client at a time
+void shutdown_server(int sig); // Report the filter counters and exit, outside any signal handler
 
 int main(int argc, char *argv[]) {
-    if (argc != 3) { // Check if the correct number of arguments is provided
-        fprintf(stderr, "Usage: %s <port> <credentials_file>\n", argv[0]);
+    int blocking = 0; // Serve one client at a time instead of running event loops
+    int use_uring = 0; // Run io_uring loops instead of epoll loops
+    long threads = sysconf(_SC_NPROCESSORS_ONLN); // One event loop per core by default
+    const char *shard_map_file = NULL; // Serve one shard of this map
+    const char *shard_name = NULL; // Name of the shard to serve
+    const char *unix_path = NULL; // Also listen on this Unix domain socket
+    const char *shm_path = NULL; // Attach socket of the shared-memory transport
+    int use_udp = 0; // Also answer UDP datagrams on the port
+    static double dump_interval = 0; // Seconds between stats dumps, 0 for none
+    credentials.numa_node = -1; // Memory from any node unless -N
+    int opt;
+    while ((opt = getopt(argc, argv, "m:t:frcd:s:n:l:S:u:x:UHN:")) != -1) { // Parse optional flags
+        if (opt == 'm' && strcmp(optarg, "blocking") == 0) {
+            blocking = 1;
+        } else if (opt == 'm' && strcmp(optarg, "epoll") == 0) {
+            blocking = use_uring = 0;
+        } else if (opt == 'm' && strcmp(optarg, "uring") == 0) {
+            blocking = 0;
+            use_uring = 1;
+        } else if (opt == 't' && atoi(optarg) > 0) {
+            threads = atoi(optarg);
+        } else if (opt == 'f') {
+            credentials.filter_bits = FILTER_BITS_PER_KEY;
+        } else if (opt == 'r') {
+            credentials.ranges = 1;
+        } else if (opt == 'c') {
+            credentials.compact = 1;
+        } else if (opt == 'd') {
+            credentials.delta_path = optarg;
+        } else if (opt == 's') {
+            shard_map_file = optarg;
+        } else if (opt == 'n') {
+            shard_name = optarg;
+        } else if (opt == 'l' && log_parse_level(optarg) >= 0) {
+            log_level = log_parse_level(optarg);
+        } else if (opt == 'S' && atof(optarg) > 0) {
+            dump_interval = atof(optarg);
+        } else if (opt == 'u') {
+            unix_path = optarg;
+        } else if (opt == 'x') {
+            shm_path = optarg;
+        } else if (opt == 'U') {
+            use_udp = 1;
+        } else if (opt == 'H') {
+            credentials.huge_pages = 1;
+        } else if (opt == 'N' && atoi(optarg) >= 0) {
+            credentials.huge_pages = 1; // Binding goes with the move to huge pages
+            credentials.numa_node = atoi(optarg);
+        } else {
+            argc = 0; // Force the usage message
+            break;
+        }
+    }
+
+    if (argc - optind != 2 || !shard_map_file != !shard_name || (blocking && unix_path)) { // Check if the correct number of arguments is provided
+        fprintf(stderr, "Usage: %s [-m blocking|epoll|uring] [-t threads] [-f] [-r] [-c] [-d delta_file] [-s shard_map -n shard]\n"
+                        "          [-l error|warn|info|debug] [-S seconds] [-u unix_socket] [-x shm_socket] [-U] [-H] [-N numa_node]\n"
+                        "          <port> <credentials_file>\n"
+                        "       -u needs -m epoll or -m uring\n", argv[0]);
         exit(EXIT_FAILURE); // Exit if arguments are incorrect
     }
 
-    int port = atoi(argv[1]); // Convert port argument to integer
-    const char *credentials_file = argv[2]; // Get the credentials file path
+    // Every thread started from here on inherits SIGINT blocked, so only the sigwait at the
+    // end of main sees it and the shutdown report never runs inside a signal handler
+    sigset_t stop_signals;
+    sigemptyset(&stop_signals);
+    sigaddset(&stop_signals, SIGINT);
+    pthread_sigmask(SIG_BLOCK, &stop_signals, NULL);
+
+    int port = atoi(argv[optind]); // Convert port argument to integer
+    credentials.path = argv[optind + 1]; // Get the credentials file path
+    if (credentials.huge_pages && !hugemem_available()) {
+        fprintf(stderr, "Transparent huge pages are disabled; -H only moves the index to aligned memory\n");
+    }
+    if (threads < 1) {
+        threads = 1;
+    }
+    if (shard_map_file) { // Hold only the digests this shard owns
+        if (shard_map_load(&shards, shard_map_file) != 0) {
+            perror("Failed to load shard map");
+            exit(EXIT_FAILURE);
+        }
+        credentials.shards = &shards;
+        if ((credentials.shard = shard_map_find(&shards, shard_name)) < 0) {
+            fprintf(stderr, "Shard %s is not in %s\n", shard_name, shard_map_file);
+            exit(EXIT_FAILURE);
+        }
+        printf("Serving shard %s (%d of %d)\n", shard_name, credentials.shard + 1, shards.count);
+    }
 
-    load_credentials(credentials_file); // Load credentials from the file
+    stats_init(); // Uptime counts from startup, not from the first request
+    load_credentials(); // Load credentials from the file
+    if (reload_start(&credentials) != 0) { // SIGHUP/SIGUSR1 and admin commands rebuild in the background
+        perror("Failed to start reload thread");
+        exit(EXIT_FAILURE);
+    }
+    protocol_set_reload_hook(reload_request);
+    if (log_start() != 0) { // Requests log through a ring buffer from here on
+        perror("Failed to start log thread");
+        exit(EXIT_FAILURE);
+    }
+    pthread_t dump_thread;
+    if (dump_interval > 0 && pthread_create(&dump_thread, NULL, dump_stats, &dump_interval) != 0) {
+        perror("Failed to start stats thread");
+        exit(EXIT_FAILURE);
+    }
 
-    struct sockaddr_in address; // Structure to hold server address
-    int addrlen = sizeof(address); // Length of the address structure
+    signal(SIGPIPE, SIG_IGN); // A client hanging up mid-reply must not kill the server
 
-    // Create socket
-    if ((server_fd = socket(AF_INET, SOCK_STREAM, 0)) == 0) {
-        perror("Socket failed"); // Print error if socket creation fails
-        exit(EXIT_FAILURE); // Exit if socket creation fails
+    if (shm_path && shm_server_start(shm_path) != 0) { // Runs beside any of the socket backends
+        exit(EXIT_FAILURE);
+    }
+    if (use_udp && udp_start(port, (int)threads) != 0) { // So does the UDP listener
+        exit(EXIT_FAILURE);
+    }
+    int unix_fd = -1; // Shared by the event-loop threads
+    if (unix_path && (unix_fd = unix_listen(unix_path, SOMAXCONN)) < 0) {
+        exit(EXIT_FAILURE);
+    }
+    if (unix_path) {
+        printf("Also listening on %s\n", unix_path);
     }
 
-    // Set socket options to reuse port
-    int opt = 1;
-    if (setsockopt(server_fd, SOL_SOCKET, SO_REUSEADDR | SO_REUSEPORT, &opt, sizeof(opt))) {
-        perror("setsockopt"); // Print error if setting socket options fails
-        exit(EXIT_FAILURE); // Exit if setting socket options fails
+    static serve_config serving; // Read by the serving thread
+    serving.port = port;
+    serving.unix_fd = unix_fd;
+    serving.threads = (int)threads;
+    serving.blocking = blocking;
+    serving.use_uring = use_uring;
+    pthread_t serve_thread;
+    if (pthread_create(&serve_thread, NULL, serve, &serving) != 0) {
+        perror("Failed to start serving thread");
+        exit(EXIT_FAILURE);
     }
 
-    // Bind to port
-    address.sin_family = AF_INET; // Set address family to Internet
-    address.sin_addr.s_addr = INADDR_ANY; // Accept connections from any IP address
-    address.sin_port = htons(port); // Set port number
+    int sig;
+    sigwait(&stop_signals, &sig); // The main thread only waits for SIGINT
+    shutdown_server(sig);
+    return 0; // Return 0 to indicate successful execution
+}
 
-    if (bind(server_fd, (struct sockaddr *)&address, sizeof(address)) < 0) {
-        perror("Bind failed"); // Print error if binding fails
-        exit(EXIT_FAILURE); // Exit if binding fails
+void *serve(void *arg) {
+    const serve_config *cfg = arg;
+    if (cfg->use_uring) {
+        if (uring_run(cfg->port, cfg->unix_fd, cfg->threads) != 0) { // Serve on per-core io_uring loops
+            exit(EXIT_FAILURE);
+        }
+    } else if (!cfg->blocking) {
+        if (reactor_run(cfg->port, cfg->unix_fd, cfg->threads) != 0) { // Serve on per-core epoll loops
+            exit(EXIT_FAILURE); // Exit if the listeners could not be set up
+        }
+    } else {
+        serve_blocking(cfg->port);
     }
+    exit(0); // The loops never return once they are running
+}
 
-    // Listen for connections
-    if (listen(server_fd, 3) < 0) {
-        perror("Listen failed"); // Print error if listening fails
-        exit(EXIT_FAILURE); // Exit if listening fails
+void serve_blocking(int port) {
+    if ((reader_slot = cred_store_register()) < 0) {
+        fprintf(stderr, "Too many threads\n");
+        exit(EXIT_FAILURE);
+    }
+    if ((server_fd = tcp_listen(port, SOMAXCONN)) < 0) { // Create, bind and listen
+        exit(EXIT_FAILURE); // Exit if the socket could not be set up
     }
-
-    signal(SIGINT, sigint_handler); // Set up signal handler for SIGINT
 
     printf("Server listening on port %d\n", port); // Print server listening message
 
     while (1) { // Infinite loop to accept and handle client connections
         int client_sock;
-        if ((client_sock = accept(server_fd, (struct sockaddr *)&address, (socklen_t*)&addrlen)) < 0) {
+        if ((client_sock = accept(server_fd, NULL, NULL)) < 0) {
+            if (errno == EINTR) {
+                continue; // Interrupted by a signal, keep accepting
+            }
             perror("Accept failed"); // Print error if accepting connection fails
             exit(EXIT_FAILURE); // Exit if accepting connection fails
         }
 
+        stats_connection(1);
         handle_client(client_sock); // Handle the client connection
         close(client_sock); // Close the client socket
+        stats_connection(0);
     }
-
-    return 0; // Return 0 to indicate successful execution
 }
 
-void load_credentials(const char *filename) {
-    FILE *file = fopen(filename, "r"); // Open the credentials file for reading
-    if (!file) {
-        perror("Failed to open credentials file"); // Print error if file opening fails
-        exit(EXIT_FAILURE); // Exit if file opening fails
-    }
-
-    char line[BUFFER_SIZE]; // Buffer to hold each line from the file
-    while (fgets(line, sizeof(line), file) && credential_count < MAX_CREDENTIALS) {
-        line[strcspn(line, "\n")] = 0; // Remove newline character from the line
-
-        // Split the line by ':' and store each part as a separate credential
-        char *token = strtok(line, ":");
-        while (token != NULL && credential_count < MAX_CREDENTIALS) {
-            strcpy(credentials[credential_count++], token); // Copy token to credentials array
-            token = strtok(NULL, ":"); // Get the next token
-        }
+void load_credentials(void) {
+    cred_index *index = reload_build(&credentials, 1); // Parse or map, then build filters and ranges
+    if (!index) {
+        perror("Failed to load credentials file"); // Print error if loading fails
+        exit(EXIT_FAILURE); // Exit if loading fails
     }
-
-    fclose(file); // Close the file
+    printf("%s %zu username and %zu password hashes and %zu pairs\n",
+           index->map ? "Mapped" : "Loaded",
+           index->usernames.count, index->passwords.count, index->pairs.count); // Print index sizes
+    cred_store_init(index); // Serve it
 }
 
 void handle_client(int client_sock) {
     char buffer[BUFFER_SIZE]; // Buffer to hold data from the client
-    int valread; // Number of bytes read from the client
-    int check_username = 0; // Flag to check username
-    int check_password = 0; // Flag to check password
-    int check_both = 0; // Flag to check both username and password
-    char username_hash[SHA256_DIGEST_SIZE * 2 + 1] = {0}; // Buffer to hold username hash
-    char password_hash[SHA256_DIGEST_SIZE * 2 + 1] = {0}; // Buffer to hold password hash
+    ssize_t valread; // Number of bytes read from the client
+    byte_buf in = {0}; // Received bytes not yet forming a complete request
+    byte_buf out = {0}; // Replies to send back
 
     while ((valread = read(client_sock, buffer, BUFFER_SIZE)) > 0) { // Read data from the client
-        buffer[valread] = '\0'; // Null-terminate the buffer
-
-        if (strncmp(buffer, "exit", 4) == 0) { // Check if the client wants to exit
-            break; // Exit the loop
+        stats_bytes(valread, 0);
+        if (byte_buf_append(&in, buffer, valread) != 0) {
+            break; // Out of memory
         }
+        int status = protocol_process(cred_store_enter(reader_slot), &in, &out, 0); // Answer every complete request
+        cred_store_leave(reader_slot); // Do not hold up reloads while waiting on the client
 
-        // Determine the type of check
-        if (strncmp(buffer, "check_username:", 15) == 0) {
-            check_username = 1; // Set flag to check username
-            strcpy(username_hash, buffer + 15); // Copy username hash from buffer
-            printf("Received username hash: %s\n", username_hash); // Debug print
-        } else if (strncmp(buffer, "check_password:", 15) == 0) {
-            check_password = 1; // Set flag to check password
-            strcpy(password_hash, buffer + 15); // Copy password hash from buffer
-            printf("Received password hash: %s\n", password_hash); // Debug print
-        } else if (strncmp(buffer, "check_both:", 11) == 0) {
-            check_both = 1; // Set flag to check both username and password
-            char *token = strtok(buffer + 11, ":"); // Split buffer to get username hash
-            if (token) {
-                strcpy(username_hash, token); // Copy username hash
-                token = strtok(NULL, ":"); // Get the next token for password hash
-                if (token) {
-                    strcpy(password_hash, token); // Copy password hash
-                }
+        while (byte_buf_pending(&out) > 0) { // Send all replies
+            ssize_t sent = send(client_sock, out.data + out.off, byte_buf_pending(&out), 0);
+            if (sent <= 0) {
+                status = PROTO_CLOSE; // Client went away
+                break;
             }
-            printf("Received both hashes - Username: %s, Password: %s\n", username_hash, password_hash); // Debug print
+            byte_buf_consume(&out, sent);
+            stats_bytes(0, sent);
         }
 
-        int found_username = 0, found_password = 0; // Flags to indicate if username/password is found
-        if (check_username || check_both) { // Check if username or both need to be checked
-            for (int i = 0; i < credential_count; i++) {
-                printf("Comparing username hash with credential: %s\n", credentials[i]); // Debug print
-                if (strcmp(username_hash, credentials[i]) == 0) { // Compare username hash
-                    found_username = 1; // Set flag if username is found
-                    break; // Exit the loop
-                }
-            }
+        if (status == PROTO_CLOSE) { // Check if the client wants to exit
+            break; // Exit the loop
         }
+    }
 
-        if (check_password || check_both) { // Check if password or both need to be checked
-            for (int i = 0; i < credential_count; i++) {
-                printf("Comparing password hash with credential: %s\n", credentials[i]); // Debug print
-                if (strcmp(password_hash, credentials[i]) == 0) { // Compare password hash
-                    found_password = 1; // Set flag if password is found
-                    break; // Exit the loop
-                }
-            }
-        }
+    byte_buf_free(&in);
+    byte_buf_free(&out);
+}
 
-        if (check_both) { // If both username and password need to be checked
-            if (found_username && found_password) {
-                send(client_sock, "FoundBoth", strlen("FoundBoth"), 0); // Send response if both are found
-            } else if (found_username) {
-                send(client_sock, "FoundUsernameOnly", strlen("FoundUsernameOnly"), 0); // Send response if only username is found
-            } else if (found_password) {
-                send(client_sock, "FoundPasswordOnly", strlen("FoundPasswordOnly"), 0); // Send response if only password is found
-            } else {
-                send(client_sock, "NotFound", strlen("NotFound"), 0); // Send response if neither is found
-            }
-        } else if (check_username) { // If only username needs to be checked
-            if (found_username) {
-                send(client_sock, "Found", strlen("Found"), 0); // Send response if username is found
-            } else {
-                send(client_sock, "Not Found", strlen("Not Found"), 0); // Send response if username is not found
-            }
-        } else if (check_password) { // If only password needs to be checked
-            if (found_password) {
-                send(client_sock, "Found", strlen("Found"), 0); // Send response if password is found
-            } else {
-                send(client_sock, "Not Found", strlen("Not Found"), 0); // Send response if password is not found
-            }
-        }
+void print_filter_stats(const char *name, const digest_filter *filter) {
+    const filter_counters *c = filter->counters;
+    if (!c) {
+        return; // No filter built
+    }
+    uint64_t rejected = __atomic_load_n(&c->rejected, __ATOMIC_RELAXED);
+    uint64_t passed = __atomic_load_n(&c->passed, __ATOMIC_RELAXED);
+    uint64_t false_positives = __atomic_load_n(&c->false_positives, __ATOMIC_RELAXED);
+    uint64_t negatives = rejected + false_positives; // Lookups that were not found
+    printf("%s filter: %llu rejected, %llu passed, %llu false positives (%.2f%% of negatives)\n", name,
+           (unsigned long long)rejected, (unsigned long long)passed, (unsigned long long)false_positives,
+           negatives ? 100.0 * false_positives / negatives : 0.0);
+}
 
-        // Reset check flags
-        check_username = check_password = check_both = 0; // Reset flags for the next iteration
+void *dump_stats(void *arg) {
+    double seconds = *(double *)arg;
+    struct timespec interval = {(time_t)seconds, (long)((seconds - (time_t)seconds) * 1e9)};
+    int slot = cred_store_register(); // Reads the index for its counts and filter counters
+    if (slot < 0) {
+        fprintf(stderr, "Too many threads, no periodic stats\n");
+        return NULL;
     }
+    static char text[STATS_TEXT_SIZE];
+    while (1) {
+        nanosleep(&interval, NULL);
+        size_t len = stats_format(cred_store_enter(slot), text, sizeof(text));
+        cred_store_leave(slot);
+        fwrite(text, 1, len, stdout); // Same format as the "stats" command
+        fflush(stdout);
+    }
+    return NULL;
 }
 
-void sigint_handler(int sig) {
+void shutdown_server(int sig) {
+    log_flush(); // Let queued messages out first
     printf("Caught signal %d, closing server...\n", sig); // Print signal caught message
-    close(server_fd); // Close the server socket
+    int slot = cred_store_register(); // A reload may be swapping the index meanwhile
+    if (slot >= 0) { // Without a slot the index could be freed under us, so skip the counters
+        const cred_index *index = cred_store_enter(slot);
+        print_filter_stats("Username", &index->usernames.filter);
+        print_filter_stats("Password", &index->passwords.filter);
+    }
+    if (server_fd >= 0) {
+        close(server_fd); // Close the server socket
+    }
     exit(0); // Exit the program
 }
\ No newline at end of file
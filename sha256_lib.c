@@ -22,60 +22,82 @@ void sha256_init(SHA256_CTX *ctx) {
 }
 
 
-// Process message blocks
-void sha256_transform(SHA256_CTX *ctx) {
+// Process message blocks (scalar reference; sha256_compress picks a faster kernel)
+void sha256_compress_scalar(uint32_t state[8], const uint8_t data[], size_t blocks) {
     uint32_t a, b, c, d, e, f, g, h, i, j, t1, t2, m[64];
 
-    for (i = 0, j = 0; i < 16; ++i, j += 4)
-        m[i] = (ctx->data[j] << 24) | (ctx->data[j + 1] << 16) | (ctx->data[j + 2] << 8) | (ctx->data[j + 3]);
-
-    for (; i < 64; ++i)
-        m[i] = SIGMA3(m[i - 2]) + m[i - 7] + SIGMA2(m[i - 15]) + m[i - 16];
-
-    a = ctx->state[0];
-    b = ctx->state[1];
-    c = ctx->state[2];
-    d = ctx->state[3];
-    e = ctx->state[4];
-    f = ctx->state[5];
-    g = ctx->state[6];
-    h = ctx->state[7];
-
-    for (i = 0; i < 64; ++i) {
-        t1 = h + SIGMA1(e) + CH(e, f, g) + k[i] + m[i];
-        t2 = SIGMA0(a) + MAJ(a, b, c);
-        h = g;
-        g = f;
-        f = e;
-        e = d + t1;
-        d = c;
-        c = b;
-        b = a;
-        a = t1 + t2;
+    for (; blocks > 0; blocks--, data += SHA256_BLOCK_SIZE) {
+        for (i = 0, j = 0; i < 16; ++i, j += 4)
+            m[i] = ((uint32_t)data[j] << 24) | (data[j + 1] << 16) | (data[j + 2] << 8) | (data[j + 3]);
+
+        for (; i < 64; ++i)
+            m[i] = SIGMA3(m[i - 2]) + m[i - 7] + SIGMA2(m[i - 15]) + m[i - 16];
+
+        a = state[0];
+        b = state[1];
+        c = state[2];
+        d = state[3];
+        e = state[4];
+        f = state[5];
+        g = state[6];
+        h = state[7];
+
+        for (i = 0; i < 64; ++i) {
+            t1 = h + SIGMA1(e) + CH(e, f, g) + k[i] + m[i];
+            t2 = SIGMA0(a) + MAJ(a, b, c);
+            h = g;
+            g = f;
+            f = e;
+            e = d + t1;
+            d = c;
+            c = b;
+            b = a;
+            a = t1 + t2;
+        }
+
+        state[0] += a;
+        state[1] += b;
+        state[2] += c;
+        state[3] += d;
+        state[4] += e;
+        state[5] += f;
+        state[6] += g;
+        state[7] += h;
     }
+}
 
-    ctx->state[0] += a;
-    ctx->state[1] += b;
-    ctx->state[2] += c;
-    ctx->state[3] += d;
-    ctx->state[4] += e;
-    ctx->state[5] += f;
-    ctx->state[6] += g;
-    ctx->state[7] += h;
+// Process the buffered block
+void sha256_transform(SHA256_CTX *ctx) {
+    sha256_compress(ctx->state, ctx->data, 1);
 }
 
 // Add message block to context
 void sha256_update(SHA256_CTX *ctx, const uint8_t data[], size_t len) {
-    size_t i;
-    for (i = 0; i < len; ++i) {
-        ctx->data[ctx->datalen] = data[i];
-        ctx->datalen++;
-        if (ctx->datalen == SHA256_BLOCK_SIZE) {
-            sha256_transform(ctx);
-            ctx->bitlen += 512;
-            ctx->datalen = 0;
-        }
+    if (ctx->datalen > 0) { // Top up a partially filled block first
+        size_t take = SHA256_BLOCK_SIZE - ctx->datalen;
+        if (take > len)
+            take = len;
+        memcpy(ctx->data + ctx->datalen, data, take);
+        ctx->datalen += take;
+        data += take;
+        len -= take;
+        if (ctx->datalen < SHA256_BLOCK_SIZE)
+            return;
+        sha256_transform(ctx);
+        ctx->bitlen += 512;
+        ctx->datalen = 0;
     }
+
+    size_t blocks = len / SHA256_BLOCK_SIZE; // Whole blocks are hashed in place, without copying
+    if (blocks > 0) {
+        sha256_compress(ctx->state, data, blocks);
+        ctx->bitlen += 512 * (uint64_t)blocks;
+        data += blocks * SHA256_BLOCK_SIZE;
+        len -= blocks * SHA256_BLOCK_SIZE;
+    }
+
+    memcpy(ctx->data, data, len); // Keep the tail for the next call
+    ctx->datalen = len;
 }
 
 // Finalize hash and produce digest
@@ -47,4 +47,14 @@ void sha256_init(SHA256_CTX *ctx);
 void sha256_update(SHA256_CTX *ctx, const uint8_t data[], size_t len);
 void sha256_final(SHA256_CTX *ctx, uint8_t hash[]);
 
+// Block compression. sha256_compress runs the fastest kernel this CPU supports (SHA-NI
+// when available), picked once at startup after checking it against the scalar reference.
+void sha256_compress_scalar(uint32_t state[8], const uint8_t data[], size_t blocks);
+void sha256_compress(uint32_t state[8], const uint8_t data[], size_t blocks);
+const char *sha256_engine(void); // Name of the kernels in use, e.g. "sha-ni+avx512"
+
+// Hash n independent messages at once. Short messages go through AVX2 (8 lanes) or
+// AVX-512 (16 lanes) multi-buffer kernels where supported, otherwise one at a time.
+void sha256_batch(const uint8_t **msgs, const size_t *lens, size_t n, uint8_t (*out)[SHA256_DIGEST_SIZE]);
+
 #endif
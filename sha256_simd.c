@@ -0,0 +1,273 @@
+// sha256_simd.c
+// Runtime-dispatched SHA-256 kernels: SHA-NI for single messages, and AVX2 / AVX-512
+// multi-buffer kernels that hash 8 / 16 independent messages in parallel, one per
+// vector lane. Every kernel is checked against sha256_compress_scalar at startup and
+// skipped if it disagrees. SHA256_ENGINE restricts the choice for benchmarking, e.g.
+// "scalar" for the reference code or "sha-ni+avx2".
+#include <stdlib.h>
+#include <string.h>
+#include <cpuid.h>
+#include <immintrin.h>
+#include "sha256_lib.h"
+
+#define MAX_LANES 16 // Widest multi-buffer kernel
+
+typedef void (*compress_fn)(uint32_t state[8], const uint8_t data[], size_t blocks);
+typedef void (*batch_fn)(const uint8_t **msgs, const size_t *lens, size_t n, uint8_t (*out)[SHA256_DIGEST_SIZE]);
+
+static const uint32_t initial_state[8] = {
+    0x6a09e667, 0xbb67ae85, 0x3c6ef372, 0xa54ff53a, 0x510e527f, 0x9b05688c, 0x1f83d9ab, 0x5be0cd19
+};
+
+static compress_fn compress_impl = sha256_compress_scalar; // Selected single-buffer kernel
+static batch_fn batch_impl; // Selected multi-buffer kernel, NULL if none
+static char engine_name[32] = "scalar";
+
+static uint32_t load_be32(const uint8_t *p) {
+    return ((uint32_t)p[0] << 24) | ((uint32_t)p[1] << 16) | ((uint32_t)p[2] << 8) | p[3];
+}
+
+static void store_be32(uint8_t *p, uint32_t v) {
+    p[0] = v >> 24;
+    p[1] = v >> 16;
+    p[2] = v >> 8;
+    p[3] = v;
+}
+
+// SHA-NI: two rounds per sha256rnds2, state kept as ABEF/CDGH halves
+__attribute__((target("sha,sse4.1,ssse3")))
+static void compress_shani(uint32_t state[8], const uint8_t data[], size_t blocks) {
+    const __m128i byteswap = _mm_set_epi64x(0x0c0d0e0f08090a0bULL, 0x0405060700010203ULL);
+    __m128i tmp = _mm_shuffle_epi32(_mm_loadu_si128((const __m128i *)&state[0]), 0xB1); // CDAB
+    __m128i state1 = _mm_shuffle_epi32(_mm_loadu_si128((const __m128i *)&state[4]), 0x1B); // EFGH
+    __m128i state0 = _mm_alignr_epi8(tmp, state1, 8); // ABEF
+    state1 = _mm_blend_epi16(state1, tmp, 0xF0); // CDGH
+
+    for (; blocks > 0; blocks--, data += SHA256_BLOCK_SIZE) {
+        __m128i abef = state0, cdgh = state1;
+        __m128i w[16]; // Message schedule, four words per entry
+
+        for (int g = 0; g < 16; g++) {
+            if (g < 4) {
+                w[g] = _mm_shuffle_epi8(_mm_loadu_si128((const __m128i *)(data + g * 16)), byteswap);
+            } else {
+                __m128i x = _mm_sha256msg1_epu32(w[g - 4], w[g - 3]);
+                x = _mm_add_epi32(x, _mm_alignr_epi8(w[g - 1], w[g - 2], 4));
+                w[g] = _mm_sha256msg2_epu32(x, w[g - 1]);
+            }
+            __m128i msg = _mm_add_epi32(w[g], _mm_loadu_si128((const __m128i *)&k[g * 4]));
+            state1 = _mm_sha256rnds2_epu32(state1, state0, msg);
+            state0 = _mm_sha256rnds2_epu32(state0, state1, _mm_shuffle_epi32(msg, 0x0E));
+        }
+
+        state0 = _mm_add_epi32(state0, abef);
+        state1 = _mm_add_epi32(state1, cdgh);
+    }
+
+    tmp = _mm_shuffle_epi32(state0, 0x1B); // FEBA
+    state1 = _mm_shuffle_epi32(state1, 0xB1); // DCHG
+    _mm_storeu_si128((__m128i *)&state[0], _mm_blend_epi16(tmp, state1, 0xF0)); // DCBA
+    _mm_storeu_si128((__m128i *)&state[4], _mm_alignr_epi8(state1, tmp, 8)); // HGFE
+}
+
+// One message being fed through a multi-buffer lane
+typedef struct {
+    const uint8_t *msg; // Message bytes
+    size_t index; // Position in the batch, for the output
+    size_t block; // Next block to hash
+    size_t blocks; // Total blocks including padding
+    size_t tail; // First block that needs padding, taken from `pad`
+    uint8_t pad[SHA256_BLOCK_SIZE * 2]; // Padded final block(s)
+} lane;
+
+// Start hashing message i in a lane
+static void lane_assign(lane *l, const uint8_t *msg, size_t len, size_t i) {
+    l->msg = msg;
+    l->index = i;
+    l->block = 0;
+    l->blocks = (len + 8) / SHA256_BLOCK_SIZE + 1;
+    l->tail = len / SHA256_BLOCK_SIZE;
+
+    size_t rest = len - l->tail * SHA256_BLOCK_SIZE; // Bytes in the first padded block
+    size_t pad_len = (l->blocks - l->tail) * SHA256_BLOCK_SIZE;
+    memcpy(l->pad, msg + l->tail * SHA256_BLOCK_SIZE, rest);
+    l->pad[rest] = 0x80;
+    memset(l->pad + rest + 1, 0, pad_len - rest - 1);
+    uint64_t bitlen = (uint64_t)len * 8;
+    store_be32(l->pad + pad_len - 8, (uint32_t)(bitlen >> 32));
+    store_be32(l->pad + pad_len - 4, (uint32_t)bitlen);
+}
+
+static const uint8_t *lane_block(const lane *l) {
+    return l->block < l->tail ? l->msg + l->block * SHA256_BLOCK_SIZE
+                              : l->pad + (l->block - l->tail) * SHA256_BLOCK_SIZE;
+}
+
+// Multi-buffer kernel over LANES lanes using GCC vector types, so the same code
+// compiles to AVX2 or AVX-512 instructions. A lane whose message finishes is refilled
+// with the next message; idle lanes hash a zero block and are ignored.
+#define MULTI_BUFFER_KERNEL(NAME, LANES, TARGET)                                              \
+__attribute__((target(TARGET)))                                                               \
+static void NAME(const uint8_t **msgs, const size_t *lens, size_t n,                          \
+                 uint8_t (*out)[SHA256_DIGEST_SIZE]) {                                        \
+    typedef uint32_t vec __attribute__((vector_size(LANES * 4)));                             \
+    static const uint8_t zero_block[SHA256_BLOCK_SIZE];                                       \
+    lane lanes[LANES];                                                                        \
+    int busy[LANES];                                                                          \
+    vec st[8];                                                                                \
+    size_t next = 0, active = 0;                                                              \
+                                                                                              \
+    for (int l = 0; l < LANES; l++) {                                                         \
+        busy[l] = next < n;                                                                   \
+        if (busy[l]) {                                                                        \
+            lane_assign(&lanes[l], msgs[next], lens[next], next);                             \
+            next++;                                                                           \
+            active++;                                                                         \
+        }                                                                                     \
+        for (int j = 0; j < 8; j++) st[j][l] = initial_state[j];                              \
+    }                                                                                         \
+                                                                                              \
+    while (active > 0) {                                                                      \
+        vec w[16];                                                                            \
+        for (int l = 0; l < LANES; l++) {                                                     \
+            const uint8_t *block = busy[l] ? lane_block(&lanes[l]) : zero_block;              \
+            for (int t = 0; t < 16; t++) w[t][l] = load_be32(block + t * 4);                  \
+        }                                                                                     \
+                                                                                              \
+        vec a = st[0], b = st[1], c = st[2], d = st[3];                                       \
+        vec e = st[4], f = st[5], g = st[6], h = st[7];                                       \
+        for (int t = 0; t < 64; t++) {                                                        \
+            if (t >= 16) {                                                                    \
+                w[t & 15] += SIGMA3(w[(t - 2) & 15]) + w[(t - 7) & 15] +                      \
+                             SIGMA2(w[(t - 15) & 15]);                                        \
+            }                                                                                 \
+            vec t1 = h + SIGMA1(e) + CH(e, f, g) + k[t] + w[t & 15];                          \
+            vec t2 = SIGMA0(a) + MAJ(a, b, c);                                                \
+            h = g; g = f; f = e; e = d + t1;                                                  \
+            d = c; c = b; b = a; a = t1 + t2;                                                 \
+        }                                                                                     \
+        st[0] += a; st[1] += b; st[2] += c; st[3] += d;                                       \
+        st[4] += e; st[5] += f; st[6] += g; st[7] += h;                                       \
+                                                                                              \
+        for (int l = 0; l < LANES; l++) {                                                     \
+            if (!busy[l] || ++lanes[l].block < lanes[l].blocks) continue;                     \
+            for (int j = 0; j < 8; j++) {                                                     \
+                store_be32(out[lanes[l].index] + j * 4, st[j][l]);                            \
+                st[j][l] = initial_state[j];                                                  \
+            }                                                                                 \
+            if (next < n) {                                                                   \
+                lane_assign(&lanes[l], msgs[next], lens[next], next);                         \
+                next++;                                                                       \
+            } else {                                                                          \
+                busy[l] = 0;                                                                  \
+                active--;                                                                     \
+            }                                                                                 \
+        }                                                                                     \
+    }                                                                                         \
+}
+
+MULTI_BUFFER_KERNEL(batch_avx2, 8, "avx2")
+MULTI_BUFFER_KERNEL(batch_avx512, 16, "avx512f")
+
+// Hash one message with the selected single-buffer kernel
+static void hash_one(const uint8_t *msg, size_t len, uint8_t out[SHA256_DIGEST_SIZE]) {
+    uint32_t state[8];
+    memcpy(state, initial_state, sizeof(state));
+    size_t full = len / SHA256_BLOCK_SIZE;
+    compress_impl(state, msg, full); // Whole blocks straight from the input
+
+    lane tail; // Reuse the multi-buffer padding for the last block(s)
+    lane_assign(&tail, msg, len, 0);
+    compress_impl(state, tail.pad, tail.blocks - tail.tail);
+    for (int j = 0; j < 8; j++) {
+        store_be32(out + j * 4, state[j]);
+    }
+}
+
+// Known-answer check of a kernel against the scalar reference
+static int compress_matches(compress_fn fn) {
+    uint8_t data[SHA256_BLOCK_SIZE * 3];
+    for (size_t i = 0; i < sizeof(data); i++) {
+        data[i] = (uint8_t)(i * 131 + 7);
+    }
+    uint32_t want[8], got[8];
+    memcpy(want, initial_state, sizeof(want));
+    memcpy(got, initial_state, sizeof(got));
+    sha256_compress_scalar(want, data, 3);
+    fn(got, data, 3);
+    return memcmp(want, got, sizeof(want)) == 0;
+}
+
+static int batch_matches(batch_fn fn) {
+    uint8_t data[300];
+    const uint8_t *msgs[MAX_LANES * 2 + 3];
+    size_t lens[MAX_LANES * 2 + 3];
+    uint8_t want[MAX_LANES * 2 + 3][SHA256_DIGEST_SIZE], got[MAX_LANES * 2 + 3][SHA256_DIGEST_SIZE];
+    size_t n = sizeof(lens) / sizeof(lens[0]);
+    for (size_t i = 0; i < sizeof(data); i++) {
+        data[i] = (uint8_t)(i * 37 + 1);
+    }
+    for (size_t i = 0; i < n; i++) { // Lengths around every padding boundary
+        msgs[i] = data + i;
+        lens[i] = (i * 29) % 200;
+        SHA256_CTX ctx; // Reference digest through the already-verified context API
+        sha256_init(&ctx);
+        sha256_update(&ctx, msgs[i], lens[i]);
+        sha256_final(&ctx, want[i]);
+    }
+    fn(msgs, lens, n, got);
+    return memcmp(want, got, sizeof(want)) == 0;
+}
+
+// 1 if the CPU reports the SHA extensions (CPUID leaf 7, EBX bit 29)
+static int cpu_has_sha(void) {
+    unsigned int eax, ebx, ecx, edx;
+    return __get_cpuid_count(7, 0, &eax, &ebx, &ecx, &edx) && (ebx & (1u << 29)) &&
+           __builtin_cpu_supports("sse4.1") && __builtin_cpu_supports("ssse3");
+}
+
+// 1 if SHA256_ENGINE is unset or names this kernel
+static int engine_allowed(const char *name) {
+    const char *forced = getenv("SHA256_ENGINE");
+    return !forced || !*forced || strstr(forced, name) != NULL;
+}
+
+__attribute__((constructor))
+static void sha256_select_engine(void) {
+    __builtin_cpu_init();
+    const char *single = "scalar", *multi = NULL;
+    if (engine_allowed("sha-ni") && cpu_has_sha() && compress_matches(compress_shani)) {
+        compress_impl = compress_shani;
+        single = "sha-ni";
+    }
+    if (engine_allowed("avx512") && __builtin_cpu_supports("avx512f") && batch_matches(batch_avx512)) {
+        batch_impl = batch_avx512;
+        multi = "avx512";
+    } else if (engine_allowed("avx2") && __builtin_cpu_supports("avx2") && batch_matches(batch_avx2)) {
+        batch_impl = batch_avx2;
+        multi = "avx2";
+    }
+    strcpy(engine_name, single);
+    if (multi) {
+        strcat(engine_name, "+");
+        strcat(engine_name, multi);
+    }
+}
+
+void sha256_compress(uint32_t state[8], const uint8_t data[], size_t blocks) {
+    compress_impl(state, data, blocks);
+}
+
+const char *sha256_engine(void) {
+    return engine_name;
+}
+
+void sha256_batch(const uint8_t **msgs, const size_t *lens, size_t n, uint8_t (*out)[SHA256_DIGEST_SIZE]) {
+    if (batch_impl && n > 1) {
+        batch_impl(msgs, lens, n, out);
+        return;
+    }
+    for (size_t i = 0; i < n; i++) {
+        hash_one(msgs[i], lens[i], out[i]);
+    }
+}
@@ -0,0 +1,216 @@
+// shard.c
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+#include <errno.h>
+#include "net.h"
+#include "shard.h"
+
+#define LINE_SIZE 4096 // Buffer size for one line of the shard map
+
+static uint64_t key_of(const uint8_t *digest) {
+    uint64_t key = 0;
+    for (int i = 0; i < 8; i++) {
+        key = (key << 8) | digest[i];
+    }
+    return key;
+}
+
+static int point_compare(const void *a, const void *b) {
+    const shard_point *x = a, *y = b;
+    if (x->key != y->key) {
+        return x->key < y->key ? -1 : 1;
+    }
+    return x->shard - y->shard; // Ties are astronomically rare, but must resolve the same everywhere
+}
+
+// Place every shard's points on the ring
+static int build_ring(shard_map *map) {
+    map->ring = malloc(sizeof(*map->ring) * map->count * SHARD_VNODES);
+    if (!map->ring) {
+        return -1;
+    }
+    for (int s = 0; s < map->count; s++) {
+        for (int v = 0; v < SHARD_VNODES; v++) {
+            char label[SHARD_NAME_SIZE + 16]; // "<name>#<vnode>"
+            int len = snprintf(label, sizeof(label), "%s#%d", map->shards[s].name, v);
+            uint8_t digest[SHA256_DIGEST_SIZE];
+            SHA256_CTX ctx;
+            sha256_init(&ctx);
+            sha256_update(&ctx, (const uint8_t *)label, len);
+            sha256_final(&ctx, digest);
+            map->ring[s * SHARD_VNODES + v] = (shard_point){key_of(digest), s};
+        }
+    }
+    qsort(map->ring, (size_t)map->count * SHARD_VNODES, sizeof(*map->ring), point_compare);
+    return 0;
+}
+
+// Parse "host:port" into a replica, 0 on success
+static int parse_replica(const char *text, shard_replica *replica) {
+    const char *colon = strrchr(text, ':');
+    if (!colon || colon == text || (size_t)(colon - text) >= sizeof(replica->host)) {
+        return -1;
+    }
+    char *end;
+    long port = strtol(colon + 1, &end, 10);
+    if (*end != '\0' || port <= 0 || port > 65535) {
+        return -1;
+    }
+    memcpy(replica->host, text, colon - text);
+    replica->host[colon - text] = '\0';
+    replica->port = (int)port;
+    return 0;
+}
+
+int shard_map_load(shard_map *map, const char *filename) {
+    FILE *file = fopen(filename, "r");
+    if (!file) {
+        return -1;
+    }
+    memset(map, 0, sizeof(*map));
+    char line[LINE_SIZE];
+    int line_number = 0;
+    while (fgets(line, sizeof(line), file)) {
+        line_number++;
+        line[strcspn(line, "#\r\n")] = '\0'; // Drop comments and the newline
+        char *save;
+        char *name = strtok_r(line, " \t", &save);
+        if (!name) {
+            continue; // Blank line
+        }
+
+        shard_entry entry;
+        memset(&entry, 0, sizeof(entry));
+        int valid = strlen(name) < sizeof(entry.name) && shard_map_find(map, name) < 0;
+        snprintf(entry.name, sizeof(entry.name), "%s", name);
+        char *address;
+        while (valid && (address = strtok_r(NULL, " \t", &save)) != NULL) {
+            valid = entry.replica_count < SHARD_MAX_REPLICAS &&
+                    parse_replica(address, &entry.replicas[entry.replica_count++]) == 0;
+        }
+        if (!valid || entry.replica_count == 0) {
+            fprintf(stderr, "%s:%d: expected a new shard name and up to %d host:port replicas\n",
+                    filename, line_number, SHARD_MAX_REPLICAS);
+            fclose(file);
+            shard_map_free(map);
+            errno = EINVAL;
+            return -1;
+        }
+
+        shard_entry *grown = realloc(map->shards, sizeof(*map->shards) * (map->count + 1));
+        if (!grown) {
+            fclose(file);
+            shard_map_free(map);
+            return -1;
+        }
+        map->shards = grown;
+        map->shards[map->count++] = entry;
+    }
+    fclose(file);
+
+    if (map->count == 0) {
+        fprintf(stderr, "%s: no shards\n", filename);
+        errno = EINVAL;
+        return -1;
+    }
+    if (build_ring(map) != 0) {
+        shard_map_free(map);
+        return -1;
+    }
+    return 0;
+}
+
+int shard_map_single(shard_map *map, const char *host, int port) {
+    memset(map, 0, sizeof(*map));
+    map->shards = calloc(1, sizeof(*map->shards));
+    if (!map->shards || strlen(host) >= sizeof(map->shards->replicas[0].host)) {
+        free(map->shards);
+        return -1;
+    }
+    map->count = 1;
+    strcpy(map->shards[0].name, "all");
+    strcpy(map->shards[0].replicas[0].host, host);
+    map->shards[0].replicas[0].port = port;
+    map->shards[0].replica_count = 1;
+    if (build_ring(map) != 0) {
+        shard_map_free(map);
+        return -1;
+    }
+    return 0;
+}
+
+int shard_map_find(const shard_map *map, const char *name) {
+    for (int i = 0; i < map->count; i++) {
+        if (strcmp(map->shards[i].name, name) == 0) {
+            return i;
+        }
+    }
+    return -1;
+}
+
+// Position of the first ring point at or after key, wrapping to 0
+static size_t ring_successor(const shard_map *map, uint64_t key) {
+    size_t lo = 0, hi = (size_t)map->count * SHARD_VNODES;
+    while (lo < hi) {
+        size_t mid = lo + (hi - lo) / 2;
+        if (map->ring[mid].key < key) {
+            lo = mid + 1;
+        } else {
+            hi = mid;
+        }
+    }
+    return lo == (size_t)map->count * SHARD_VNODES ? 0 : lo;
+}
+
+int shard_owner(const shard_map *map, const uint8_t digest[SHA256_DIGEST_SIZE]) {
+    return shard_owner_key(map, key_of(digest));
+}
+
+int shard_owner_key(const shard_map *map, uint64_t key) {
+    if (map->count == 1) {
+        return 0;
+    }
+    return map->ring[ring_successor(map, key)].shard;
+}
+
+int shard_owners(const shard_map *map, uint64_t first, uint64_t last, int *owners) {
+    int found = 0;
+    size_t points = (size_t)map->count * SHARD_VNODES;
+    size_t i = ring_successor(map, first); // Owns `first`
+    while (found < map->count) {
+        int owner = map->ring[i].shard;
+        int seen = 0;
+        for (int j = 0; j < found && !seen; j++) {
+            seen = owners[j] == owner;
+        }
+        if (!seen) {
+            owners[found++] = owner;
+        }
+        if (map->ring[i].key >= last || map->ring[i].key < first) {
+            break; // This point owns `last`, or wrapped around and owns the rest of the range
+        }
+        i = (i + 1) % points;
+    }
+    return found;
+}
+
+int shard_connect(const shard_map *map, int shard, int *replica) {
+    const shard_entry *s = &map->shards[shard];
+    for (int attempt = 0; attempt < s->replica_count; attempt++) {
+        int r = (*replica + attempt) % s->replica_count;
+        int sock = net_connect(s->replicas[r].host, s->replicas[r].port);
+        if (sock >= 0) {
+            *replica = r;
+            return sock;
+        }
+        fprintf(stderr, "Shard %s: replica %s:%d unavailable\n", s->name, s->replicas[r].host, s->replicas[r].port);
+    }
+    return -1;
+}
+
+void shard_map_free(shard_map *map) {
+    free(map->shards);
+    free(map->ring);
+    memset(map, 0, sizeof(*map));
+}
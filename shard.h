@@ -0,0 +1,61 @@
+// shard.h
+// Consistent-hash partitioning of the digest space across server processes. A shard
+// map file names each shard and the replicas serving it, one shard per line:
+//   # name  replica [replica ...]
+//   a       10.0.0.1:8080 10.0.0.2:8080
+//   b       10.0.0.3:8080
+// Every shard places SHARD_VNODES points on a ring of 64-bit keys, and a digest belongs
+// to the shard of the first point at or after its first 8 bytes. Digests are already
+// uniform, so no further hashing is needed, and adding a shard only moves the keys its
+// own points take over. Usernames and passwords are routed independently, so one line
+// of a credentials file may live on two shards. Servers load only the digests of their
+// shard; clients route every digest to its shard and fail over between its replicas.
+
+#ifndef _SHARD_H_
+#define _SHARD_H_
+
+#include <stddef.h>
+#include <stdint.h>
+#include "sha256_lib.h"
+
+#define SHARD_VNODES 128 // Ring points per shard
+#define SHARD_NAME_SIZE 32 // Longest shard name, including the terminator
+#define SHARD_MAX_REPLICAS 8 // Most replicas listed for one shard
+
+// Address of one server process
+typedef struct {
+    char host[256]; // Hostname or address, or a Unix domain socket path
+    int port; // TCP port
+} shard_replica;
+
+// One partition of the digest space
+typedef struct {
+    char name[SHARD_NAME_SIZE]; // Name from the map file, hashed to place the ring points
+    shard_replica replicas[SHARD_MAX_REPLICAS]; // Servers holding the shard, tried in order
+    int replica_count; // Number of replicas
+} shard_entry;
+
+// Ring point owned by a shard
+typedef struct {
+    uint64_t key; // Position on the ring
+    int shard; // Index into shard_map.shards
+} shard_point;
+
+// Parsed shard map and its ring
+typedef struct {
+    shard_entry *shards; // Shards in file order
+    int count; // Number of shards
+    shard_point *ring; // count * SHARD_VNODES points, sorted by key
+} shard_map;
+
+int shard_map_load(shard_map *map, const char *filename); // Parse a shard map file, 0 on success
+int shard_map_single(shard_map *map, const char *host, int port); // One shard served by host:port, 0 on success
+int shard_map_find(const shard_map *map, const char *name); // Index of the named shard, -1 if unknown
+int shard_owner(const shard_map *map, const uint8_t digest[SHA256_DIGEST_SIZE]); // Shard holding a digest
+int shard_owner_key(const shard_map *map, uint64_t key); // Shard holding a ring key, such as a pair fingerprint
+int shard_owners(const shard_map *map, uint64_t first, uint64_t last,
+                 int *owners); // Shards holding any key in [first, last] (first <= last), returns how many
+int shard_connect(const shard_map *map, int shard, int *replica); // Connect to a replica from *replica on, -1 if none answer
+void shard_map_free(shard_map *map); // Release the shards and ring
+
+#endif
@@ -0,0 +1,229 @@
+// shm.c
+#define _GNU_SOURCE // memfd_create
+#include <stdio.h>
+#include <string.h>
+#include <errno.h>
+#include <poll.h>
+#include <unistd.h>
+#include <sys/eventfd.h>
+#include <sys/mman.h>
+#include <sys/socket.h>
+#include <sys/time.h>
+#include "net.h"
+#include "shm.h"
+
+#define SHM_FD_COUNT 3 // Passed to the client: segment, client eventfd, server eventfd
+#define SHM_ATTACH_TIMEOUT 2 // Seconds to wait for the segment after connecting
+
+// Wake the other side if it said it is going to sleep; called after moving data
+static void wake_peer(shm_channel *ch) {
+    uint32_t *flag = &ch->seg->waiting[!ch->side].flag;
+    __atomic_thread_fence(__ATOMIC_SEQ_CST); // Pairs with the fence in shm_wait_prepare
+    if (__atomic_load_n(flag, __ATOMIC_RELAXED) && __atomic_exchange_n(flag, 0, __ATOMIC_ACQ_REL)) {
+        uint64_t one = 1;
+        if (write(ch->peer_fd, &one, sizeof(one)) < 0) {
+            return; // Counter saturated, the peer has a wakeup pending anyway
+        }
+    }
+}
+
+int shm_channel_create(shm_channel *ch, int sock) {
+    memset(ch, 0, sizeof(*ch));
+    ch->side = SHM_SERVER;
+    ch->sock = sock;
+    int seg_fd = memfd_create("breachcheck-shm", MFD_CLOEXEC);
+    ch->wake_fd = eventfd(0, EFD_NONBLOCK | EFD_CLOEXEC);
+    ch->peer_fd = eventfd(0, EFD_NONBLOCK | EFD_CLOEXEC);
+    if (seg_fd < 0 || ch->wake_fd < 0 || ch->peer_fd < 0 || ftruncate(seg_fd, sizeof(shm_segment)) != 0) {
+        goto fail;
+    }
+    ch->seg = mmap(NULL, sizeof(shm_segment), PROT_READ | PROT_WRITE, MAP_SHARED, seg_fd, 0);
+    if (ch->seg == MAP_FAILED) {
+        ch->seg = NULL;
+        goto fail;
+    }
+    ch->seg->magic = SHM_MAGIC; // A new memfd is zeroed, so the rings start empty
+    ch->seg->version = SHM_VERSION;
+    ch->seg->ring_size = SHM_RING_SIZE;
+    ch->seg->waiting[SHM_SERVER].flag = 1; // The server sleeps until the first request arrives
+
+    int fds[SHM_FD_COUNT] = {seg_fd, ch->peer_fd, ch->wake_fd};
+    char control[CMSG_SPACE(sizeof(fds))];
+    memset(control, 0, sizeof(control));
+    char byte = 'S';
+    struct iovec iov = {&byte, 1}; // At least one byte must carry the descriptors
+    struct msghdr msg = {0};
+    msg.msg_iov = &iov;
+    msg.msg_iovlen = 1;
+    msg.msg_control = control;
+    msg.msg_controllen = sizeof(control);
+    struct cmsghdr *cmsg = CMSG_FIRSTHDR(&msg);
+    cmsg->cmsg_level = SOL_SOCKET;
+    cmsg->cmsg_type = SCM_RIGHTS;
+    cmsg->cmsg_len = CMSG_LEN(sizeof(fds));
+    memcpy(CMSG_DATA(cmsg), fds, sizeof(fds));
+    if (sendmsg(sock, &msg, MSG_NOSIGNAL) != 1) {
+        goto fail;
+    }
+    close(seg_fd); // The mapping keeps the segment alive
+    return 0;
+
+fail:
+    if (seg_fd >= 0) {
+        close(seg_fd);
+    }
+    ch->sock = -1; // Left to the caller
+    shm_close(ch);
+    return -1;
+}
+
+int shm_attach(shm_channel *ch, const char *path) {
+    memset(ch, 0, sizeof(*ch));
+    ch->side = SHM_CLIENT;
+    ch->wake_fd = ch->peer_fd = -1;
+    if ((ch->sock = unix_connect(path)) < 0) {
+        return -1;
+    }
+
+    struct timeval timeout = {SHM_ATTACH_TIMEOUT, 0}; // A plain socket would never answer
+    setsockopt(ch->sock, SOL_SOCKET, SO_RCVTIMEO, &timeout, sizeof(timeout));
+    int fds[SHM_FD_COUNT];
+    char control[CMSG_SPACE(sizeof(fds))];
+    char byte;
+    struct iovec iov = {&byte, 1};
+    struct msghdr msg = {0};
+    msg.msg_iov = &iov;
+    msg.msg_iovlen = 1;
+    msg.msg_control = control;
+    msg.msg_controllen = sizeof(control);
+    ssize_t n;
+    while ((n = recvmsg(ch->sock, &msg, MSG_CMSG_CLOEXEC)) < 0 && errno == EINTR) {
+    }
+    struct cmsghdr *cmsg = n == 1 ? CMSG_FIRSTHDR(&msg) : NULL;
+    if (!cmsg || cmsg->cmsg_type != SCM_RIGHTS || cmsg->cmsg_len != CMSG_LEN(sizeof(fds))) {
+        fprintf(stderr, "%s is not a shared-memory attach socket\n", path);
+        shm_close(ch);
+        errno = EPROTO;
+        return -1;
+    }
+    memcpy(fds, CMSG_DATA(cmsg), sizeof(fds));
+    ch->wake_fd = fds[1];
+    ch->peer_fd = fds[2];
+    ch->seg = mmap(NULL, sizeof(shm_segment), PROT_READ | PROT_WRITE, MAP_SHARED, fds[0], 0);
+    close(fds[0]);
+    if (ch->seg == MAP_FAILED || ch->seg->magic != SHM_MAGIC || ch->seg->version != SHM_VERSION ||
+        ch->seg->ring_size != SHM_RING_SIZE) {
+        if (ch->seg == MAP_FAILED) {
+            ch->seg = NULL;
+        }
+        fprintf(stderr, "Incompatible shared-memory segment from %s\n", path);
+        shm_close(ch);
+        errno = EPROTO;
+        return -1;
+    }
+    return 0;
+}
+
+void shm_close(shm_channel *ch) {
+    if (ch->seg) {
+        munmap(ch->seg, sizeof(shm_segment));
+    }
+    int fds[3] = {ch->sock, ch->wake_fd, ch->peer_fd};
+    for (int i = 0; i < 3; i++) {
+        if (fds[i] >= 0) {
+            close(fds[i]);
+        }
+    }
+    ch->seg = NULL;
+    ch->sock = ch->wake_fd = ch->peer_fd = -1;
+}
+
+ssize_t shm_write(shm_channel *ch, const void *data, size_t len) {
+    shm_ring *ring = &ch->seg->rings[ch->side];
+    uint32_t head = ring->head; // Only this side should write it, but the peer can map it too
+    uint32_t used = head - __atomic_load_n(&ring->tail, __ATOMIC_ACQUIRE);
+    if (used > SHM_RING_SIZE) {
+        errno = EPROTO; // The peer broke the counters; trusting them would write past the ring
+        return -1;
+    }
+    size_t n = SHM_RING_SIZE - used;
+    if (n > len) {
+        n = len;
+    }
+    if (n == 0) {
+        return 0;
+    }
+    size_t at = head & (SHM_RING_SIZE - 1);
+    size_t first = n < SHM_RING_SIZE - at ? n : SHM_RING_SIZE - at; // Up to the end of the ring
+    memcpy(ring->data + at, data, first);
+    memcpy(ring->data, (const char *)data + first, n - first); // Wrapped part
+    __atomic_store_n(&ring->head, head + (uint32_t)n, __ATOMIC_RELEASE); // Publish the bytes
+    wake_peer(ch);
+    return n;
+}
+
+ssize_t shm_read(shm_channel *ch, void *buf, size_t len) {
+    shm_ring *ring = &ch->seg->rings[!ch->side];
+    uint32_t tail = ring->tail; // Only this side should write it, but the peer can map it too
+    size_t n = (uint32_t)(__atomic_load_n(&ring->head, __ATOMIC_ACQUIRE) - tail);
+    if (n > SHM_RING_SIZE) {
+        errno = EPROTO; // More than a ring's worth: the counters are corrupt
+        return -1;
+    }
+    if (n > len) {
+        n = len;
+    }
+    if (n == 0) {
+        return 0;
+    }
+    size_t at = tail & (SHM_RING_SIZE - 1);
+    size_t first = n < SHM_RING_SIZE - at ? n : SHM_RING_SIZE - at;
+    memcpy(buf, ring->data + at, first);
+    memcpy((char *)buf + first, ring->data, n - first);
+    __atomic_store_n(&ring->tail, tail + (uint32_t)n, __ATOMIC_RELEASE); // Hand the space back
+    wake_peer(ch); // The peer may be waiting for room
+    return n;
+}
+
+size_t shm_readable(const shm_channel *ch) {
+    const shm_ring *ring = &ch->seg->rings[!ch->side];
+    return (uint32_t)(__atomic_load_n(&ring->head, __ATOMIC_ACQUIRE) - ring->tail);
+}
+
+int shm_wait_prepare(shm_channel *ch, int want_write) {
+    uint32_t *flag = &ch->seg->waiting[ch->side].flag;
+    __atomic_store_n(flag, 1, __ATOMIC_RELAXED);
+    __atomic_thread_fence(__ATOMIC_SEQ_CST); // The peer either sees the flag or we see its data
+    const shm_ring *out = &ch->seg->rings[ch->side];
+    // Corrupt counters count as ready too, so the caller's next shm_read/shm_write reports them
+    int ready = shm_readable(ch) > 0 ||
+                (want_write && out->head - __atomic_load_n(&out->tail, __ATOMIC_ACQUIRE) != SHM_RING_SIZE);
+    if (ready) {
+        __atomic_store_n(flag, 0, __ATOMIC_RELAXED); // A wakeup already on its way is harmless
+    }
+    return ready;
+}
+
+void shm_wait_done(shm_channel *ch) {
+    uint64_t count;
+    if (read(ch->wake_fd, &count, sizeof(count)) < 0) {
+        return; // Nothing was signalled
+    }
+}
+
+int shm_wait(shm_channel *ch, int want_write, int timeout_ms) {
+    if (shm_wait_prepare(ch, want_write)) {
+        return 0;
+    }
+    struct pollfd fds[2] = {{ch->wake_fd, POLLIN, 0}, {ch->sock, POLLIN, 0}};
+    int n = poll(fds, 2, timeout_ms);
+    __atomic_store_n(&ch->seg->waiting[ch->side].flag, 0, __ATOMIC_RELAXED); // Awake, whatever woke us
+    if (n > 0 && fds[1].revents) {
+        errno = EPIPE; // Nothing is sent on the attach socket after the handshake: it closed
+        return -1;
+    }
+    if (n > 0) {
+        shm_wait_done(ch);
+    }
+    return n < 0 && errno != EINTR ? -1 : 0;
+}
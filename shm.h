@@ -0,0 +1,69 @@
+// shm.h
+// Shared-memory transport for clients on the same host as the server. A client
+// connects to the server's attach socket (a Unix domain socket) and receives, with
+// SCM_RIGHTS, a memfd holding two single-producer single-consumer byte rings, one for
+// requests and one for replies, and an eventfd for each side. The rings carry the
+// same text and binary requests as a socket, so protocol_process answers them
+// unchanged, but a request costs two memcpy and no system call while both sides are
+// busy. A side about to sleep sets its `waiting` flag and rechecks the rings; the
+// other side writes the sleeper's eventfd only when it finds that flag set after
+// moving data, so a wakeup costs one eventfd write per sleep, not per request. The
+// attach socket stays open to tell each side when the other has gone away.
+
+#ifndef _SHM_H_
+#define _SHM_H_
+
+#include <stddef.h>
+#include <stdint.h>
+#include <sys/types.h>
+
+#define SHM_MAGIC 0x48534342 // "BCSH" in the segment header
+#define SHM_VERSION 1
+#define SHM_RING_SIZE (1 << 20) // Bytes per ring, a power of two
+
+#define SHM_SERVER 0 // Side that reads requests and writes replies
+#define SHM_CLIENT 1 // Side that writes requests and reads replies
+
+// Byte ring; the counters only grow and are taken modulo SHM_RING_SIZE
+typedef struct {
+    _Alignas(64) uint32_t head; // Bytes written so far, advanced by the producer
+    _Alignas(64) uint32_t tail; // Bytes read so far, advanced by the consumer
+    _Alignas(64) char data[SHM_RING_SIZE];
+} shm_ring;
+
+// Layout of the shared segment
+typedef struct {
+    uint32_t magic; // SHM_MAGIC
+    uint32_t version; // SHM_VERSION
+    uint32_t ring_size; // SHM_RING_SIZE
+    struct {
+        _Alignas(64) uint32_t flag; // Set while this side sleeps on its eventfd
+    } waiting[2]; // Indexed by side
+    shm_ring rings[2]; // [SHM_CLIENT]: requests, [SHM_SERVER]: replies; indexed by producer
+} shm_segment;
+
+// One side's view of a session
+typedef struct {
+    shm_segment *seg; // Mapped segment
+    int side; // SHM_SERVER or SHM_CLIENT
+    int sock; // Attach connection
+    int wake_fd; // Eventfd written to wake this side
+    int peer_fd; // Eventfd written to wake the other side
+} shm_channel;
+
+int shm_channel_create(shm_channel *ch, int sock); // Server: make a segment and hand it to the client on sock, 0 on success
+int shm_attach(shm_channel *ch, const char *path); // Client: connect to an attach socket and map the segment, 0 on success
+void shm_close(shm_channel *ch); // Unmap and close everything; the peer sees the attach socket close
+
+// Both sides can write the whole segment, so neither trusts the other's counters:
+// shm_write and shm_read fail with EPROTO once they describe more than a full ring, and
+// the session must then be closed
+ssize_t shm_write(shm_channel *ch, const void *data, size_t len); // Copy as much as fits into the outgoing ring, -1 if corrupt
+ssize_t shm_read(shm_channel *ch, void *buf, size_t len); // Copy out what the incoming ring holds, up to len, -1 if corrupt
+size_t shm_readable(const shm_channel *ch); // Bytes waiting in the incoming ring, over SHM_RING_SIZE if corrupt
+
+int shm_wait_prepare(shm_channel *ch, int want_write); // Announce a sleep; 1 if there is work already and the sleep is off
+void shm_wait_done(shm_channel *ch); // Reset the eventfd after waking up
+int shm_wait(shm_channel *ch, int want_write, int timeout_ms); // Block until the peer moves data, -1 (EPIPE) once it is gone
+
+#endif
@@ -0,0 +1,207 @@
+// shm_server.c
+#define _GNU_SOURCE // accept4
+#include <stdio.h>
+#include <stdlib.h>
+#include <stdint.h>
+#include <errno.h>
+#include <unistd.h>
+#include <pthread.h>
+#include <sys/epoll.h>
+#include <sys/socket.h>
+#include "net.h"
+#include "shm.h"
+#include "cred_store.h"
+#include "protocol.h"
+#include "stats.h"
+#include "shm_server.h"
+
+#define MAX_EVENTS 256 // Events handled per epoll_wait call
+#define READ_CHUNK 16384 // Bytes taken from a request ring at a time
+#define MAX_PENDING_OUTPUT (1 << 20) // Stop reading requests while the reply ring is full
+#define SESSION_ROUNDS 64 // Passes over one busy session before the others get a turn
+#define TAG_HANGUP 1 // Low bit of epoll data: the event is on the attach socket
+
+// One attached client
+typedef struct shm_session {
+    shm_channel ch; // Rings and eventfds
+    byte_buf in; // Requests taken from the ring but not yet complete
+    byte_buf out; // Replies the ring had no room for
+    int closing; // Close once `out` has been flushed
+    int closed; // Freed after the current batch of events
+    struct shm_session *next_closed;
+} __attribute__((aligned(TAG_HANGUP + 1))) shm_session;
+
+static int listen_fd = -1; // Attach socket
+static int epoll_fd = -1; // Listener, every session's eventfd and attach socket
+static int reader_slot = -1; // cred_store reader slot of the thread
+static shm_session *closed_sessions; // Closed during the current batch of events
+
+static void session_close(shm_session *s) {
+    if (s->closed) {
+        return;
+    }
+    epoll_ctl(epoll_fd, EPOLL_CTL_DEL, s->ch.wake_fd, NULL);
+    epoll_ctl(epoll_fd, EPOLL_CTL_DEL, s->ch.sock, NULL);
+    shm_close(&s->ch); // The client sees its attach socket close
+    byte_buf_free(&s->in);
+    byte_buf_free(&s->out);
+    s->closed = 1; // Another event of this batch may still point at it
+    s->next_closed = closed_sessions;
+    closed_sessions = s;
+    stats_connection(0);
+}
+
+// Move requests and replies through the rings until both stall, then sleep
+static void session_service(const cred_index *index, shm_session *s) {
+    char chunk[READ_CHUNK];
+    shm_wait_done(&s->ch); // Reset the eventfd before looking, so no later wakeup is lost
+
+    for (int round = 0; round < SESSION_ROUNDS; round++) {
+        size_t moved = 0;
+        while (!s->closing && byte_buf_pending(&s->out) < MAX_PENDING_OUTPUT) {
+            ssize_t n = shm_read(&s->ch, chunk, sizeof(chunk));
+            if (n < 0) {
+                session_close(s); // The client broke the ring
+                return;
+            }
+            if (n == 0) {
+                break;
+            }
+            moved += n;
+            stats_bytes(n, 0);
+            if (byte_buf_append(&s->in, chunk, n) != 0 || protocol_process(index, &s->in, &s->out, 0) == PROTO_CLOSE) {
+                s->closing = 1; // Exit request, bad request or out of memory
+            }
+        }
+        ssize_t sent = shm_write(&s->ch, s->out.data + s->out.off, byte_buf_pending(&s->out));
+        if (sent < 0) {
+            session_close(s);
+            return;
+        }
+        byte_buf_consume(&s->out, sent);
+        stats_bytes(0, sent);
+        moved += sent;
+
+        if (s->closing && byte_buf_pending(&s->out) == 0) {
+            session_close(s);
+            return;
+        }
+        if (moved == 0 && !shm_wait_prepare(&s->ch, byte_buf_pending(&s->out) > 0)) {
+            return; // Asleep until the client moves data
+        }
+    }
+    uint64_t one = 1; // Still busy: come back after the other sessions
+    if (write(s->ch.wake_fd, &one, sizeof(one)) < 0) {
+        return; // Counter saturated, already due
+    }
+}
+
+// Accept every pending client and give each its rings
+static void attach_clients(void) {
+    while (1) {
+        int sock = accept4(listen_fd, NULL, NULL, SOCK_NONBLOCK | SOCK_CLOEXEC);
+        if (sock < 0) {
+            if (errno == EINTR || errno == ECONNABORTED) {
+                continue;
+            }
+            if (errno != EAGAIN && errno != EWOULDBLOCK) {
+                perror("Accept failed"); // Out of descriptors etc.; retry on the next event
+            }
+            return;
+        }
+
+        shm_session *s = calloc(1, sizeof(*s));
+        if (!s || shm_channel_create(&s->ch, sock) != 0) {
+            perror("Shared-memory attach failed");
+            close(sock);
+            free(s);
+            continue;
+        }
+        struct epoll_event ev;
+        ev.events = EPOLLIN; // Level-triggered; the eventfd is reset before each service
+        ev.data.ptr = s;
+        struct epoll_event hangup;
+        hangup.events = EPOLLIN | EPOLLRDHUP; // The client sends nothing more, so any event is a hang-up
+        hangup.data.ptr = (char *)s + TAG_HANGUP;
+        if (epoll_ctl(epoll_fd, EPOLL_CTL_ADD, s->ch.wake_fd, &ev) < 0 ||
+            epoll_ctl(epoll_fd, EPOLL_CTL_ADD, s->ch.sock, &hangup) < 0) {
+            perror("epoll_ctl");
+            epoll_ctl(epoll_fd, EPOLL_CTL_DEL, s->ch.wake_fd, NULL);
+            shm_close(&s->ch);
+            free(s);
+            continue;
+        }
+        stats_connection(1);
+    }
+}
+
+static void *shm_server_loop(void *arg) {
+    (void)arg;
+    struct epoll_event events[MAX_EVENTS];
+
+    while (1) {
+        int n = epoll_wait(epoll_fd, events, MAX_EVENTS, -1); // Idle here, outside any reader burst
+        if (n < 0) {
+            if (errno == EINTR) {
+                continue;
+            }
+            perror("epoll_wait");
+            exit(EXIT_FAILURE);
+        }
+
+        const cred_index *index = cred_store_enter(reader_slot); // Fixed for this batch of events
+        for (int i = 0; i < n; i++) {
+            uintptr_t data = (uintptr_t)events[i].data.ptr;
+            shm_session *s = (shm_session *)(data & ~(uintptr_t)TAG_HANGUP);
+            if (!s) {
+                attach_clients();
+            } else if (s->closed) {
+                continue; // Closed earlier in this batch
+            } else if (data & TAG_HANGUP) {
+                session_close(s); // Client detached or exited
+            } else {
+                session_service(index, s);
+            }
+        }
+        cred_store_leave(reader_slot); // Lets a reload free the index we just used
+
+        while (closed_sessions) {
+            shm_session *s = closed_sessions;
+            closed_sessions = s->next_closed;
+            free(s);
+        }
+    }
+    return NULL;
+}
+
+int shm_server_start(const char *path) {
+    if ((reader_slot = cred_store_register()) < 0) {
+        fprintf(stderr, "Too many threads\n");
+        return -1;
+    }
+    listen_fd = unix_listen(path, SOMAXCONN);
+    if (listen_fd < 0 || set_nonblocking(listen_fd) < 0) {
+        return -1;
+    }
+    epoll_fd = epoll_create1(EPOLL_CLOEXEC);
+    if (epoll_fd < 0) {
+        perror("epoll_create1");
+        return -1;
+    }
+    struct epoll_event ev;
+    ev.events = EPOLLIN;
+    ev.data.ptr = NULL; // Marks the attach socket
+    if (epoll_ctl(epoll_fd, EPOLL_CTL_ADD, listen_fd, &ev) < 0) {
+        perror("epoll_ctl");
+        return -1;
+    }
+
+    pthread_t thread;
+    if (pthread_create(&thread, NULL, shm_server_loop, NULL) != 0) {
+        perror("pthread_create");
+        return -1;
+    }
+    printf("Shared-memory transport attaching on %s\n", path);
+    fflush(stdout);
+    return 0;
+}
@@ -0,0 +1,12 @@
+// shm_server.h
+// Server side of the shared-memory transport (shm.h). One thread listens on the
+// attach socket, hands each client its own pair of rings and answers their requests
+// with protocol_process, sleeping in epoll on the sessions' eventfds when every ring
+// is empty. It runs next to whichever socket backend serves TCP.
+
+#ifndef _SHM_SERVER_H_
+#define _SHM_SERVER_H_
+
+int shm_server_start(const char *path); // Listen on path and serve from a new thread, -1 on setup error
+
+#endif
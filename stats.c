@@ -0,0 +1,184 @@
+// stats.c
+#include <stdio.h>
+#include <stdlib.h>
+#include <stdarg.h>
+#include <string.h>
+#include <time.h>
+#include "histogram.h"
+#include "log.h"
+#include "stats.h"
+
+// Counters written only by the owning thread
+typedef struct {
+    uint64_t requests[STAT_OP_COUNT]; // Requests answered
+    uint64_t lookups[STAT_OP_COUNT]; // Digests looked up by them
+    uint64_t hits[STAT_OP_COUNT]; // Digests found
+    uint64_t bytes_in; // Bytes read from clients
+    uint64_t bytes_out; // Bytes queued to clients
+    uint64_t opened; // Connections accepted
+    uint64_t closed; // Connections closed
+    histogram latency[STAT_OP_COUNT]; // Nanoseconds from parsing a request to queueing its reply
+} __attribute__((aligned(64))) stats_block;
+
+static const char *op_names[STAT_OP_COUNT] = {
+    "check_username", "check_password", "check_both", "range", "batch", "get_filter", "admin",
+};
+
+static stats_block *blocks[STATS_MAX_THREADS]; // Every thread's counters
+static int block_count; // Entries of `blocks` in use
+static __thread stats_block *local; // This thread's counters, NULL until first use
+static uint64_t started; // stats_now() at stats_init, for the uptime
+
+uint64_t stats_now(void) {
+    struct timespec ts;
+    clock_gettime(CLOCK_MONOTONIC, &ts);
+    return (uint64_t)ts.tv_sec * 1000000000 + ts.tv_nsec;
+}
+
+void stats_init(void) {
+    __atomic_store_n(&started, stats_now(), __ATOMIC_RELAXED);
+}
+
+// This thread's block, created on first use; NULL if there are too many threads
+static stats_block *local_block(void) {
+    if (!local && __atomic_load_n(&block_count, __ATOMIC_RELAXED) < STATS_MAX_THREADS) {
+        stats_block *b;
+        if (posix_memalign((void **)&b, 64, sizeof(*b)) != 0) {
+            return NULL;
+        }
+        memset(b, 0, sizeof(*b));
+        int slot = __atomic_fetch_add(&block_count, 1, __ATOMIC_RELAXED);
+        if (slot >= STATS_MAX_THREADS) {
+            free(b);
+            return NULL;
+        }
+        __atomic_store_n(&blocks[slot], b, __ATOMIC_RELEASE);
+        local = b;
+    }
+    return local;
+}
+
+// Add to a counter only this thread writes; readers may load it at any time
+static inline void bump(uint64_t *counter, uint64_t n) {
+    __atomic_store_n(counter, *counter + n, __ATOMIC_RELAXED);
+}
+
+void stats_request(int op, uint32_t lookups, uint32_t hits, uint64_t start) {
+    stats_block *b = local_block();
+    if (!b) {
+        return;
+    }
+    bump(&b->requests[op], 1);
+    bump(&b->lookups[op], lookups);
+    bump(&b->hits[op], hits);
+    hist_record(&b->latency[op], stats_now() - start);
+}
+
+void stats_bytes(size_t in, size_t out) {
+    stats_block *b = local_block();
+    if (b) {
+        bump(&b->bytes_in, in);
+        bump(&b->bytes_out, out);
+    }
+}
+
+void stats_connection(int opened) {
+    stats_block *b = local_block();
+    if (b) {
+        bump(opened ? &b->opened : &b->closed, 1);
+    }
+}
+
+// Append one "<name> <value>" line
+__attribute__((format(printf, 5, 6)))
+static void line(char *buf, size_t size, size_t *len, int *lines, const char *fmt, ...) {
+    if (*len >= size) {
+        return;
+    }
+    va_list args;
+    va_start(args, fmt);
+    int n = vsnprintf(buf + *len, size - *len, fmt, args);
+    va_end(args);
+    if (n > 0 && (size_t)n < size - *len) {
+        *len += n;
+        (*lines)++;
+    } else {
+        *len = size; // Out of room; the caller sized the buffer for every line
+    }
+}
+
+size_t stats_format(const cred_index *index, char *buf, size_t size) {
+    static __thread histogram merged; // 30 KB, too large for the stack of every caller
+    uint64_t requests[STAT_OP_COUNT] = {0}, lookups[STAT_OP_COUNT] = {0}, hits[STAT_OP_COUNT] = {0};
+    uint64_t bytes_in = 0, bytes_out = 0, opened = 0, closed = 0;
+    int count = __atomic_load_n(&block_count, __ATOMIC_ACQUIRE);
+    for (int t = 0; t < count && t < STATS_MAX_THREADS; t++) {
+        const stats_block *b = __atomic_load_n(&blocks[t], __ATOMIC_ACQUIRE);
+        if (!b) {
+            continue; // Registered but not published yet
+        }
+        for (int op = 0; op < STAT_OP_COUNT; op++) {
+            requests[op] += __atomic_load_n(&b->requests[op], __ATOMIC_RELAXED);
+            lookups[op] += __atomic_load_n(&b->lookups[op], __ATOMIC_RELAXED);
+            hits[op] += __atomic_load_n(&b->hits[op], __ATOMIC_RELAXED);
+        }
+        bytes_in += __atomic_load_n(&b->bytes_in, __ATOMIC_RELAXED);
+        bytes_out += __atomic_load_n(&b->bytes_out, __ATOMIC_RELAXED);
+        opened += __atomic_load_n(&b->opened, __ATOMIC_RELAXED);
+        closed += __atomic_load_n(&b->closed, __ATOMIC_RELAXED);
+    }
+
+    char body[STATS_TEXT_SIZE];
+    size_t len = 0;
+    int lines = 0;
+    uint64_t since = __atomic_load_n(&started, __ATOMIC_RELAXED);
+    line(body, sizeof(body), &len, &lines, "uptime_seconds %.3f\n", since ? (stats_now() - since) / 1e9 : 0.0);
+    line(body, sizeof(body), &len, &lines, "connections_active %llu\n", (unsigned long long)(opened - closed));
+    line(body, sizeof(body), &len, &lines, "connections_total %llu\n", (unsigned long long)opened);
+    line(body, sizeof(body), &len, &lines, "bytes_in %llu\n", (unsigned long long)bytes_in);
+    line(body, sizeof(body), &len, &lines, "bytes_out %llu\n", (unsigned long long)bytes_out);
+    line(body, sizeof(body), &len, &lines, "log_dropped %llu\n", (unsigned long long)log_dropped());
+    line(body, sizeof(body), &len, &lines, "usernames %zu\n", index->usernames.count);
+    line(body, sizeof(body), &len, &lines, "passwords %zu\n", index->passwords.count);
+    line(body, sizeof(body), &len, &lines, "pairs %zu\n", index->pairs.count);
+    const digest_filter *filters[2] = {&index->usernames.filter, &index->passwords.filter};
+    for (int f = 0; f < 2; f++) {
+        const filter_counters *c = filters[f]->counters;
+        const char *name = f == 0 ? "username" : "password";
+        line(body, sizeof(body), &len, &lines, "filter_%s_rejected %llu\n", name,
+             (unsigned long long)(c ? __atomic_load_n(&c->rejected, __ATOMIC_RELAXED) : 0));
+        line(body, sizeof(body), &len, &lines, "filter_%s_false_positives %llu\n", name,
+             (unsigned long long)(c ? __atomic_load_n(&c->false_positives, __ATOMIC_RELAXED) : 0));
+    }
+
+    for (int op = 0; op < STAT_OP_COUNT; op++) {
+        memset(&merged, 0, sizeof(merged));
+        for (int t = 0; t < count && t < STATS_MAX_THREADS; t++) {
+            const stats_block *b = __atomic_load_n(&blocks[t], __ATOMIC_ACQUIRE);
+            if (b) {
+                hist_merge(&merged, &b->latency[op]);
+            }
+        }
+        const char *name = op_names[op];
+        line(body, sizeof(body), &len, &lines, "%s_requests %llu\n", name, (unsigned long long)requests[op]);
+        line(body, sizeof(body), &len, &lines, "%s_lookups %llu\n", name, (unsigned long long)lookups[op]);
+        line(body, sizeof(body), &len, &lines, "%s_hits %llu\n", name, (unsigned long long)hits[op]);
+        line(body, sizeof(body), &len, &lines, "%s_misses %llu\n", name, (unsigned long long)(lookups[op] - hits[op]));
+        static const struct {
+            const char *suffix;
+            double percentile;
+        } points[] = {{"p50", 50}, {"p90", 90}, {"p99", 99}, {"p999", 99.9}};
+        for (size_t p = 0; p < sizeof(points) / sizeof(points[0]); p++) {
+            line(body, sizeof(body), &len, &lines, "%s_latency_%s_us %.3f\n", name, points[p].suffix,
+                 hist_percentile(&merged, points[p].percentile) / 1e3);
+        }
+        line(body, sizeof(body), &len, &lines, "%s_latency_max_us %.3f\n", name, merged.max / 1e3);
+    }
+
+    int header = snprintf(buf, size, "Stats %d\n", lines);
+    if (header < 0 || (size_t)header + len >= size) {
+        return 0; // Caller's buffer is too small
+    }
+    memcpy(buf + header, body, len);
+    return header + len;
+}
@@ -0,0 +1,38 @@
+// stats.h
+// Server instrumentation. Every thread that answers requests records into its own
+// cache-line-aligned block of counters and per-operation latency histograms, created
+// on first use, so recording is a few plain stores with no shared cache lines or
+// atomic read-modify-writes. Readers sum the blocks of every thread. A snapshot taken
+// while traffic flows may count a request in one field and not yet in another.
+//
+// stats_format renders a snapshot the way the "stats" command returns it:
+//   Stats <n>\n followed by n "<name> <value>\n" lines,
+// with a fixed set of names, so the output of successive polls lines up.
+
+#ifndef _STATS_H_
+#define _STATS_H_
+
+#include <stddef.h>
+#include <stdint.h>
+#include "cred_index.h"
+
+#define STAT_CHECK_USERNAME 0 // check_username requests
+#define STAT_CHECK_PASSWORD 1 // check_password requests
+#define STAT_CHECK_BOTH 2 // check_both requests
+#define STAT_RANGE 3 // range: requests
+#define STAT_BATCH 4 // Binary CHECK_BATCH frames
+#define STAT_FILTER 5 // Binary GET_FILTER frames
+#define STAT_ADMIN 6 // reload_full, reload_delta and stats
+#define STAT_OP_COUNT 7
+
+#define STATS_MAX_THREADS 256 // Threads that can record; later ones are not counted
+#define STATS_TEXT_SIZE 16384 // Enough for every line stats_format writes
+
+void stats_init(void); // Start the uptime clock, before any thread records
+uint64_t stats_now(void); // Monotonic nanoseconds, for request start times
+void stats_request(int op, uint32_t lookups, uint32_t hits, uint64_t start); // Count one answered request
+void stats_bytes(size_t in, size_t out); // Count bytes read from and written to clients
+void stats_connection(int opened); // Count a connection opening (1) or closing (0)
+size_t stats_format(const cred_index *index, char *buf, size_t size); // Render a snapshot, returns its length
+
+#endif
@@ -0,0 +1,161 @@
+// tests/breachcheck_test.c
+// libbreachcheck against a server played by this process on a Unix domain socket,
+// answering through protocol_process with the fixture index: checks are answered,
+// a server that stops replying or goes away makes requests time out on schedule
+// rather than hang, and a cancelled request never calls back.
+// Usage: tests/breachcheck_test <index_file> <plain_credentials_file>
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+#include <unistd.h>
+#include <time.h>
+#include <sys/socket.h>
+#include "breachcheck.h"
+#include "protocol.h"
+#include "net.h"
+#include "check.h"
+
+#define TIMEOUT_MS 100 // Per-request timeout given to the client
+#define MAX_CONNS 4 // Connections the fake server keeps
+
+// Fake server: answers while `silent` is 0, otherwise reads nothing and sends nothing
+typedef struct {
+    const cred_index *index;
+    int listen_fd;
+    int fds[MAX_CONNS];
+    byte_buf in[MAX_CONNS];
+    int silent;
+} fake_server;
+
+// Outcome reported to a callback
+typedef struct {
+    int calls;
+    int status;
+    int found;
+} result;
+
+static void on_result(void *arg, uint64_t handle, int status, int found) {
+    (void)handle;
+    result *r = arg;
+    r->calls++;
+    r->status = status;
+    r->found = found;
+}
+
+static double now_ms(void) {
+    struct timespec ts;
+    clock_gettime(CLOCK_MONOTONIC, &ts);
+    return ts.tv_sec * 1e3 + ts.tv_nsec / 1e6;
+}
+
+// Accept and answer whatever has arrived, without blocking
+static void serve(fake_server *s) {
+    if (s->silent || s->listen_fd < 0) {
+        return;
+    }
+    int fd;
+    while ((fd = accept(s->listen_fd, NULL, NULL)) >= 0) {
+        int slot = 0;
+        while (slot < MAX_CONNS && s->fds[slot] >= 0) {
+            slot++;
+        }
+        if (slot == MAX_CONNS || set_nonblocking(fd) != 0) {
+            close(fd);
+            continue;
+        }
+        s->fds[slot] = fd;
+    }
+    for (int i = 0; i < MAX_CONNS; i++) {
+        char buf[4096];
+        ssize_t n;
+        while (s->fds[i] >= 0 && (n = read(s->fds[i], buf, sizeof(buf))) > 0) {
+            byte_buf out = {0};
+            byte_buf_append(&s->in[i], buf, n);
+            protocol_process(s->index, &s->in[i], &out, 0);
+            if (write(s->fds[i], out.data + out.off, byte_buf_pending(&out)) < 0) {
+                perror("write");
+            }
+            byte_buf_free(&out);
+        }
+    }
+}
+
+// Run the client and the server until `r` has been called back or `ms` have passed
+static void pump(bc_client *client, fake_server *s, result *r, double ms) {
+    double end = now_ms() + ms;
+    while ((!r || r->calls == 0) && now_ms() < end) {
+        serve(s);
+        bc_process(client, 5);
+    }
+}
+
+int main(int argc, char *argv[]) {
+    if (argc != 3) {
+        fprintf(stderr, "Usage: %s <index_file> <plain_credentials_file>\n", argv[0]);
+        exit(EXIT_FAILURE);
+    }
+    cred creds[CHECK_MAX_CREDS];
+    CHECK(load_fixture(argv[2], creds) == 5);
+    cred_index index;
+    if (cred_index_open(&index, argv[1]) != 0) {
+        perror("Failed to open index");
+        exit(EXIT_FAILURE);
+    }
+    char path[64];
+    snprintf(path, sizeof(path), "/tmp/breachcheck_test.%d.sock", (int)getpid());
+    fake_server server = {&index, unix_listen(path, 16), {-1, -1, -1, -1}, {{0}}, 0};
+    if (server.listen_fd < 0 || set_nonblocking(server.listen_fd) != 0) {
+        perror("Failed to listen");
+        exit(EXIT_FAILURE);
+    }
+    bc_options options = {path, 0, 2, TIMEOUT_MS, 20, 0};
+    bc_client *client = bc_create(&options);
+    CHECK(client != NULL);
+
+    // Answered checks: a listed line, an unlisted one, and a username alone
+    result listed = {0}, unlisted = {0}, username = {0};
+    CHECK(bc_check(client, "admin@xyz.com", 13, "password", 8, on_result, &listed) != 0);
+    CHECK(bc_check(client, "stranger@xyz.com", 16, "guess", 5, on_result, &unlisted) != 0);
+    CHECK(bc_check(client, "user1@abc.com", 13, NULL, 0, on_result, &username) != 0);
+    pump(client, &server, NULL, 50);
+    CHECK(listed.calls == 1 && listed.status == BC_OK && listed.found == (BC_FOUND_USERNAME | BC_FOUND_PASSWORD));
+    CHECK(unlisted.calls == 1 && unlisted.status == BC_OK && unlisted.found == 0);
+    CHECK(username.calls == 1 && username.status == BC_OK && username.found == BC_FOUND_USERNAME);
+    CHECK(bc_pending(client) == 0);
+
+    // A server that stops answering: the request times out after TIMEOUT_MS, not before
+    server.silent = 1;
+    result stalled = {0};
+    double start = now_ms();
+    CHECK(bc_check(client, "admin@xyz.com", 13, "password", 8, on_result, &stalled) != 0);
+    pump(client, &server, &stalled, 10 * TIMEOUT_MS);
+    double waited = now_ms() - start;
+    CHECK(stalled.calls == 1 && stalled.status == BC_TIMEOUT);
+    CHECK(waited >= TIMEOUT_MS - 1 && waited < 5 * TIMEOUT_MS);
+
+    // A cancelled request never calls back
+    result cancelled = {0};
+    uint64_t handle = bc_check(client, "admin@xyz.com", 13, NULL, 0, on_result, &cancelled);
+    CHECK(handle != 0 && bc_cancel(client, handle) == 0 && bc_cancel(client, handle) == -1);
+    pump(client, &server, NULL, 2 * TIMEOUT_MS);
+    CHECK(cancelled.calls == 0 && bc_pending(client) == 0);
+
+    // A server that is gone: reconnects fail and the request still times out
+    for (int i = 0; i < MAX_CONNS; i++) {
+        if (server.fds[i] >= 0) {
+            close(server.fds[i]);
+        }
+        byte_buf_free(&server.in[i]);
+    }
+    close(server.listen_fd);
+    server.listen_fd = -1;
+    unlink(path);
+    result gone = {0};
+    CHECK(bc_check(client, "admin@xyz.com", 13, "password", 8, on_result, &gone) != 0);
+    pump(client, &server, &gone, 10 * TIMEOUT_MS);
+    CHECK(gone.calls == 1 && gone.status == BC_TIMEOUT && bc_pending(client) == 0);
+
+    bc_destroy(client);
+    cred_index_free(&index);
+    return check_report("breachcheck_test");
+}
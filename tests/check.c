@@ -0,0 +1,51 @@
+// tests/check.c
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+#include "check.h"
+
+static int checks, failures; // Checks run and failed
+
+void check(int ok, const char *what, const char *file, int line) {
+    checks++;
+    if (!ok) {
+        fprintf(stderr, "%s:%d: check failed: %s\n", file, line, what);
+        failures++;
+    }
+}
+
+int check_report(const char *name) {
+    printf("%s: %d checks, %d failed\n", name, checks, failures);
+    return failures ? EXIT_FAILURE : EXIT_SUCCESS;
+}
+
+void hash_cred(const char *username, const char *password, cred *c) {
+    SHA256_CTX ctx;
+    sha256_init(&ctx);
+    sha256_update(&ctx, (const uint8_t *)username, strlen(username));
+    sha256_final(&ctx, c->username);
+    sha256_init(&ctx);
+    sha256_update(&ctx, (const uint8_t *)password, strlen(password));
+    sha256_final(&ctx, c->password);
+}
+
+int load_fixture(const char *filename, cred *creds) {
+    FILE *file = fopen(filename, "r");
+    if (!file) {
+        perror("Failed to open fixture");
+        exit(EXIT_FAILURE);
+    }
+    char line[256];
+    int count = 0;
+    while (count < CHECK_MAX_CREDS && fgets(line, sizeof(line), file)) {
+        line[strcspn(line, "\r\n")] = '\0';
+        char *colon = strchr(line, ':'); // Passwords may contain ':', usernames may not
+        if (!colon) {
+            continue;
+        }
+        *colon = '\0';
+        hash_cred(line, colon + 1, &creds[count++]);
+    }
+    fclose(file);
+    return count;
+}
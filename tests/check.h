@@ -0,0 +1,26 @@
+// tests/check.h
+// Helpers shared by the test programs `make test` runs: a CHECK macro that counts
+// failures and carries on, so one run reports every broken check, and the lines of a
+// plain "user:password" fixture hashed the way build-index -p hashes them.
+
+#ifndef _CHECK_H_
+#define _CHECK_H_
+
+#include <stdint.h>
+#include "sha256_lib.h"
+
+#define CHECK_MAX_CREDS 16 // Lines read from a fixture
+#define CHECK(cond) check((cond), #cond, __FILE__, __LINE__)
+
+// Username and password digests of one "user:password" line
+typedef struct {
+    uint8_t username[SHA256_DIGEST_SIZE];
+    uint8_t password[SHA256_DIGEST_SIZE];
+} cred;
+
+void check(int ok, const char *what, const char *file, int line); // Count one check, report it if it failed
+int check_report(const char *name); // Print the totals, EXIT_SUCCESS if every check passed
+void hash_cred(const char *username, const char *password, cred *c); // Digests of one line
+int load_fixture(const char *filename, cred *creds); // Hash up to CHECK_MAX_CREDS lines, returns how many
+
+#endif
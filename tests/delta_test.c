@@ -0,0 +1,141 @@
+// tests/delta_test.c
+// Delta files merged into the fixture index the way reload.c merges them: a removed
+// line takes out its pair and only the digests no remaining line holds, re-merging a
+// delta changes nothing, an index without line counts refuses removals, and a shard
+// keeps only the digests and pairs it owns.
+// Usage: tests/delta_test <index_file> <plain_credentials_file>
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+#include <unistd.h>
+#include <errno.h>
+#include "cred_index.h"
+#include "check.h"
+
+// Write `text` to a new temporary file named in `path`
+static void write_temp(char path[64], const char *text) {
+    snprintf(path, 64, "/tmp/delta_test.XXXXXX");
+    int fd = mkstemp(path);
+    FILE *file = fd >= 0 ? fdopen(fd, "w") : NULL;
+    if (!file || fputs(text, file) == EOF || fclose(file) != 0) {
+        perror("Failed to write temporary file");
+        exit(EXIT_FAILURE);
+    }
+}
+
+// Append one "<op><hex>:<hex>" delta line to `text`
+static void delta_line(char *text, char op, const cred *c) {
+    char username[SHA256_HEX_SIZE + 1], password[SHA256_HEX_SIZE + 1];
+    digest_to_hex(c->username, username);
+    digest_to_hex(c->password, password);
+    sprintf(text + strlen(text), "%c%s:%s\n", op, username, password);
+}
+
+// Merge the delta `text` into base, 0 on success
+static int merge(cred_index *index, const cred_index *base, const char *text,
+                 const shard_map *map, int shard) {
+    char path[64];
+    write_temp(path, text);
+    int status = cred_index_apply_delta(index, base, path, map, shard);
+    unlink(path);
+    return status;
+}
+
+static int holds_line(const cred_index *index, const cred *c) {
+    return pair_set_contains(&index->pairs, pair_fingerprint(c->username, c->password));
+}
+
+int main(int argc, char *argv[]) {
+    if (argc != 3) {
+        fprintf(stderr, "Usage: %s <index_file> <plain_credentials_file>\n", argv[0]);
+        exit(EXIT_FAILURE);
+    }
+    cred creds[CHECK_MAX_CREDS];
+    CHECK(load_fixture(argv[2], creds) == 5);
+    const cred *admin = &creds[0], *user2 = &creds[2]; // Both use "password"
+    cred fresh;
+    hash_cred("fresh@abc.com", "n3w-passw0rd", &fresh);
+
+    cred_index base;
+    if (cred_index_map(&base, argv[1]) != 0) {
+        perror("Failed to open index");
+        exit(EXIT_FAILURE);
+    }
+    CHECK(base.usernames.refs != NULL && base.passwords.refs != NULL);
+
+    // user2's line goes, but admin still holds its password
+    char text[4096] = "";
+    delta_line(text, '-', user2);
+    delta_line(text, '+', &fresh);
+    delta_line(text, '+', admin); // Already held: no second count for "password"
+    cred_index merged;
+    CHECK(merge(&merged, &base, text, NULL, 0) == 0);
+    CHECK(!digest_set_contains(&merged.usernames, user2->username));
+    CHECK(digest_set_contains(&merged.passwords, user2->password));
+    CHECK(!holds_line(&merged, user2) && holds_line(&merged, admin));
+    CHECK(digest_set_contains(&merged.usernames, fresh.username));
+    CHECK(digest_set_contains(&merged.passwords, fresh.password) && holds_line(&merged, &fresh));
+    CHECK(merged.usernames.count == 5 && merged.passwords.count == 5 && merged.pairs.count == 5);
+
+    // The same lines again change nothing
+    cred_index again;
+    CHECK(merge(&again, &merged, text, NULL, 0) == 0);
+    CHECK(again.usernames.count == 5 && again.passwords.count == 5 && again.pairs.count == 5);
+    CHECK(memcmp(again.passwords.refs, merged.passwords.refs, merged.passwords.count * DIGEST_REF_SIZE) == 0);
+    cred_index_free(&again);
+
+    // Removing admin's line too leaves no line holding "password"
+    char last[4096] = "";
+    delta_line(last, '-', admin);
+    CHECK(merge(&again, &merged, last, NULL, 0) == 0);
+    CHECK(!digest_set_contains(&again.passwords, admin->password));
+    CHECK(!digest_set_contains(&again.usernames, admin->username));
+    cred_index_free(&again);
+    cred_index_free(&merged);
+
+    // An index written without line counts accepts additions only
+    char uncounted[64];
+    write_temp(uncounted, "");
+    cred_index_writer w;
+    CHECK(cred_index_writer_open(&w, uncounted) == 0 &&
+          cred_index_writer_put(&w, 0, base.usernames.digests, NULL, base.usernames.count) == 0 &&
+          cred_index_writer_put(&w, 1, base.passwords.digests, NULL, base.passwords.count) == 0 &&
+          cred_index_writer_put_pairs(&w, base.pairs.keys, base.pairs.count) == 0 &&
+          cred_index_writer_close(&w) == 0);
+    cred_index old;
+    CHECK(cred_index_map(&old, uncounted) == 0 && cred_index_verify(&old) == 0);
+    CHECK(old.usernames.refs == NULL);
+    char add_only[4096] = "";
+    delta_line(add_only, '+', &fresh);
+    CHECK(merge(&merged, &old, add_only, NULL, 0) == 0 && digest_set_contains(&merged.usernames, fresh.username));
+    cred_index_free(&merged);
+    errno = 0;
+    CHECK(merge(&merged, &old, text, NULL, 0) == -1 && errno == EINVAL);
+    cred_index_free(&old);
+    unlink(uncounted);
+
+    // Each shard keeps the lines it owns
+    char map_file[64];
+    write_temp(map_file, "a 127.0.0.1:1\nb 127.0.0.1:2\n");
+    shard_map map;
+    CHECK(shard_map_load(&map, map_file) == 0);
+    unlink(map_file);
+    for (int shard = 0; shard < map.count; shard++) {
+        cred_index owned;
+        CHECK(cred_index_select(&owned, &base, &map, shard) == 0);
+        CHECK(merge(&merged, &owned, text, &map, shard) == 0);
+        for (size_t i = 0; i < merged.usernames.count; i++) {
+            CHECK(shard_owner(&map, merged.usernames.digests[i]) == shard);
+        }
+        CHECK(pair_set_owned(&merged.pairs, &map, shard));
+        CHECK(digest_set_contains(&merged.usernames, fresh.username) ==
+              (shard_owner(&map, fresh.username) == shard));
+        CHECK(!digest_set_contains(&merged.usernames, user2->username));
+        cred_index_free(&merged);
+        cred_index_free(&owned);
+    }
+    shard_map_free(&map);
+
+    cred_index_free(&base);
+    return check_report("delta_test");
+}
@@ -0,0 +1,128 @@
+// tests/ingest_test.c
+// build-index's streaming ingest under a memory budget small enough to spill many
+// sorted runs: the merged index file must hold the same digests, line counts and pairs
+// as the credentials file loaded in memory, whether the inputs are plain lines hashed
+// on the way in or hex digests, and repeated lines across inputs must count once.
+// Usage: tests/ingest_test
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+#include <unistd.h>
+#include "cred_index.h"
+#include "ingest.h"
+#include "check.h"
+
+#define LINES 20000 // Distinct lines written
+#define REPEATED 1000 // Of which the first are written again in a second input
+#define USERNAMES 9000 // Line i uses username i % USERNAMES
+#define PASSWORDS 700 // and password i % PASSWORDS
+
+static char dir[] = "/tmp/ingest_test.XXXXXX";
+
+static void line_text(int i, char *username, char *password) {
+    sprintf(username, "user%d@abc.com", i % USERNAMES);
+    sprintf(password, "pw%d", i % PASSWORDS);
+}
+
+// Write lines [first, last) to dir/name, as plain text or hex digests; returns the path
+static char *write_input(const char *name, int first, int last, int plain) {
+    static char paths[4][64];
+    static int used;
+    char *path = paths[used++];
+    snprintf(path, sizeof(paths[0]), "%s/%s", dir, name);
+    FILE *file = fopen(path, "w");
+    if (!file) {
+        perror("Failed to write input");
+        exit(EXIT_FAILURE);
+    }
+    for (int i = first; i < last; i++) {
+        char username[32], password[32];
+        line_text(i, username, password);
+        if (plain) {
+            fprintf(file, "%s:%s\n", username, password);
+        } else {
+            cred c;
+            char uhex[SHA256_HEX_SIZE + 1], phex[SHA256_HEX_SIZE + 1];
+            hash_cred(username, password, &c);
+            digest_to_hex(c.username, uhex);
+            digest_to_hex(c.password, phex);
+            fprintf(file, "%s:%s\n", uhex, phex);
+        }
+    }
+    fclose(file);
+    return path;
+}
+
+// Line count stored for `digest`, 0 if the set does not hold it
+static uint32_t line_count(const digest_set *set, const uint8_t *digest) {
+    for (size_t i = 0; i < set->count; i++) {
+        if (memcmp(set->digests[i], digest, SHA256_DIGEST_SIZE) == 0) {
+            const uint8_t *r = set->refs[i];
+            return ((uint32_t)r[0] << 24) | ((uint32_t)r[1] << 16) | ((uint32_t)r[2] << 8) | r[3];
+        }
+    }
+    return 0;
+}
+
+static int same_set(const digest_set *a, const digest_set *b) {
+    return a->count == b->count && a->refs && b->refs &&
+           memcmp(a->digests, b->digests, a->count * SHA256_DIGEST_SIZE) == 0 &&
+           memcmp(a->refs, b->refs, a->count * DIGEST_REF_SIZE) == 0;
+}
+
+// Ingest `inputs` with the smallest run buffers ingest allows, compare with `expected`
+static void check_ingest(const char *const *inputs, int count, int plain, const cred_index *expected) {
+    char output[64];
+    snprintf(output, sizeof(output), "%s/out.idx", dir);
+    ingest_options options = {plain, 2, 1, dir, NULL, 0}; // A 1-byte budget: every buffer is as small as allowed
+    ingest_totals totals;
+    memset(&totals, 0, sizeof(totals));
+    CHECK(ingest_files(inputs, count, output, &options, &totals) == 0);
+    CHECK(totals.runs > 2 && totals.lines == LINES + REPEATED && totals.skipped == 0);
+    CHECK(totals.unique[0] == USERNAMES && totals.unique[1] == PASSWORDS && totals.unique[2] == LINES);
+
+    cred_index index;
+    if (cred_index_map(&index, output) != 0) {
+        perror("Failed to map ingested index");
+        exit(EXIT_FAILURE);
+    }
+    CHECK(cred_index_verify(&index) == 0);
+    CHECK(same_set(&index.usernames, &expected->usernames));
+    CHECK(same_set(&index.passwords, &expected->passwords));
+    CHECK(index.pairs.count == expected->pairs.count &&
+          memcmp(index.pairs.keys, expected->pairs.keys, index.pairs.count * PAIR_KEY_SIZE) == 0);
+    cred_index_free(&index);
+    unlink(output);
+}
+
+int main(void) {
+    if (!mkdtemp(dir)) {
+        perror("Failed to create temporary directory");
+        exit(EXIT_FAILURE);
+    }
+    const char *plain[2] = {write_input("plain.txt", 0, LINES, 1), write_input("again.txt", 0, REPEATED, 1)};
+    const char *hex[2] = {write_input("hex.txt", 0, LINES, 0), write_input("again-hex.txt", 0, REPEATED, 0)};
+
+    cred_index expected; // The same lines parsed and counted in memory
+    if (cred_index_load(&expected, hex[0]) != 0) {
+        perror("Failed to load credentials");
+        exit(EXIT_FAILURE);
+    }
+    CHECK(expected.usernames.count == USERNAMES && expected.passwords.count == PASSWORDS);
+    cred c;
+    hash_cred("user0@abc.com", "pw0", &c); // Lines 0, 9000 and 18000; 0, 700, ... 19600
+    CHECK(line_count(&expected.usernames, c.username) == 3 && line_count(&expected.passwords, c.password) == 29);
+    hash_cred("user5000@abc.com", "pw500", &c); // Lines 5000 and 14000; 500, 1200, ... 19400
+    CHECK(line_count(&expected.usernames, c.username) == 2 && line_count(&expected.passwords, c.password) == 28);
+
+    check_ingest(plain, 2, 1, &expected);
+    check_ingest(hex, 2, 0, &expected);
+
+    cred_index_free(&expected);
+    for (int i = 0; i < 2; i++) {
+        unlink(plain[i]);
+        unlink(hex[i]);
+    }
+    rmdir(dir);
+    return check_report("ingest_test");
+}
@@ -0,0 +1,91 @@
+// tests/pair_test.c
+// The pair section of the fixture index: check_both tells a username and password
+// breached on one line (FoundPair) from ones breached on different lines, CHECK_BATCH
+// with BIN_FIELD_PAIR sets a bit per pair, and an index written without pairs answers
+// FoundBoth and refuses pair batches.
+// Usage: tests/pair_test <index_file> <plain_credentials_file>
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+#include <unistd.h>
+#include "cred_index.h"
+#include "check.h"
+#include "wire.h"
+
+// Reply to check_both for a username and password digest
+static const char *both(const cred_index *index, const uint8_t *username, const uint8_t *password) {
+    return text_reply(index, TEXT_CHECK_BOTH, username, password, 0);
+}
+
+// Status and bitmap of a BIN_FIELD_PAIR batch of `count` username/password items
+static int pair_batch(const cred_index *index, const uint8_t *items, uint32_t count, uint8_t *bits) {
+    uint8_t frame[BIN_HEADER_SIZE + 8 * SHA256_DIGEST_SIZE * 2];
+    byte_buf in = {0}, out = {0};
+    byte_buf_append(&in, frame, batch_frame(frame, BIN_FIELD_PAIR, 5, items, count));
+    protocol_process(index, &in, &out, 0);
+    bin_header hdr;
+    int status = -1;
+    if (byte_buf_pending(&out) >= BIN_HEADER_SIZE && bin_header_decode((uint8_t *)out.data + out.off, &hdr) == 0) {
+        status = hdr.field;
+        *bits = hdr.length == 1 ? (uint8_t)out.data[out.off + BIN_HEADER_SIZE] : 0;
+    }
+    byte_buf_free(&in);
+    byte_buf_free(&out);
+    return status;
+}
+
+int main(int argc, char *argv[]) {
+    if (argc != 3) {
+        fprintf(stderr, "Usage: %s <index_file> <plain_credentials_file>\n", argv[0]);
+        exit(EXIT_FAILURE);
+    }
+    cred creds[CHECK_MAX_CREDS];
+    int count = load_fixture(argv[2], creds);
+    CHECK(count == 5);
+    cred_index index;
+    if (cred_index_open(&index, argv[1]) != 0) {
+        perror("Failed to open index");
+        exit(EXIT_FAILURE);
+    }
+    cred stranger;
+    hash_cred("stranger@xyz.com", "guess", &stranger);
+    const cred *admin = &creds[0], *user1 = &creds[1];
+
+    CHECK(index.pairs.indexed && index.pairs.count == (size_t)count);
+    for (int i = 0; i < count; i++) {
+        CHECK(strcmp(both(&index, creds[i].username, creds[i].password), "FoundPair") == 0);
+    }
+    CHECK(strcmp(both(&index, admin->username, user1->password), "FoundBoth") == 0); // Different lines
+    CHECK(strcmp(both(&index, admin->username, stranger.password), "FoundUsernameOnly") == 0);
+    CHECK(strcmp(both(&index, stranger.username, admin->password), "FoundPasswordOnly") == 0);
+    CHECK(strcmp(both(&index, stranger.username, stranger.password), "NotFound") == 0);
+
+    // Items: admin's line, admin with user1's password, user1's line
+    uint8_t items[3 * SHA256_DIGEST_SIZE * 2];
+    const cred *halves[3][2] = {{admin, admin}, {admin, user1}, {user1, user1}};
+    for (int i = 0; i < 3; i++) {
+        memcpy(items + i * 2 * SHA256_DIGEST_SIZE, halves[i][0]->username, SHA256_DIGEST_SIZE);
+        memcpy(items + (i * 2 + 1) * SHA256_DIGEST_SIZE, halves[i][1]->password, SHA256_DIGEST_SIZE);
+    }
+    uint8_t bits = 0xff;
+    CHECK(pair_batch(&index, items, 3, &bits) == BIN_STATUS_OK && bits == 0x05);
+
+    // The same digests written without a pair section
+    char path[64];
+    snprintf(path, sizeof(path), "/tmp/pair_test.%d.idx", (int)getpid());
+    cred_index_writer w;
+    CHECK(cred_index_writer_open(&w, path) == 0 &&
+          cred_index_writer_put(&w, 0, index.usernames.digests, index.usernames.refs, index.usernames.count) == 0 &&
+          cred_index_writer_put(&w, 1, index.passwords.digests, index.passwords.refs, index.passwords.count) == 0 &&
+          cred_index_writer_close(&w) == 0);
+    cred_index unpaired;
+    CHECK(cred_index_map(&unpaired, path) == 0 && cred_index_verify(&unpaired) == 0);
+    unlink(path);
+    CHECK(!unpaired.pairs.indexed);
+    CHECK(strcmp(both(&unpaired, admin->username, admin->password), "FoundBoth") == 0);
+    CHECK(pair_batch(&unpaired, items, 3, &bits) == BIN_STATUS_UNSUPPORTED);
+    cred_index_free(&unpaired);
+
+    cred_index_free(&index);
+    return check_report("pair_test");
+}
@@ -0,0 +1,107 @@
+// tests/protocol_test.c
+// The binary protocol as protocol_process sees it on a stream: CHECK_BATCH frames
+// answered with bitmaps, frames split across reads or pipelined into one, text and
+// binary requests interleaved, and malformed frames refused with the right status.
+// Usage: tests/protocol_test <index_file> <plain_credentials_file>
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+#include "cred_index.h"
+#include "check.h"
+#include "wire.h"
+
+// Status of the reply header at `off` in `out`, -1 if there is none or its ID differs
+static int reply_status(const byte_buf *out, size_t off, uint32_t request_id) {
+    bin_header hdr;
+    if (byte_buf_pending(out) < off + BIN_HEADER_SIZE ||
+        bin_header_decode((const uint8_t *)out->data + out->off + off, &hdr) != 0 || hdr.request_id != request_id) {
+        return -1;
+    }
+    return hdr.field;
+}
+
+int main(int argc, char *argv[]) {
+    if (argc != 3) {
+        fprintf(stderr, "Usage: %s <index_file> <plain_credentials_file>\n", argv[0]);
+        exit(EXIT_FAILURE);
+    }
+    cred creds[CHECK_MAX_CREDS];
+    CHECK(load_fixture(argv[2], creds) == 5);
+    cred_index index;
+    if (cred_index_open(&index, argv[1]) != 0) {
+        perror("Failed to open index");
+        exit(EXIT_FAILURE);
+    }
+    cred stranger;
+    hash_cred("stranger@xyz.com", "guess", &stranger);
+
+    // Three usernames, the middle one unlisted: bits 0 and 2
+    uint8_t items[4 * SHA256_DIGEST_SIZE * 2];
+    memcpy(items, creds[0].username, SHA256_DIGEST_SIZE);
+    memcpy(items + SHA256_DIGEST_SIZE, stranger.username, SHA256_DIGEST_SIZE);
+    memcpy(items + 2 * SHA256_DIGEST_SIZE, creds[3].username, SHA256_DIGEST_SIZE);
+    uint8_t frame[2 * (BIN_HEADER_SIZE + sizeof(items))];
+    size_t len = batch_frame(frame, BIN_FIELD_USERNAME, 7, items, 3);
+
+    // Split mid-header, then mid-payload: nothing is answered until the frame is whole
+    byte_buf in = {0}, out = {0};
+    size_t cuts[] = {5, 40, len};
+    size_t fed = 0;
+    for (int i = 0; i < 3; i++) {
+        byte_buf_append(&in, frame + fed, cuts[i] - fed);
+        fed = cuts[i];
+        CHECK(protocol_process(&index, &in, &out, 0) == PROTO_OK);
+        CHECK(byte_buf_pending(&out) == (i < 2 ? 0 : BIN_HEADER_SIZE + 1));
+    }
+    CHECK(batch_answer((const uint8_t *)out.data + out.off, byte_buf_pending(&out), 7, 0x05));
+    byte_buf_free(&out);
+
+    // Two frames and a text request in one read are answered in order
+    uint8_t both[2 * SHA256_DIGEST_SIZE * 2]; // Listed line, then an unlisted username with a listed password
+    memcpy(both, creds[1].username, SHA256_DIGEST_SIZE);
+    memcpy(both + SHA256_DIGEST_SIZE, creds[1].password, SHA256_DIGEST_SIZE);
+    memcpy(both + 2 * SHA256_DIGEST_SIZE, stranger.username, SHA256_DIGEST_SIZE);
+    memcpy(both + 3 * SHA256_DIGEST_SIZE, creds[0].password, SHA256_DIGEST_SIZE);
+    size_t first = batch_frame(frame, BIN_FIELD_BOTH, 8, both, 2);
+    size_t second = batch_frame(frame + first, BIN_FIELD_PASSWORD, 9, stranger.password, 1);
+    char hex[SHA256_HEX_SIZE + 1];
+    digest_to_hex(creds[4].username, hex);
+    byte_buf_append(&in, frame, first + second);
+    byte_buf_append(&in, TEXT_CHECK_USERNAME, strlen(TEXT_CHECK_USERNAME));
+    byte_buf_append(&in, hex, SHA256_HEX_SIZE);
+    CHECK(protocol_process(&index, &in, &out, 0) == PROTO_OK && byte_buf_pending(&in) == 0);
+    const uint8_t *replies = (const uint8_t *)out.data + out.off;
+    CHECK(batch_answer(replies, BIN_HEADER_SIZE + 1, 8, 0x0b)); // Username and password of item 0, password of item 1
+    CHECK(batch_answer(replies + BIN_HEADER_SIZE + 1, BIN_HEADER_SIZE + 1, 9, 0x00));
+    CHECK(byte_buf_pending(&out) == 2 * (BIN_HEADER_SIZE + 1) + strlen("Found") &&
+          memcmp(replies + 2 * (BIN_HEADER_SIZE + 1), "Found", strlen("Found")) == 0);
+    byte_buf_free(&out);
+
+    // A length that disagrees with the count is refused, and the stream carries on
+    len = batch_frame(frame, BIN_FIELD_USERNAME, 10, items, 2);
+    frame[11] = 3; // Count 3, payload of 2
+    byte_buf_append(&in, frame, len);
+    CHECK(protocol_process(&index, &in, &out, 0) == PROTO_OK);
+    CHECK(reply_status(&out, 0, 10) == BIN_STATUS_BAD_REQUEST && byte_buf_pending(&out) == BIN_HEADER_SIZE);
+    byte_buf_free(&out);
+
+    // An unknown version is unsupported
+    len = batch_frame(frame, BIN_FIELD_USERNAME, 11, items, 1);
+    frame[1] = BIN_VERSION + 1;
+    byte_buf_append(&in, frame, len);
+    CHECK(protocol_process(&index, &in, &out, 0) == PROTO_OK);
+    CHECK(reply_status(&out, 0, 11) == BIN_STATUS_UNSUPPORTED);
+    byte_buf_free(&out);
+
+    // A payload too large to buffer closes the stream
+    bin_header huge = {BIN_VERSION, BIN_OP_CHECK_BATCH, BIN_FIELD_USERNAME, 12, 1, BIN_MAX_PAYLOAD + 1};
+    bin_header_encode(&huge, frame);
+    byte_buf_append(&in, frame, BIN_HEADER_SIZE);
+    CHECK(protocol_process(&index, &in, &out, 0) == PROTO_CLOSE);
+    CHECK(reply_status(&out, 0, 12) == BIN_STATUS_BAD_REQUEST);
+
+    byte_buf_free(&in);
+    byte_buf_free(&out);
+    cred_index_free(&index);
+    return check_report("protocol_test");
+}
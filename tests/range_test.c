@@ -0,0 +1,71 @@
+// tests/range_test.c
+// k-anonymity range replies built over the fixture's passwords: every bucket's blob
+// lists exactly the suffixes of the passwords under its prefix, range: queries return
+// that blob, and malformed prefixes or an index without ranges get their fixed replies.
+// Usage: tests/range_test <index_file> <plain_credentials_file>
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+#include "cred_index.h"
+#include "check.h"
+#include "wire.h"
+
+// "range:" followed by the first RANGE_PREFIX_HEX hex characters of `digest`
+static void range_request(char *request, const uint8_t *digest) {
+    char hex[SHA256_HEX_SIZE + 1];
+    digest_to_hex(digest, hex);
+    sprintf(request, "%s%.*s", TEXT_RANGE, RANGE_PREFIX_HEX, hex);
+}
+
+int main(int argc, char *argv[]) {
+    if (argc != 3) {
+        fprintf(stderr, "Usage: %s <index_file> <plain_credentials_file>\n", argv[0]);
+        exit(EXIT_FAILURE);
+    }
+    cred creds[CHECK_MAX_CREDS];
+    int count = load_fixture(argv[2], creds);
+    CHECK(count == 5);
+    cred_index index;
+    if (cred_index_open(&index, argv[1]) != 0) {
+        perror("Failed to open index");
+        exit(EXIT_FAILURE);
+    }
+    char request[64];
+    range_request(request, creds[0].password);
+    CHECK(strcmp(text_reply(&index, request, NULL, NULL, 0), "Range Unsupported\n") == 0);
+
+    CHECK(cred_index_build_ranges(&index) == 0);
+    const range_index *ranges = &index.password_ranges;
+    size_t listed = 0, malformed = 0;
+    for (uint32_t b = 0; b < RANGE_BUCKETS; b++) { // Every password lands in exactly one bucket
+        size_t len;
+        const char *blob = range_index_get(ranges, b, &len);
+        if (!blob || strncmp(blob, "Range ", 6) != 0) { // Blobs are not NUL-terminated, so no sscanf
+            malformed++;
+            continue;
+        }
+        size_t n = strtoul(blob + 6, NULL, 10);
+        malformed += len != (size_t)snprintf(NULL, 0, "Range %zu\n", n) + n * (RANGE_SUFFIX_HEX + 1);
+        listed += n;
+    }
+    CHECK(malformed == 0 && listed == index.passwords.count);
+    size_t len;
+    CHECK(range_index_get(ranges, RANGE_BUCKETS, &len) == NULL);
+
+    for (int i = 0; i < count; i++) { // A query returns the bucket holding the password's suffix
+        char hex[SHA256_HEX_SIZE + 1], line[RANGE_SUFFIX_HEX + 3];
+        digest_to_hex(creds[i].password, hex);
+        sprintf(line, "\n%s\n", hex + RANGE_PREFIX_HEX);
+        range_request(request, creds[i].password);
+        const char *reply = text_reply(&index, request, NULL, NULL, 0);
+        CHECK(strncmp(reply, "Range ", 6) == 0 && strstr(reply, line) != NULL);
+    }
+    cred stranger;
+    hash_cred("stranger@xyz.com", "guess", &stranger);
+    range_request(request, stranger.password); // Shares no prefix with the five passwords
+    CHECK(strcmp(text_reply(&index, request, NULL, NULL, 0), "Range 0\n") == 0);
+    CHECK(strcmp(text_reply(&index, TEXT_RANGE "5e88g", NULL, NULL, 0), "Range Invalid\n") == 0);
+
+    cred_index_free(&index);
+    return check_report("range_test");
+}
@@ -0,0 +1,85 @@
+// tests/shard_test.c
+// The shard ring and replica failover: the ring splits digests between shards in
+// similar shares, adding a shard only moves digests to it, and shard_connect skips a
+// replica that is down and reports a shard with none left. Replicas are Unix domain
+// sockets in a temporary directory, so nothing binds a TCP port.
+// Usage: tests/shard_test
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+#include <unistd.h>
+#include <sys/socket.h>
+#include "shard.h"
+#include "net.h"
+#include "check.h"
+
+#define KEYS 10000 // Digests placed on the rings
+
+static char dir[] = "/tmp/shard_test.XXXXXX";
+
+// Load a shard map from `text`, written to a file in `dir`
+static void load_map(shard_map *map, const char *text) {
+    char path[64];
+    snprintf(path, sizeof(path), "%s/map", dir);
+    FILE *file = fopen(path, "w");
+    if (!file || fputs(text, file) == EOF || fclose(file) != 0 || shard_map_load(map, path) != 0) {
+        perror("Failed to load shard map");
+        exit(EXIT_FAILURE);
+    }
+    unlink(path);
+}
+
+int main(void) {
+    if (!mkdtemp(dir)) {
+        perror("Failed to create temporary directory");
+        exit(EXIT_FAILURE);
+    }
+
+    // Two shards split the digests evenly; a third takes a share from both and moves nothing else
+    shard_map two, three;
+    load_map(&two, "a 10.0.0.1:8080\nb 10.0.0.2:8080\n");
+    load_map(&three, "a 10.0.0.1:8080\nb 10.0.0.2:8080\nc 10.0.0.3:8080\n");
+    int shares[3] = {0}, moved = 0, stray = 0;
+    for (int i = 0; i < KEYS; i++) {
+        cred c;
+        char name[32];
+        snprintf(name, sizeof(name), "user%d@abc.com", i);
+        hash_cred(name, "", &c);
+        int before = shard_owner(&two, c.username), after = shard_owner(&three, c.username);
+        shares[after]++;
+        moved += before != after;
+        stray += before != after && after != 2;
+    }
+    CHECK(shares[0] > KEYS / 5 && shares[1] > KEYS / 5 && shares[2] > KEYS / 5);
+    CHECK(moved == shares[2] && stray == 0);
+    CHECK(shard_map_find(&three, "c") == 2 && shard_map_find(&three, "d") == -1);
+    shard_map_free(&two);
+    shard_map_free(&three);
+
+    // Shard a's first replica is down; shard b has no live replica at all
+    char live[64], text[512];
+    snprintf(live, sizeof(live), "%s/live.sock", dir);
+    int listener = unix_listen(live, 4);
+    CHECK(listener >= 0);
+    snprintf(text, sizeof(text), "a %s/dead.sock:1 %s:1\nb %s/dead.sock:1\n", dir, live, dir);
+    shard_map map;
+    load_map(&map, text);
+    int replica = 0;
+    int sock = shard_connect(&map, 0, &replica);
+    CHECK(sock >= 0 && replica == 1);
+    int accepted = accept(listener, NULL, NULL);
+    CHECK(accepted >= 0);
+    close(accepted);
+    close(sock);
+    sock = shard_connect(&map, 0, &replica); // Starts from the replica that answered last
+    CHECK(sock >= 0 && replica == 1);
+    close(sock);
+    replica = 0;
+    CHECK(shard_connect(&map, 1, &replica) == -1);
+    shard_map_free(&map);
+
+    close(listener);
+    unlink(live);
+    rmdir(dir);
+    return check_report("shard_test");
+}
@@ -0,0 +1,100 @@
+// tests/shm_test.c
+// Shared-memory rings between a server and a client side attached through a Unix
+// domain socket: bytes come out in order across the end of the ring and across the
+// 32-bit counters wrapping, a full ring takes no more, counters a peer has corrupted
+// are refused with EPROTO, and a client waiting on a server that closed is told so.
+// Usage: tests/shm_test
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+#include <unistd.h>
+#include <errno.h>
+#include <pthread.h>
+#include <sys/socket.h>
+#include "shm.h"
+#include "net.h"
+#include "check.h"
+
+#define CHUNK (SHM_RING_SIZE / 3 * 2) // Two chunks do not fit at once, so the second wraps
+
+static int listen_fd;
+static shm_channel server;
+
+// Accept one client and hand it a segment, as shm_server does
+static void *serve_attach(void *arg) {
+    (void)arg;
+    int sock = accept(listen_fd, NULL, NULL);
+    if (sock < 0 || shm_channel_create(&server, sock) != 0) {
+        perror("Failed to create shared-memory channel");
+        exit(EXIT_FAILURE);
+    }
+    return NULL;
+}
+
+// Send `len` bytes of a pattern starting at `seed` from client to server, 1 if they arrive intact
+static int round_trip(shm_channel *client, uint8_t *out, uint8_t *in, size_t len, unsigned seed) {
+    for (size_t i = 0; i < len; i++) {
+        out[i] = (uint8_t)(i * 31 + seed);
+    }
+    return shm_write(client, out, len) == (ssize_t)len && shm_readable(&server) == len &&
+           shm_read(&server, in, len) == (ssize_t)len && memcmp(in, out, len) == 0 && shm_readable(&server) == 0;
+}
+
+int main(void) {
+    char path[64];
+    snprintf(path, sizeof(path), "/tmp/shm_test.%d.sock", (int)getpid());
+    if ((listen_fd = unix_listen(path, 1)) < 0) {
+        perror("Failed to listen");
+        exit(EXIT_FAILURE);
+    }
+    pthread_t thread;
+    pthread_create(&thread, NULL, serve_attach, NULL);
+    shm_channel client;
+    CHECK(shm_attach(&client, path) == 0);
+    pthread_join(thread, NULL);
+    close(listen_fd);
+    unlink(path);
+
+    uint8_t *out = malloc(SHM_RING_SIZE + 1), *in = malloc(SHM_RING_SIZE + 1);
+    if (!out || !in) {
+        perror("malloc");
+        exit(EXIT_FAILURE);
+    }
+    CHECK(shm_wait_prepare(&server, 0) == 0); // Nothing to read yet
+    CHECK(round_trip(&client, out, in, CHUNK, 1));
+    CHECK(round_trip(&client, out, in, CHUNK, 2)); // Runs past the end of the data array
+    shm_ring *requests = &client.seg->rings[SHM_CLIENT];
+    CHECK(requests->head == 2 * CHUNK && requests->tail == 2 * CHUNK);
+
+    // A full ring takes exactly SHM_RING_SIZE bytes and then nothing
+    CHECK(shm_write(&client, out, SHM_RING_SIZE + 1) == SHM_RING_SIZE && shm_write(&client, out, 1) == 0);
+    CHECK(shm_wait_prepare(&server, 0) == 1 && shm_wait_prepare(&client, 1) == 0);
+    CHECK(shm_read(&server, in, SHM_RING_SIZE + 1) == SHM_RING_SIZE && memcmp(in, out, SHM_RING_SIZE) == 0);
+
+    // The 32-bit counters wrap around zero mid-transfer
+    requests->head = requests->tail = UINT32_MAX - 99;
+    CHECK(round_trip(&client, out, in, 1000, 3));
+    CHECK(requests->head == 900);
+
+    // Counters claiming more than a ring's worth are refused, in either direction
+    uint32_t head = requests->head;
+    requests->tail = head + 1; // Reader ahead of the writer: the writer would see a huge backlog
+    errno = 0;
+    CHECK(shm_write(&client, out, 1) == -1 && errno == EPROTO);
+    requests->tail = head;
+    requests->head = head + SHM_RING_SIZE + 1; // Writer claims more than the ring holds
+    errno = 0;
+    CHECK(shm_readable(&server) > SHM_RING_SIZE && shm_read(&server, in, 1) == -1 && errno == EPROTO);
+    CHECK(shm_wait_prepare(&server, 0) == 1); // Reported as ready so the next read fails
+    requests->head = head;
+
+    // A client waiting for replies learns that the server closed
+    shm_close(&server);
+    errno = 0;
+    CHECK(shm_wait(&client, 0, 1000) == -1 && errno == EPIPE);
+    shm_close(&client);
+
+    free(out);
+    free(in);
+    return check_report("shm_test");
+}
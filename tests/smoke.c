@@ -0,0 +1,49 @@
+// tests/smoke.c
+// Smoke test of the digest index, run by `make test` after build-index has compiled the
+// plain fixture into an index file: the file must map and verify, hold each field's
+// distinct digests once, and answer check_username and check_password for every
+// fixture line and for credentials it never listed.
+// Usage: tests/smoke <index_file> <plain_credentials_file>
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+#include "cred_index.h"
+#include "check.h"
+#include "wire.h"
+
+int main(int argc, char *argv[]) {
+    if (argc != 3) {
+        fprintf(stderr, "Usage: %s <index_file> <plain_credentials_file>\n", argv[0]);
+        exit(EXIT_FAILURE);
+    }
+    cred creds[CHECK_MAX_CREDS];
+    int count = load_fixture(argv[2], creds);
+    CHECK(count == 5); // Lines 0 and 2 share the password "password"
+
+    cred_index index;
+    if (cred_index_open(&index, argv[1]) != 0) {
+        perror("Failed to open index");
+        exit(EXIT_FAILURE);
+    }
+    CHECK(index.map != NULL && cred_index_verify(&index) == 0);
+    CHECK(index.usernames.count == 5 && index.passwords.count == 4);
+
+    cred stranger;
+    hash_cred("stranger@xyz.com", "guess", &stranger); // Never listed
+    for (int i = 0; i < count; i++) {
+        CHECK(digest_set_contains(&index.usernames, creds[i].username));
+        CHECK(digest_set_contains(&index.passwords, creds[i].password));
+        CHECK(!digest_set_contains(&index.usernames, creds[i].password)); // Fields are kept apart
+    }
+    CHECK(!digest_set_contains(&index.usernames, stranger.username));
+    CHECK(!digest_set_contains(&index.passwords, stranger.password));
+
+    CHECK(strcmp(text_reply(&index, TEXT_CHECK_USERNAME, creds[4].username, NULL, 0), "Found") == 0);
+    CHECK(strcmp(text_reply(&index, TEXT_CHECK_PASSWORD, NULL, creds[2].password, 0), "Found") == 0);
+    CHECK(strcmp(text_reply(&index, TEXT_CHECK_USERNAME, stranger.username, NULL, 0), "Not Found") == 0);
+    CHECK(strcmp(text_reply(&index, TEXT_CHECK_PASSWORD, NULL, stranger.password, 0), "Not Found") == 0);
+    CHECK(strcmp(text_reply(&index, "check_username:", NULL, NULL, 0), "") == 0); // Waits for the digest
+
+    cred_index_free(&index);
+    return check_report("smoke");
+}
@@ -0,0 +1,113 @@
+// tests/udp_test.c
+// UDP query mode served in-process by udp_start over the fixture index, queried from a
+// connected socket: CHECK_BATCH datagrams up to BIN_MAX_DATAGRAM bytes are answered
+// with their request ID, a truncated frame gets BAD_REQUEST, other ops UNSUPPORTED,
+// and a datagram that is not a binary frame is dropped without a reply.
+// Usage: tests/udp_test <index_file> <plain_credentials_file>
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+#include <unistd.h>
+#include <sys/socket.h>
+#include <sys/time.h>
+#include "cred_store.h"
+#include "protocol.h"
+#include "udp.h"
+#include "net.h"
+#include "check.h"
+#include "wire.h"
+
+#define RECV_TIMEOUT_MS 200 // Wait for a reply before sending again
+#define ATTEMPTS 3 // Sends of one request before giving up, as a client would
+
+// Send `frame` until a reply arrives, returns its length, or -1 if none came
+static ssize_t ask(int sock, const uint8_t *frame, size_t len, uint8_t *reply, size_t size) {
+    for (int attempt = 0; attempt < ATTEMPTS; attempt++) {
+        if (send(sock, frame, len, 0) != (ssize_t)len) {
+            return -1;
+        }
+        ssize_t n = recv(sock, reply, size, 0);
+        if (n >= 0) {
+            return n;
+        }
+    }
+    return -1;
+}
+
+// Status of a reply, -1 if it does not answer `request_id`
+static int status_of(const uint8_t *reply, ssize_t len, uint32_t request_id) {
+    bin_header hdr;
+    if (len < BIN_HEADER_SIZE || bin_header_decode(reply, &hdr) != 0 || hdr.request_id != request_id) {
+        return -1;
+    }
+    return hdr.field;
+}
+
+int main(int argc, char *argv[]) {
+    if (argc != 3) {
+        fprintf(stderr, "Usage: %s <index_file> <plain_credentials_file>\n", argv[0]);
+        exit(EXIT_FAILURE);
+    }
+    cred creds[CHECK_MAX_CREDS];
+    CHECK(load_fixture(argv[2], creds) == 5);
+    cred_index *index = malloc(sizeof(*index)); // Owned by the store from here on
+    if (!index || cred_index_open(index, argv[1]) != 0) {
+        perror("Failed to open index");
+        exit(EXIT_FAILURE);
+    }
+    cred_store_init(index);
+    int port = 20000 + getpid() % 20000; // Apart from other runs on the same host
+    if (udp_start(port, 1) != 0) {
+        exit(EXIT_FAILURE);
+    }
+    int sock = udp_connect("127.0.0.1", port);
+    struct timeval timeout = {0, RECV_TIMEOUT_MS * 1000};
+    if (sock < 0 || setsockopt(sock, SOL_SOCKET, SO_RCVTIMEO, &timeout, sizeof(timeout)) != 0) {
+        perror("Failed to open UDP socket");
+        exit(EXIT_FAILURE);
+    }
+
+    // The largest batch a datagram carries: every fixture username, then unlisted digests
+    uint32_t most = (BIN_MAX_DATAGRAM - BIN_HEADER_SIZE) / SHA256_DIGEST_SIZE;
+    uint8_t *items = calloc(most, SHA256_DIGEST_SIZE);
+    uint8_t frame[BIN_MAX_DATAGRAM + SHA256_DIGEST_SIZE], reply[BIN_MAX_DATAGRAM];
+    for (int i = 0; i < 5; i++) {
+        memcpy(items + i * SHA256_DIGEST_SIZE, creds[i].username, SHA256_DIGEST_SIZE);
+    }
+    size_t len = batch_frame(frame, BIN_FIELD_USERNAME, 21, items, most);
+    CHECK(len <= BIN_MAX_DATAGRAM);
+    ssize_t n = ask(sock, frame, len, reply, sizeof(reply));
+    CHECK(status_of(reply, n, 21) == BIN_STATUS_OK && n == BIN_HEADER_SIZE + (ssize_t)bin_bitmap_size(BIN_FIELD_USERNAME, most));
+    int rest_clear = 1;
+    for (ssize_t i = BIN_HEADER_SIZE + 1; i < n; i++) {
+        rest_clear &= reply[i] == 0;
+    }
+    CHECK(n > BIN_HEADER_SIZE && reply[BIN_HEADER_SIZE] == 0x1f && rest_clear);
+
+    // A small batch of passwords, first an unlisted one
+    cred stranger;
+    hash_cred("stranger@xyz.com", "guess", &stranger);
+    memcpy(items, stranger.password, SHA256_DIGEST_SIZE);
+    memcpy(items + SHA256_DIGEST_SIZE, creds[3].password, SHA256_DIGEST_SIZE);
+    n = ask(sock, frame, batch_frame(frame, BIN_FIELD_PASSWORD, 22, items, 2), reply, sizeof(reply));
+    CHECK(batch_answer(reply, n, 22, 0x02));
+
+    // A frame cut short by one digest
+    len = batch_frame(frame, BIN_FIELD_USERNAME, 23, items, 2);
+    n = ask(sock, frame, len - SHA256_DIGEST_SIZE, reply, sizeof(reply));
+    CHECK(status_of(reply, n, 23) == BIN_STATUS_BAD_REQUEST && n == BIN_HEADER_SIZE);
+
+    // Filters do not fit a datagram
+    bin_header filter = {BIN_VERSION, BIN_OP_GET_FILTER, BIN_FIELD_USERNAME, 24, 0, 0};
+    bin_header_encode(&filter, frame);
+    n = ask(sock, frame, BIN_HEADER_SIZE, reply, sizeof(reply));
+    CHECK(status_of(reply, n, 24) == BIN_STATUS_UNSUPPORTED);
+
+    // A text request has no request ID to answer
+    CHECK(send(sock, TEXT_STATS, strlen(TEXT_STATS), 0) == (ssize_t)strlen(TEXT_STATS));
+    CHECK(recv(sock, reply, sizeof(reply), 0) == -1);
+
+    free(items);
+    close(sock);
+    return check_report("udp_test");
+}
@@ -0,0 +1,43 @@
+// tests/wire.c
+#include <string.h>
+#include "wire.h"
+
+const char *text_reply(const cred_index *index, const char *prefix, const uint8_t *username,
+                       const uint8_t *password, int admin) {
+    static char reply[256];
+    char request[256], hex[SHA256_HEX_SIZE + 1];
+    strcpy(request, prefix);
+    if (username) {
+        digest_to_hex(username, hex);
+        strcat(request, hex);
+    }
+    if (password) {
+        digest_to_hex(password, hex);
+        strcat(request, username ? ":" : "");
+        strcat(request, hex);
+    }
+
+    byte_buf in = {0}, out = {0};
+    byte_buf_append(&in, request, strlen(request));
+    protocol_process(index, &in, &out, admin);
+    size_t len = byte_buf_pending(&out) < sizeof(reply) - 1 ? byte_buf_pending(&out) : sizeof(reply) - 1;
+    memcpy(reply, out.data + out.off, len);
+    reply[len] = '\0';
+    byte_buf_free(&in);
+    byte_buf_free(&out);
+    return reply;
+}
+
+size_t batch_frame(uint8_t *frame, uint8_t field, uint32_t request_id, const uint8_t *items, uint32_t count) {
+    bin_header hdr = {BIN_VERSION, BIN_OP_CHECK_BATCH, field, request_id, count,
+                      count * (uint32_t)bin_item_size(field)};
+    bin_header_encode(&hdr, frame);
+    memcpy(frame + BIN_HEADER_SIZE, items, hdr.length);
+    return BIN_HEADER_SIZE + hdr.length;
+}
+
+int batch_answer(const uint8_t *reply, size_t len, uint32_t request_id, uint8_t bits) {
+    bin_header hdr;
+    return len == BIN_HEADER_SIZE + 1 && bin_header_decode(reply, &hdr) == 0 && hdr.field == BIN_STATUS_OK &&
+           hdr.request_id == request_id && hdr.length == 1 && reply[BIN_HEADER_SIZE] == bits;
+}
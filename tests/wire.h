@@ -0,0 +1,19 @@
+// tests/wire.h
+// Requests built by hand and replies taken apart for the protocol tests, so they
+// exercise protocol.c without a client in between.
+
+#ifndef _WIRE_H_
+#define _WIRE_H_
+
+#include <stddef.h>
+#include <stdint.h>
+#include "protocol.h"
+
+const char *text_reply(const cred_index *index, const char *prefix, const uint8_t *username,
+                       const uint8_t *password, int admin); // Reply to prefix + hex digests, overwritten by the next call
+size_t batch_frame(uint8_t *frame, uint8_t field, uint32_t request_id, const uint8_t *items,
+                   uint32_t count); // Encode a CHECK_BATCH frame, returns its length
+int batch_answer(const uint8_t *reply, size_t len, uint32_t request_id,
+                 uint8_t bits); // 1 if `reply` answers `request_id` OK with the one-byte bitmap `bits`
+
+#endif
@@ -0,0 +1,131 @@
+// udp.c
+#define _GNU_SOURCE // recvmmsg, sendmmsg
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+#include <errno.h>
+#include <pthread.h>
+#include <sys/socket.h>
+#include "net.h"
+#include "cred_store.h"
+#include "protocol.h"
+#include "stats.h"
+#include "udp.h"
+
+#define UDP_BATCH 64 // Datagrams taken per recvmmsg call
+
+// One serving thread and its socket
+typedef struct {
+    int fd; // SO_REUSEPORT socket of this thread
+    int reader_slot; // cred_store reader slot of the thread
+} udp_worker;
+
+// Send every queued reply, skipping one the kernel refuses (sender gone, no route, ...)
+static void send_replies(int fd, struct mmsghdr *replies, int count) {
+    int sent = 0;
+    while (sent < count) {
+        int n = sendmmsg(fd, replies + sent, count - sent, 0);
+        if (n < 0) {
+            if (errno != EINTR) {
+                sent++; // The sender is not waiting for a reply we cannot deliver
+            }
+            continue;
+        }
+        for (int i = sent; i < sent + n; i++) {
+            stats_bytes(0, replies[i].msg_len);
+        }
+        sent += n;
+    }
+}
+
+static void *udp_loop(void *arg) {
+    udp_worker *w = arg;
+    struct mmsghdr requests[UDP_BATCH], replies[UDP_BATCH];
+    struct iovec request_iov[UDP_BATCH], reply_iov[UDP_BATCH];
+    struct sockaddr_storage senders[UDP_BATCH]; // Where each reply goes
+    size_t offsets[UDP_BATCH]; // Start of each reply in `out`
+    uint8_t *buffers = malloc((size_t)UDP_BATCH * BIN_MAX_DATAGRAM);
+    byte_buf out = {0}; // Replies of the current batch, back to back
+    if (!buffers) {
+        perror("Out of memory");
+        exit(EXIT_FAILURE);
+    }
+
+    while (1) {
+        for (int i = 0; i < UDP_BATCH; i++) {
+            request_iov[i].iov_base = buffers + (size_t)i * BIN_MAX_DATAGRAM;
+            request_iov[i].iov_len = BIN_MAX_DATAGRAM;
+            memset(&requests[i].msg_hdr, 0, sizeof(requests[i].msg_hdr));
+            requests[i].msg_hdr.msg_iov = &request_iov[i];
+            requests[i].msg_hdr.msg_iovlen = 1;
+            requests[i].msg_hdr.msg_name = &senders[i];
+            requests[i].msg_hdr.msg_namelen = sizeof(senders[i]);
+        }
+        // Sleep until one datagram arrives, then take whatever else is already queued
+        int n = recvmmsg(w->fd, requests, UDP_BATCH, MSG_WAITFORONE, NULL);
+        if (n < 0) {
+            if (errno == EINTR) {
+                continue;
+            }
+            perror("recvmmsg");
+            exit(EXIT_FAILURE);
+        }
+
+        int count = 0; // Replies queued
+        out.off = out.len = 0;
+        const cred_index *index = cred_store_enter(w->reader_slot); // Fixed for this batch of datagrams
+        for (int i = 0; i < n; i++) {
+            size_t len = requests[i].msg_len;
+            size_t before = out.len;
+            stats_bytes(len, 0);
+            // A datagram cut short (MSG_TRUNC) no longer matches its header's length and
+            // is answered BAD_REQUEST
+            if (protocol_answer_datagram(index, request_iov[i].iov_base, len, &out) != 0) {
+                out.len = before; // Dropped, along with any partial reply
+                continue;
+            }
+            offsets[count] = before;
+            reply_iov[count].iov_len = out.len - before;
+            memset(&replies[count].msg_hdr, 0, sizeof(replies[count].msg_hdr));
+            replies[count].msg_hdr.msg_iov = &reply_iov[count];
+            replies[count].msg_hdr.msg_iovlen = 1;
+            replies[count].msg_hdr.msg_name = &senders[i];
+            replies[count].msg_hdr.msg_namelen = requests[i].msg_hdr.msg_namelen;
+            count++;
+        }
+        cred_store_leave(w->reader_slot); // Lets a reload free the index we just used
+
+        for (int i = 0; i < count; i++) {
+            reply_iov[i].iov_base = out.data + offsets[i]; // `out` may have moved while growing
+        }
+        send_replies(w->fd, replies, count);
+    }
+    return NULL;
+}
+
+int udp_start(int port, int threads) {
+    for (int t = 0; t < threads; t++) {
+        udp_worker *w = malloc(sizeof(*w));
+        if (!w) {
+            perror("Out of memory");
+            return -1;
+        }
+        if ((w->reader_slot = cred_store_register()) < 0) {
+            fprintf(stderr, "Too many threads\n");
+            free(w);
+            return -1;
+        }
+        if ((w->fd = udp_bind(port)) < 0) {
+            free(w);
+            return -1;
+        }
+        pthread_t thread;
+        if (pthread_create(&thread, NULL, udp_loop, w) != 0) {
+            perror("pthread_create");
+            return -1;
+        }
+    }
+    printf("Answering UDP queries on port %d with %d threads\n", port, threads);
+    fflush(stdout);
+    return 0;
+}
@@ -0,0 +1,16 @@
+// udp.h
+// Connectionless query mode. A client that only needs a few digests answered pays for
+// a TCP handshake and teardown per session; over UDP one datagram carries a binary
+// CHECK_BATCH frame (see protocol.h) and one datagram brings back its reply, matched by
+// request ID. Nothing is retransmitted by the server: a client that hears nothing in
+// time sends the request again or tries another replica. Each thread owns a
+// SO_REUSEPORT socket on the TCP port number, so the kernel spreads senders over them,
+// and moves a batch of datagrams per recvmmsg/sendmmsg call. It runs next to whichever
+// socket backend serves TCP.
+
+#ifndef _UDP_H_
+#define _UDP_H_
+
+int udp_start(int port, int threads); // Bind and serve from `threads` new threads, -1 on setup error
+
+#endif
@@ -0,0 +1,389 @@
+// uring.c
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+#include <errno.h>
+#include <unistd.h>
+#include <pthread.h>
+#include <sys/mman.h>
+#include <sys/socket.h>
+#include <sys/syscall.h>
+#include <netinet/in.h>
+#include <netinet/tcp.h>
+#include <linux/io_uring.h>
+#include "net.h"
+#include "cred_store.h"
+#include "protocol.h"
+#include "stats.h"
+#include "uring.h"
+
+#define RING_ENTRIES 1024 // Submission queue slots per thread
+#define CQ_ENTRIES (RING_ENTRIES * 4) // Completion slots; multishot requests post many each
+#define BUFFER_COUNT 1024 // Provided receive buffers per thread, a power of two
+#define BUFFER_SIZE 16384 // Bytes per receive buffer
+#define BUFFER_GROUP 0 // Group ID of the provided buffer ring
+#define MAX_PENDING_OUTPUT (1 << 20) // Stop receiving from a client that is not draining replies
+
+// Low bits of user_data say which operation completed; the rest is the connection
+#define TAG_ACCEPT 1 // Multishot accept on a listening socket, whose descriptor is the rest
+#define TAG_RECV 2 // Multishot recv of a connection
+#define TAG_SEND 3 // Send of a connection's output
+#define TAG_CANCEL 4 // Cancellation of a recv, nothing to do on completion
+#define TAG_MASK 7
+
+// State of one client connection
+typedef struct {
+    int fd; // Client socket
+    byte_buf in; // Received bytes not yet forming a complete request
+    byte_buf out; // Replies queued while a send is in flight
+    byte_buf sending; // Bytes handed to the kernel, left untouched until the send completes
+    int receiving; // Multishot recv armed
+    int cancelling; // Cancellation of that recv submitted
+    int send_busy; // Send in flight
+    int closing; // Close once output is flushed and no operation is in flight
+    int failed; // Socket error, drop unsent output
+    int admin; // Accepted on the Unix domain socket, so reload commands are allowed
+} __attribute__((aligned(TAG_MASK + 1))) uring_conn;
+
+// One thread's ring and listening socket
+typedef struct {
+    int reader_slot; // This thread's cred_store reader slot
+    int listen_fd; // This thread's SO_REUSEPORT listening socket
+    int unix_fd; // Unix domain socket shared by every thread, -1 if none
+    int fd; // io_uring instance
+    unsigned *sq_head, *sq_tail, *sq_array; // Submission ring, shared with the kernel
+    unsigned sq_mask, sq_entries;
+    unsigned sq_local_tail; // Tail including SQEs not yet published
+    struct io_uring_sqe *sqes;
+    unsigned *cq_head, *cq_tail; // Completion ring, shared with the kernel
+    unsigned cq_mask;
+    struct io_uring_cqe *cqes;
+    struct io_uring_buf_ring *buf_ring; // Provided receive buffers
+    uint16_t buf_tail; // Buffers handed to the kernel so far
+    char *buffers; // BUFFER_COUNT * BUFFER_SIZE bytes
+    pthread_t thread; // Thread running the loop
+} uring_loop;
+
+static int ring_setup_call(unsigned entries, struct io_uring_params *p) {
+    return (int)syscall(__NR_io_uring_setup, entries, p);
+}
+
+// Publish queued SQEs and submit them, waiting for `wait` completions
+static int ring_enter(uring_loop *u, unsigned wait) {
+    __atomic_store_n(u->sq_tail, u->sq_local_tail, __ATOMIC_RELEASE);
+    unsigned pending = u->sq_local_tail - __atomic_load_n(u->sq_head, __ATOMIC_ACQUIRE);
+    if (pending == 0 && wait == 0) {
+        return 0;
+    }
+    return (int)syscall(__NR_io_uring_enter, u->fd, pending, wait, wait ? IORING_ENTER_GETEVENTS : 0, NULL, 0);
+}
+
+// Next free SQE, zeroed; submits what is queued if the ring is full
+static struct io_uring_sqe *sqe_get(uring_loop *u) {
+    while (u->sq_local_tail - __atomic_load_n(u->sq_head, __ATOMIC_ACQUIRE) == u->sq_entries) {
+        if (ring_enter(u, 0) < 0 && errno != EINTR && errno != EAGAIN && errno != EBUSY) {
+            perror("io_uring_enter");
+            exit(EXIT_FAILURE);
+        }
+    }
+    struct io_uring_sqe *sqe = &u->sqes[u->sq_local_tail++ & u->sq_mask];
+    memset(sqe, 0, sizeof(*sqe));
+    return sqe;
+}
+
+// Hand receive buffer `bid` (back) to the kernel
+static void buffer_return(uring_loop *u, unsigned bid) {
+    struct io_uring_buf *buf = &u->buf_ring->bufs[u->buf_tail & (BUFFER_COUNT - 1)];
+    buf->addr = (uintptr_t)(u->buffers + (size_t)bid * BUFFER_SIZE);
+    buf->len = BUFFER_SIZE;
+    buf->bid = bid;
+    u->buf_tail++;
+    __atomic_store_n(&u->buf_ring->tail, u->buf_tail, __ATOMIC_RELEASE);
+}
+
+// Create the ring and register its receive buffers, on the thread that will use it
+static int ring_init(uring_loop *u) {
+    struct io_uring_params p;
+    memset(&p, 0, sizeof(p));
+    p.flags = IORING_SETUP_CQSIZE | IORING_SETUP_SINGLE_ISSUER | IORING_SETUP_DEFER_TASKRUN;
+    p.cq_entries = CQ_ENTRIES;
+    u->fd = ring_setup_call(RING_ENTRIES, &p);
+    if (u->fd < 0 && errno == EINVAL) { // Kernels before 6.1 run completions eagerly instead
+        memset(&p, 0, sizeof(p));
+        p.flags = IORING_SETUP_CQSIZE;
+        p.cq_entries = CQ_ENTRIES;
+        u->fd = ring_setup_call(RING_ENTRIES, &p);
+    }
+    if (u->fd < 0) {
+        return -1;
+    }
+    if (!(p.features & IORING_FEAT_SINGLE_MMAP)) {
+        errno = ENOSYS; // Kernels before 5.4
+        return -1;
+    }
+
+    size_t sq_size = p.sq_off.array + p.sq_entries * sizeof(unsigned);
+    size_t cq_size = p.cq_off.cqes + p.cq_entries * sizeof(struct io_uring_cqe);
+    size_t ring_size = sq_size > cq_size ? sq_size : cq_size; // Both rings share one mapping
+    char *ring = mmap(NULL, ring_size, PROT_READ | PROT_WRITE, MAP_SHARED | MAP_POPULATE, u->fd, IORING_OFF_SQ_RING);
+    if (ring == MAP_FAILED) {
+        return -1;
+    }
+    u->sqes = mmap(NULL, p.sq_entries * sizeof(struct io_uring_sqe), PROT_READ | PROT_WRITE,
+                   MAP_SHARED | MAP_POPULATE, u->fd, IORING_OFF_SQES);
+    if (u->sqes == MAP_FAILED) {
+        return -1;
+    }
+    u->sq_head = (unsigned *)(ring + p.sq_off.head);
+    u->sq_tail = (unsigned *)(ring + p.sq_off.tail);
+    u->sq_array = (unsigned *)(ring + p.sq_off.array);
+    u->sq_mask = *(unsigned *)(ring + p.sq_off.ring_mask);
+    u->sq_entries = p.sq_entries;
+    u->sq_local_tail = *u->sq_tail;
+    for (unsigned i = 0; i < p.sq_entries; i++) {
+        u->sq_array[i] = i; // Slot i always holds SQE i
+    }
+    u->cq_head = (unsigned *)(ring + p.cq_off.head);
+    u->cq_tail = (unsigned *)(ring + p.cq_off.tail);
+    u->cq_mask = *(unsigned *)(ring + p.cq_off.ring_mask);
+    u->cqes = (struct io_uring_cqe *)(ring + p.cq_off.cqes);
+
+    if (posix_memalign((void **)&u->buf_ring, 4096, BUFFER_COUNT * sizeof(struct io_uring_buf)) != 0 ||
+        !(u->buffers = malloc((size_t)BUFFER_COUNT * BUFFER_SIZE))) {
+        errno = ENOMEM;
+        return -1;
+    }
+    memset(u->buf_ring, 0, BUFFER_COUNT * sizeof(struct io_uring_buf));
+    struct io_uring_buf_reg reg;
+    memset(&reg, 0, sizeof(reg));
+    reg.ring_addr = (uintptr_t)u->buf_ring;
+    reg.ring_entries = BUFFER_COUNT;
+    reg.bgid = BUFFER_GROUP;
+    if (syscall(__NR_io_uring_register, u->fd, IORING_REGISTER_PBUF_RING, &reg, 1) != 0) {
+        return -1; // Kernels before 5.19
+    }
+    for (unsigned bid = 0; bid < BUFFER_COUNT; bid++) {
+        buffer_return(u, bid);
+    }
+    return 0;
+}
+
+static void arm_accept(uring_loop *u, int listen_fd) {
+    struct io_uring_sqe *sqe = sqe_get(u);
+    sqe->opcode = IORING_OP_ACCEPT;
+    sqe->fd = listen_fd;
+    sqe->ioprio = IORING_ACCEPT_MULTISHOT; // One completion per connection until cancelled
+    sqe->accept_flags = SOCK_CLOEXEC;
+    sqe->user_data = ((uint64_t)listen_fd << 3) | TAG_ACCEPT;
+}
+
+static void arm_recv(uring_loop *u, uring_conn *c) {
+    struct io_uring_sqe *sqe = sqe_get(u);
+    sqe->opcode = IORING_OP_RECV;
+    sqe->fd = c->fd;
+    sqe->ioprio = IORING_RECV_MULTISHOT; // One completion per arrival, each in a provided buffer
+    sqe->flags = IOSQE_BUFFER_SELECT;
+    sqe->buf_group = BUFFER_GROUP;
+    sqe->user_data = (uintptr_t)c | TAG_RECV;
+    c->receiving = 1;
+}
+
+static void cancel_recv(uring_loop *u, uring_conn *c) {
+    struct io_uring_sqe *sqe = sqe_get(u);
+    sqe->opcode = IORING_OP_ASYNC_CANCEL;
+    sqe->fd = -1;
+    sqe->addr = (uintptr_t)c | TAG_RECV;
+    sqe->user_data = TAG_CANCEL;
+    c->cancelling = 1;
+}
+
+static void start_send(uring_loop *u, uring_conn *c) {
+    if (byte_buf_pending(&c->sending) == 0) { // Swap in the replies queued since the last send
+        byte_buf drained = c->sending;
+        c->sending = c->out;
+        c->out = drained;
+        c->out.off = c->out.len = 0;
+    }
+    struct io_uring_sqe *sqe = sqe_get(u);
+    sqe->opcode = IORING_OP_SEND;
+    sqe->fd = c->fd;
+    sqe->addr = (uintptr_t)(c->sending.data + c->sending.off);
+    sqe->len = byte_buf_pending(&c->sending);
+    sqe->msg_flags = MSG_NOSIGNAL;
+    sqe->user_data = (uintptr_t)c | TAG_SEND;
+    c->send_busy = 1;
+}
+
+// Queue whatever the connection needs next, or free it once it is done
+static void conn_update(uring_loop *u, uring_conn *c) {
+    if (c->failed) {
+        byte_buf_consume(&c->out, byte_buf_pending(&c->out));
+        if (!c->send_busy) {
+            byte_buf_consume(&c->sending, byte_buf_pending(&c->sending));
+        }
+    }
+    size_t backlog = byte_buf_pending(&c->out) + byte_buf_pending(&c->sending);
+    if (!c->send_busy && backlog > 0) {
+        start_send(u, c);
+    }
+    if (c->receiving && !c->cancelling && (c->closing || backlog >= MAX_PENDING_OUTPUT)) {
+        cancel_recv(u, c); // Re-armed once the client reads its replies
+    } else if (!c->receiving && !c->closing && backlog < MAX_PENDING_OUTPUT) {
+        arm_recv(u, c);
+    }
+    if (c->closing && !c->receiving && !c->send_busy && backlog == 0) {
+        close(c->fd); // Close the client socket
+        byte_buf_free(&c->in);
+        byte_buf_free(&c->out);
+        byte_buf_free(&c->sending);
+        free(c);
+        stats_connection(0);
+    }
+}
+
+static void on_accept(uring_loop *u, const struct io_uring_cqe *cqe) {
+    int listen_fd = (int)(cqe->user_data >> 3);
+    if (!(cqe->flags & IORING_CQE_F_MORE)) {
+        arm_accept(u, listen_fd); // The kernel ended the multishot accept (e.g. out of descriptors)
+    }
+    if (cqe->res < 0) {
+        if (cqe->res != -ECANCELED) {
+            errno = -cqe->res;
+            perror("Accept failed");
+        }
+        return;
+    }
+    int client_sock = cqe->res;
+    if (listen_fd == u->listen_fd) {
+        int opt = 1; // Replies are tiny, do not hold them back for coalescing
+        setsockopt(client_sock, IPPROTO_TCP, TCP_NODELAY, &opt, sizeof(opt));
+    }
+    uring_conn *c = calloc(1, sizeof(*c));
+    if (!c) {
+        close(client_sock);
+        return;
+    }
+    c->fd = client_sock;
+    c->admin = listen_fd == u->unix_fd; // Reachable only by local users the socket file lets in
+    stats_connection(1);
+    conn_update(u, c); // Arms the first recv
+}
+
+static void on_recv(uring_loop *u, const cred_index *index, uring_conn *c, const struct io_uring_cqe *cqe) {
+    if (cqe->flags & IORING_CQE_F_BUFFER) {
+        unsigned bid = cqe->flags >> IORING_CQE_BUFFER_SHIFT;
+        if (cqe->res > 0 && !c->closing) {
+            stats_bytes(cqe->res, 0);
+            if (byte_buf_append(&c->in, u->buffers + (size_t)bid * BUFFER_SIZE, cqe->res) != 0 ||
+                protocol_process(index, &c->in, &c->out, c->admin) == PROTO_CLOSE) {
+                c->closing = 1; // Exit request, bad request or out of memory
+            }
+        }
+        buffer_return(u, bid); // Copied out, the kernel may reuse it
+    }
+    if (cqe->res == 0) {
+        c->closing = 1; // Client hung up
+    } else if (cqe->res < 0 && cqe->res != -ENOBUFS && cqe->res != -ECANCELED) {
+        c->closing = c->failed = 1; // Connection reset or similar
+    }
+    if (!(cqe->flags & IORING_CQE_F_MORE)) {
+        c->receiving = c->cancelling = 0; // Out of buffers, cancelled or finished; conn_update decides
+    }
+    conn_update(u, c);
+}
+
+static void on_send(uring_loop *u, uring_conn *c, const struct io_uring_cqe *cqe) {
+    c->send_busy = 0;
+    if (cqe->res > 0) {
+        byte_buf_consume(&c->sending, cqe->res); // A short send is resumed by conn_update
+        stats_bytes(0, cqe->res);
+    } else if (cqe->res < 0) {
+        c->closing = c->failed = 1;
+    }
+    conn_update(u, c);
+}
+
+static void *uring_loop_run(void *arg) {
+    uring_loop *u = arg;
+    if (ring_init(u) != 0) {
+        perror("io_uring setup");
+        exit(EXIT_FAILURE);
+    }
+    arm_accept(u, u->listen_fd);
+    if (u->unix_fd >= 0) {
+        arm_accept(u, u->unix_fd); // Every thread takes connections from the shared socket
+    }
+
+    while (1) {
+        if (ring_enter(u, 1) < 0 && errno != EINTR && errno != EAGAIN && errno != EBUSY) { // Submit and wait in one call
+            perror("io_uring_enter");
+            exit(EXIT_FAILURE);
+        }
+
+        const cred_index *index = cred_store_enter(u->reader_slot); // Fixed for this batch of completions
+        unsigned head = *u->cq_head;
+        unsigned tail = __atomic_load_n(u->cq_tail, __ATOMIC_ACQUIRE);
+        for (; head != tail; head++) {
+            struct io_uring_cqe cqe = u->cqes[head & u->cq_mask];
+            uring_conn *c = (uring_conn *)(uintptr_t)(cqe.user_data & ~(uint64_t)TAG_MASK);
+            switch (cqe.user_data & TAG_MASK) {
+            case TAG_ACCEPT:
+                on_accept(u, &cqe);
+                break;
+            case TAG_RECV:
+                on_recv(u, index, c, &cqe);
+                break;
+            case TAG_SEND:
+                on_send(u, c, &cqe);
+                break;
+            }
+        }
+        __atomic_store_n(u->cq_head, head, __ATOMIC_RELEASE);
+        cred_store_leave(u->reader_slot); // Lets a reload free the index we just used
+    }
+    return NULL;
+}
+
+int uring_run(int port, int unix_fd, int threads) {
+    struct io_uring_params p; // Fail at startup, not in a thread, if io_uring is unavailable
+    memset(&p, 0, sizeof(p));
+    int probe = ring_setup_call(1, &p);
+    if (probe < 0) {
+        perror("io_uring is not available");
+        return -1;
+    }
+    close(probe);
+
+    uring_loop *loops = calloc(threads, sizeof(*loops));
+    if (!loops) {
+        return -1;
+    }
+    // Set up every listener before starting any thread so bind errors surface at startup
+    for (int i = 0; i < threads; i++) {
+        uring_loop *u = &loops[i];
+        u->reader_slot = cred_store_register();
+        if (u->reader_slot < 0) {
+            fprintf(stderr, "Too many threads\n");
+            return -1;
+        }
+        u->listen_fd = tcp_listen(port, SOMAXCONN);
+        if (u->listen_fd < 0) {
+            return -1;
+        }
+        u->unix_fd = unix_fd;
+    }
+
+    printf("Server listening on port %d with %d io_uring threads\n", port, threads); // Print server listening message
+    fflush(stdout);
+
+    for (int i = 0; i < threads; i++) {
+        if (pthread_create(&loops[i].thread, NULL, uring_loop_run, &loops[i]) != 0) {
+            perror("pthread_create");
+            return -1;
+        }
+    }
+    for (int i = 0; i < threads; i++) {
+        pthread_join(loops[i].thread, NULL);
+    }
+    return 0;
+}
@@ -0,0 +1,17 @@
+// uring.h
+// io_uring server backend, an alternative to reactor.c selected with -m uring. Each
+// thread owns a ring and a SO_REUSEPORT listening socket, and shares the Unix domain
+// socket if one is given. One multishot accept per listening socket keeps
+// connections coming and one multishot recv per connection keeps data coming, with
+// receive buffers picked by the kernel from a ring of provided buffers, so nothing is
+// re-armed per request. Completions are handled in batches and every send queued while
+// handling them goes to the kernel in a single io_uring_enter, which also waits for
+// the next batch: one system call per batch instead of a recv and a send per request.
+// Requests are answered by the same protocol_process as the other backends.
+
+#ifndef _URING_H_
+#define _URING_H_
+
+int uring_run(int port, int unix_fd, int threads); // Serve until the process exits, -1 on setup error; unix_fd may be -1
+
+#endif